@@ -6,9 +6,75 @@
 
       end
 
+c     save (id=0) or restore (id=1) the formula generated by njform,
+c     so that njsum can evaluate it after another formula was set up.
       subroutine cpydat(nd, idata, id)
+      integer nd, idata(*), id
+      DIMENSION K6(40),K7(80),K8(40),KW(6,20),J2TEST(12),J3TEST(12)
+      COMMON/COUPLE/M,N,J1(40),J2(12,3),J3(12,3)
+      COMMON/DIMEN/KFL1,KFL2,KFL3,KFL4,KFL5,KFL6,KFL7
+      COMMON/JCONST/J6C,J7C,J8C,JWC,ICOUNT,K6,K7,K8,KW,J2TEST,J3TEST
+!$OMP THREADPRIVATE(/COUPLE/,/DIMEN/,/JCONST/)
 
-      write(*,*) 'not implemented'
+      if (nd .lt. 390) then
+         write(*,*) 'cpydat: data array too small', nd
+         return
+      endif
+      if (id .eq. 0) then
+         idata(1) = m
+         idata(2) = n
+         idata(3) = kfl1
+         idata(4) = kfl2
+         idata(5) = kfl3
+         idata(6) = kfl4
+         idata(7) = kfl5
+         idata(8) = kfl6
+         idata(9) = kfl7
+         idata(10) = j6c
+         idata(11) = j7c
+         idata(12) = j8c
+         idata(13) = jwc
+         idata(14) = icount
+      else
+         m = idata(1)
+         n = idata(2)
+         kfl1 = idata(3)
+         kfl2 = idata(4)
+         kfl3 = idata(5)
+         kfl4 = idata(6)
+         kfl5 = idata(7)
+         kfl6 = idata(8)
+         kfl7 = idata(9)
+         j6c = idata(10)
+         j7c = idata(11)
+         j8c = idata(12)
+         jwc = idata(13)
+         icount = idata(14)
+      endif
+      k = 15
+      call njcpy(36, j2, idata(k), id)
+      call njcpy(36, j3, idata(k+36), id)
+      k = k + 72
+      call njcpy(40, k6, idata(k), id)
+      call njcpy(80, k7, idata(k+40), id)
+      call njcpy(40, k8, idata(k+120), id)
+      call njcpy(120, kw, idata(k+160), id)
+      call njcpy(12, j2test, idata(k+280), id)
+      call njcpy(12, j3test, idata(k+292), id)
+      end
+
+      subroutine njcpy(n, ia, ib, id)
+      integer n, ia(n), ib(n), id
+
+      if (id .eq. 0) then
+         do i = 1, n
+            ib(i) = ia(i)
+         enddo
+      else
+         do i = 1, n
+            ia(i) = ib(i)
+         enddo
+      endif
       end
 
       subroutine njform(im, nb, ij2, ij3, ifree)  
@@ -17,6 +17,7 @@
  */
 
 #include "angular.h"
+#include "mpiutil.h"
 
 static char *rcsid="$Id$";
 #if __GNUC__ == 2
@@ -120,6 +121,29 @@ int Triangle(int j1, int j2, int j3) {
 static double _sumk[MAXTERM];
 #pragma omp threadprivate(_sumk)
 
+/*
+** tables of the 3j and 6j symbols in the Regge-reduced form.
+** _wjmax is the largest 2j covered, 0 disables the tables.
+** _wcomb[k][n] holds the binomial coefficients C(n, k) used to
+** rank the reduced parameters.
+*/
+#define WJT_MAX 100
+static int _wjmax = 0;
+static char _wfile[1024] = "";
+static double *_w3jt = NULL;
+static double *_w6jt = NULL;
+static long long _w3jn = 0;
+static long long _w6jn = 0;
+static long long _wcomb[7][WJT_MAX+8];
+#define WSORT2(x, y) {int _t = Min(x, y); y = Max(x, y); x = _t;}
+
+static double W3jDirect(int j1, int j2, int j3, int m1, int m2, int m3);
+static double W6jDirect(int j1, int j2, int j3, int i1, int i2, int i3);
+static int W3jTable(int j1, int j2, int j3, int m1, int m2, int m3,
+		    double *r);
+static int W6jTable(int j1, int j2, int j3, int i1, int i2, int i3,
+		    double *r);
+
 /* 
 ** FUNCTION:    W3j.
 ** PURPOSE:     calculate the Wigner 3j symbol.
@@ -146,8 +170,7 @@ static double _sumk[MAXTERM];
 **              issues a warning.
 */
 double W3j(int j1, int j2, int j3, int m1, int m2, int m3) {
-  int i, k, kmin, kmax, ik[14];
-  double delta, qsum, a, b;
+  double b;
 
 #ifdef PERFORM_STATISTICS
   clock_t start, stop; 
@@ -155,10 +178,35 @@ double W3j(int j1, int j2, int j3, int m1, int m2, int m3) {
 #endif
 
   if (m1 + m2 + m3) return 0.0;
-  if (!Triangle(j1, j2, j3)) return 0.0;
-  if (abs(m1) > j1) return 0.0;
-  if (abs(m2) > j2) return 0.0;
-  if (abs(m3) > j3) return 0.0;
+  if (_w3jt == NULL || !W3jTable(j1, j2, j3, m1, m2, m3, &b)) {
+    if (!Triangle(j1, j2, j3)) return 0.0;
+    if (abs(m1) > j1) return 0.0;
+    if (abs(m2) > j2) return 0.0;
+    if (abs(m3) > j3) return 0.0;
+    b = W3jDirect(j1, j2, j3, m1, m2, m3);
+  }
+
+#ifdef PERFORM_STATISTICS
+  stop = clock();
+  timing.w3j += stop -start;
+#endif
+
+  return b;
+}
+
+/*
+** FUNCTION:    W3jDirect.
+** PURPOSE:     evaluate the 3j symbol from the Racah formula.
+** INPUT:       see W3j.
+** RETURN:      {double},
+**              3j coefficients.
+** SIDE EFFECT: 
+** NOTE:        the selection rules must have been checked 
+**              by the caller.
+*/
+static double W3jDirect(int j1, int j2, int j3, int m1, int m2, int m3) {
+  int i, k, kmin, kmax, ik[14];
+  double delta, qsum, a, b;
 
   ik[0] = j1 + j2 - j3;
   ik[1] = j1 - j2 + j3;
@@ -214,11 +262,6 @@ double W3j(int j1, int j2, int j3, int m1, int m2, int m3) {
   b = exp(0.5*delta-a);
   b *= qsum; 
 
-#ifdef PERFORM_STATISTICS
-  stop = clock();
-  timing.w3j += stop -start;
-#endif
-
   return b;
 }
 
@@ -243,19 +286,42 @@ double W3j(int j1, int j2, int j3, int m1, int m2, int m3) {
 ** NOTE:        
 */
 double W6j(int j1, int j2, int j3, int i1, int i2, int i3) {
-  int n1, n2, n3, n4, n5, n6, n7, k, kmin, kmax, ic, ki;
-  double r, a;
+  double r;
 
 #ifdef PERFORM_STATISTICS
   clock_t start, stop;
   start = clock();
 #endif
 
-  if (!(Triangle(j1, j2, j3) &&
-	Triangle(j1, i2, i3) &&
-	Triangle(i1, j2, i3) &&
-	Triangle(i1, i2, j3)))
-    return 0.0;
+  if (_w6jt == NULL || !W6jTable(j1, j2, j3, i1, i2, i3, &r)) {
+    if (!(Triangle(j1, j2, j3) &&
+	  Triangle(j1, i2, i3) &&
+	  Triangle(i1, j2, i3) &&
+	  Triangle(i1, i2, j3)))
+      return 0.0;
+    r = W6jDirect(j1, j2, j3, i1, i2, i3);
+  }
+
+#ifdef PERFORM_STATISTICS
+  stop = clock();
+  timing.w6j += stop - start;
+#endif
+  return r;
+}
+
+/*
+** FUNCTION:    W6jDirect.
+** PURPOSE:     evaluate the 6j symbol from the Racah formula.
+** INPUT:       see W6j.
+** RETURN:      {double},
+**              6j symbol.
+** SIDE EFFECT: 
+** NOTE:        the triangular relations must have been checked
+**              by the caller.
+*/
+static double W6jDirect(int j1, int j2, int j3, int i1, int i2, int i3) {
+  int n1, n2, n3, n4, n5, n6, n7, k, kmin, kmax, ic, ki;
+  double r, a;
 
   n1 = (j1 + j2 + j3) / 2;
   n2 = (i2 + i1 + j3) / 2;
@@ -302,12 +368,7 @@ double W6j(int j1, int j2, int j3, int i1, int i2, int i3) {
   if (IsEven(n5+kmin)) r = -r;
   if (IsOdd(((j1+j2+i1+i2)/2))) r = -r;
 
-#ifdef PERFORM_STATISTICS
-  stop = clock();
-  timing.w6j += stop - start;
-#endif
   return r;
-
 }
 
 /* 
@@ -446,6 +507,377 @@ int W9jTriangle(int j1, int j2, int j3,
 	  Triangle(j3, i3, k3));
 }
 
+/*
+** FUNCTION:    WRank.
+** PURPOSE:     rank of a tuple of non-negative integers 
+**              in the simplex sum(x) <= N.
+** INPUT:       {int n},
+**              number of integers.
+**              {int *x},
+**              the tuple.
+** RETURN:      {long long},
+**              the rank, independent of N.
+** SIDE EFFECT: 
+** NOTE:        the tuples with sum(x) <= N occupy the ranks 
+**              0 to C(N+n, n)-1.
+*/
+static long long WRank(int n, int *x) {
+  int i, t;
+  long long r;
+
+  t = 0;
+  r = 0;
+  for (i = n-1; i >= 0; i--) {
+    t += x[i];
+    r += _wcomb[n-i][t+n-1-i];
+  }
+  return r;
+}
+
+/*
+** FUNCTION:    W3jTable.
+** PURPOSE:     look up the 3j symbol in the precomputed table.
+** INPUT:       see W3j.
+**              {double *r},
+**              the 3j symbol on output.
+** RETURN:      {int},
+**              1: found, 0: not covered by the table.
+** SIDE EFFECT: 
+** NOTE:        a negative element of the Regge square means 
+**              the selection rules are violated, and 0 is 
+**              returned in *r.
+**              the Regge square of the symbol is brought to 
+**              the canonical form with its smallest element S 
+**              at (0,0), R01 <= R02, R10 <= R20 and R01 <= R10.
+**              the 5 remaining degrees of freedom are mapped to 
+**              non-negative integers summing to at most 2*jmax.
+**              an odd permutation of rows or columns introduces
+**              the phase (-1)^(j1+j2+j3).
+*/
+static int W3jTable(int j1, int j2, int j3, int m1, int m2, int m3,
+		    double *r) {
+  int R[9], k, t, p, r0, r1, r2, c0, c1, c2, x[5], a, c, d, e;
+
+  if ((j1+j2+j3) & 1 || (j1+m1) & 1 || (j2+m2) & 1) return 0;
+  R[0] = (j2+j3-j1)/2;
+  R[1] = (j1+j3-j2)/2;
+  R[2] = (j1+j2-j3)/2;
+  R[3] = (j1-m1)/2;
+  R[4] = (j2-m2)/2;
+  R[5] = (j3-m3)/2;
+  R[6] = (j1+m1)/2;
+  R[7] = (j2+m2)/2;
+  R[8] = (j3+m3)/2;
+  t = 0;
+  for (k = 1; k < 9; k++) {
+    t = (R[k] < R[t])?k:t;
+  }
+  if (R[t] < 0) {
+    *r = 0.0;
+    return 1;
+  }
+  r0 = 3*(t/3);
+  c0 = t%3;
+  p = r0/3 + c0;
+  r1 = (r0 == 0)?3:0;
+  r2 = (r0 == 6)?3:6;
+  c1 = (c0 == 0)?1:0;
+  c2 = (c0 == 2)?1:2;
+  if (R[r0+c1] > R[r0+c2]) {
+    t = c1; c1 = c2; c2 = t;
+    p++;
+  }
+  if (R[r1+c0] > R[r2+c0]) {
+    t = r1; r1 = r2; r2 = t;
+    p++;
+  }
+  x[0] = R[r0+c0];
+  e = R[r1+c1] - x[0];
+  if (R[r0+c1] > R[r1+c0]) {
+    a = R[r1+c0] - x[0];
+    c = R[r0+c1] - x[0];
+    d = R[r0+c2] - x[0];
+  } else {
+    a = R[r0+c1] - x[0];
+    c = R[r1+c0] - x[0];
+    d = R[r2+c0] - x[0];
+  }
+  x[1] = e - d + a;
+  x[2] = d - e;
+  x[3] = c - a;
+  x[4] = d - c;
+  if (x[0]+x[2]+x[3]+x[4]+x[1] > _wjmax) return 0;
+  *r = _w3jt[WRank(5, x)];
+  if (p & (j1+j2+j3)/2 & 1) *r = -(*r);
+  return 1;
+}
+
+/*
+** FUNCTION:    W6jTable.
+** PURPOSE:     look up the 6j symbol in the precomputed table.
+** INPUT:       see W6j.
+**              {double *r},
+**              the 6j symbol on output.
+** RETURN:      {int},
+**              1: found, 0: not covered by the table.
+** SIDE EFFECT: 
+** NOTE:        the triangular relations hold if b0 >= a3.
+**              the 6j symbol depends only on the sorted triad 
+**              sums a0<=..<=a3 and the sorted sums of opposite 
+**              pairs b0<=b1<=b2, which is invariant under all 
+**              144 tetrahedral and Regge symmetries. the 6 
+**              successive differences of (a, b) index the table.
+*/
+static int W6jTable(int j1, int j2, int j3, int i1, int i2, int i3,
+		    double *r) {
+  int a[4], b[3], x[6];
+
+  if (((j1+j2+j3) | (j1+i2+i3) | (i1+j2+i3) | (i1+i2+j3)) & 1) return 0;
+  a[0] = (j1+j2+j3)/2;
+  a[1] = (j1+i2+i3)/2;
+  a[2] = (i1+j2+i3)/2;
+  a[3] = (i1+i2+j3)/2;
+  b[0] = (j1+j2+i1+i2)/2;
+  b[1] = (j2+j3+i2+i3)/2;
+  b[2] = (j3+j1+i3+i1)/2;
+  WSORT2(a[0], a[1]);
+  WSORT2(a[2], a[3]);
+  WSORT2(a[0], a[2]);
+  WSORT2(a[1], a[3]);
+  WSORT2(a[1], a[2]);
+  WSORT2(b[0], b[1]);
+  WSORT2(b[1], b[2]);
+  WSORT2(b[0], b[1]);
+  if (b[0] < a[3]) {
+    *r = 0.0;
+    return 1;
+  }
+  if (b[2] - a[0] > _wjmax) return 0;
+  x[0] = a[1] - a[0];
+  x[1] = a[2] - a[1];
+  x[2] = a[3] - a[2];
+  x[3] = b[0] - a[3];
+  x[4] = b[1] - b[0];
+  x[5] = b[2] - b[1];
+  *r = _w6jt[WRank(6, x)];
+  return 1;
+}
+
+/*
+** FUNCTION:    W6jRegge.
+** PURPOSE:     evaluate the 6j symbol from the triad sums 
+**              and the sums of opposite pairs.
+** INPUT:       {int *a},
+**              the 4 triad sums.
+**              {int *b},
+**              the 3 sums of opposite pairs.
+** RETURN:      {double},
+**              6j symbol.
+** SIDE EFFECT: 
+** NOTE:        the 12 differences b[j]-a[i] are the arguments 
+**              of the triangle coefficients. the summation terms 
+**              are scaled by the largest one as in W3jDirect.
+*/
+static double W6jRegge(int *a, int *b) {
+  int i, j, k, kmin, kmax;
+  double delta, c, qsum, r;
+
+  delta = 0.0;
+  kmin = a[0];
+  kmax = b[0];
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 3; j++) {
+      delta += LnFactorial(b[j]-a[i]);
+    }
+    delta -= LnFactorial(a[i]+1);
+    if (a[i] > kmin) kmin = a[i];
+  }
+  for (j = 1; j < 3; j++) {
+    if (b[j] < kmax) kmax = b[j];
+  }
+  c = -1E30;
+  for (k = kmin, i = 0; k <= kmax && i < MAXTERM; k++, i++) {
+    _sumk[i] = LnFactorial(k+1);
+    for (j = 0; j < 4; j++) _sumk[i] -= LnFactorial(k-a[j]);
+    for (j = 0; j < 3; j++) _sumk[i] -= LnFactorial(b[j]-k);
+    if (_sumk[i] > c) c = _sumk[i];
+  }
+  qsum = 0.0;
+  for (k = kmin, i = 0; k <= kmax && i < MAXTERM; k++, i++) {
+    r = exp(_sumk[i]-c);
+    if (IsOdd(k)) r = -r;
+    qsum += r;
+  }
+  return qsum*exp(0.5*delta+c);
+}
+
+/*
+** FUNCTION:    BuildWignerTable.
+** PURPOSE:     fill the 3j and 6j tables.
+** INPUT:       
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        the outer parameter is distributed over threads.
+*/
+static void BuildWignerTable(void) {
+  int s;
+
+#pragma omp parallel for schedule(dynamic) private(s)
+  for (s = 0; s <= _wjmax; s++) {
+    int x[6], j[3], m[3], a[4], b[3], R[3][3], i, n;
+
+    x[0] = s;
+    for (x[1] = 0; x[1] <= _wjmax-s; x[1]++) {
+      for (x[2] = 0; x[2] <= _wjmax-s-x[1]; x[2]++) {
+	for (x[3] = 0; x[3] <= _wjmax-s-x[1]-x[2]; x[3]++) {
+	  n = _wjmax-s-x[1]-x[2]-x[3];
+	  for (x[4] = 0; x[4] <= n; x[4]++) {
+	    R[0][1] = x[1] + x[2];
+	    R[1][0] = R[0][1] + x[3];
+	    R[2][0] = R[1][0] + x[4];
+	    R[0][2] = R[1][0] + R[2][0] - R[0][1];
+	    R[1][1] = R[2][0] - x[2];
+	    R[1][2] = R[2][0] - R[1][1];
+	    R[2][1] = R[0][2] - R[1][1];
+	    R[2][2] = R[0][1] + R[1][1] - R[2][0];
+	    for (i = 0; i < 3; i++) {
+	      j[i] = 2*s + R[1][i] + R[2][i];
+	      m[i] = R[2][i] - R[1][i];
+	    }
+	    _w3jt[WRank(5, x)] = W3jDirect(j[0], j[1], j[2],
+					   m[0], m[1], m[2]);
+	    for (x[5] = 0; x[5] <= n-x[4]; x[5]++) {
+	      a[0] = x[1] + 2*x[2] + 3*x[3] + 2*x[4] + x[5];
+	      a[1] = a[0] + x[0];
+	      a[2] = a[1] + x[1];
+	      a[3] = a[2] + x[2];
+	      b[0] = a[3] + x[3];
+	      b[1] = b[0] + x[4];
+	      b[2] = b[1] + x[5];
+	      _w6jt[WRank(6, x)] = W6jRegge(a, b);
+	    }
+	  }
+	}
+      }
+    }
+  }
+}
+
+/*
+** FUNCTION:    SetWignerTable.
+** PURPOSE:     set up the tables of 3j and 6j symbols.
+** INPUT:       {int jmax},
+**              largest 2j covered by the tables.
+**              0 frees the tables.
+** RETURN:      {int},
+**              0: success.
+**              -1: jmax out of range.
+** SIDE EFFECT: W3j and W6j, and W9j through W6j, 
+**              use the tables for symbols within jmax.
+** NOTE:        if the file set by the option angular:wfile 
+**              holds tables of the same jmax, they are read 
+**              from it. otherwise they are computed and saved
+**              to the file.
+*/
+int SetWignerTable(int jmax) {
+  char magic[8];
+  int i, k, n, m;
+  long long c[2];
+  FILE *f;
+  double wt0, wt1;
+
+  if (jmax < 0 || jmax > WJT_MAX) {
+    printf("jmax of the Wigner table must be within 0 to %d\n", WJT_MAX);
+    return -1;
+  }
+  if (_w3jt) {
+    free(_w3jt);
+    free(_w6jt);
+    _w3jt = NULL;
+    _w6jt = NULL;
+    _w3jn = 0;
+    _w6jn = 0;
+  }
+  _wjmax = 0;
+  if (jmax == 0) return 0;
+
+  for (n = 0; n < WJT_MAX+8; n++) {
+    _wcomb[0][n] = 1;
+    for (k = 1; k < 7; k++) {
+      if (n == 0) _wcomb[k][n] = 0;
+      else _wcomb[k][n] = _wcomb[k][n-1] + _wcomb[k-1][n-1];
+    }
+  }
+  wt0 = WallTime();
+  _w3jn = _wcomb[5][jmax+5];
+  _w6jn = _wcomb[6][jmax+6];
+  _w3jt = malloc(sizeof(double)*_w3jn);
+  _w6jt = malloc(sizeof(double)*_w6jn);
+  _wjmax = jmax;
+  m = 0;
+  if (_wfile[0]) {
+    f = fopen(_wfile, "r");
+    if (f) {
+      i = fread(magic, sizeof(char), 8, f);
+      i += fread(&n, sizeof(int), 1, f);
+      i += fread(c, sizeof(long long), 2, f);
+      if (i == 11 && strncmp(magic, "FACWJT01", 8) == 0 &&
+	  n == jmax && c[0] == _w3jn && c[1] == _w6jn) {
+	if (fread(_w3jt, sizeof(double), _w3jn, f) == (size_t) _w3jn &&
+	    fread(_w6jt, sizeof(double), _w6jn, f) == (size_t) _w6jn) {
+	  m = 1;
+	}
+      }
+      fclose(f);
+    }
+  }
+  if (m == 0) {
+    BuildWignerTable();
+    if (_wfile[0] && MyRankMPI() == 0) {
+      f = fopen(_wfile, "w");
+      if (f) {
+	c[0] = _w3jn;
+	c[1] = _w6jn;
+	fwrite("FACWJT01", sizeof(char), 8, f);
+	fwrite(&jmax, sizeof(int), 1, f);
+	fwrite(c, sizeof(long long), 2, f);
+	fwrite(_w3jt, sizeof(double), _w3jn, f);
+	fwrite(_w6jt, sizeof(double), _w6jn, f);
+	fclose(f);
+      } else {
+	printf("cannot open Wigner table file %s\n", _wfile);
+      }
+    }
+  }
+  wt1 = WallTime();
+  MPrintf(0, "Wigner table: jmax=%d n3j=%lld n6j=%lld %s %10.3E\n",
+	  jmax, _w3jn, _w6jn, m?"loaded":"built", wt1-wt0);
+  return 0;
+}
+
+/*
+** FUNCTION:    SetOptionAngular.
+** PURPOSE:     set the options of module *angular*.
+** INPUT:       {char *s},
+**              option name.
+**              {char *sp, int ip, double dp},
+**              option values.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        angular:wfile must be set before angular:wjmax
+**              to take effect.
+*/
+void SetOptionAngular(char *s, char *sp, int ip, double dp) {
+  if (0 == strcmp(s, "angular:wfile")) {
+    strncpy(_wfile, sp, sizeof(_wfile)-1);
+    return;
+  }
+  if (0 == strcmp(s, "angular:wjmax")) {
+    SetWignerTable(ip);
+    return;
+  }
+}
+
 /* 
 ** FUNCTION:    WignerEckartFactor.
 ** PURPOSE:     calculate the geometric prefactor in 
@@ -169,5 +169,7 @@ double WignerEckartFactor(int jf, int k, int ji,
 double ClebschGordan(int j1, int m1, int j2, int m2, int jf, int mf);
 double ReducedCL(int ja, int k, int jb);
 double WignerDMatrix(double a, int j2, int m2, int n2);
+int    SetWignerTable(int jmax);
+void   SetOptionAngular(char *s, char *sp, int ip, double dp);
 
 #endif
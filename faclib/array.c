@@ -52,13 +52,20 @@ void ReportMultiStats(void) {
   int i;
   if (_multistats == NULL) return;
   //if (MyRankMPI() != 0) return;
+  MPrintf(-1, "mem: ts=%g, other=%g, radial=%g, structure=%g, excitation=%g, crm=%g\n",
+	  TotalSize(), TotalSizeTag(MTAG_OTHER), TotalSizeTag(MTAG_RADIAL),
+	  TotalSizeTag(MTAG_STRUCTURE), TotalSizeTag(MTAG_EXCITATION),
+	  TotalSizeTag(MTAG_CRM));
   for (i = 0; i < _multistats->dim; i++) {
     MULTI **pma = (MULTI **) ArrayGet(_multistats, i);
     if (pma == NULL) continue;
     MULTI *ma = *pma;
     if (ma == NULL) continue;
-    if (ma->numelem > 0) {
-      MPrintf(-1, "idx=%d, id=%s, nd=%d, hs=%d, ne=%d, me=%d, ts=%g, os=%g, ms=%g, c=%d, ch=%g, isize=%d, esize=%d, lock=%x\n", i, ma->id, ma->ndim, ma->hsize, ma->numelem, ma->maxelem, ma->totalsize, ma->overheadsize, ma->maxsize, ma->clean_flag, ma->cth, ma->isize, ma->esize, ma->lock);
+    if (ma->numelem > 0 || ma->nhit + ma->nmiss > 0) {
+      MPrintf(-1, "idx=%d, id=%s, nd=%d, hs=%d, ne=%d, me=%d, ts=%g, os=%g, ss=%g, is=%g, ms=%g, c=%d, ch=%g, isize=%d, esize=%d, lock=%x\n", i, ma->id, ma->ndim, ma->hsize, ma->numelem, ma->maxelem, ma->totalsize, ma->overheadsize, ma->slabsize, ma->idlesize, ma->maxsize, ma->clean_flag, ma->cth, ma->isize, ma->esize, ma->lock);
+      MPrintf(-1, "idx=%d, id=%s, hit=%lu, miss=%lu, evict=%lu, hr=%g\n",
+	      i, ma->id, ma->nhit, ma->nmiss, ma->nevict,
+	      ma->nhit/(ma->nhit+ma->nmiss+1e-30));
     }
   }
 }
@@ -77,6 +84,7 @@ void RemoveMultiLocks(void) {
       free(ma->lock);
       ma->lock = NULL;
     }
+    if (ma->array == NULL) continue;
     for (j = 0; j < ma->hsize; j++) {
       ARRAY *a = &ma->array[j];
       if (a->lock) {
@@ -126,6 +134,8 @@ void InitArrayData(void *p, int n) {
   for (i = 0; i < n; i++) {
     d[i].dim = 0;
     d[i].esize = 0;
+    d[i].dir = NULL;
+    d[i].ndir = 0;
   }
 }
 
@@ -150,6 +160,8 @@ int ArrayInit(ARRAY *a, int esize, int block) {
   a->bsize = ((int)esize)*((int)block);
   a->dim = 0;
   a->data = NULL;
+  a->dir = NULL;
+  a->ndir = 0;
 #if USE_MPI == 2
   a->lock = (LOCK *) malloc(sizeof(LOCK));
   if (0 != InitLock(a->lock)) {
@@ -173,6 +185,50 @@ int ArrayInitID(ARRAY *a, int esize, int block, char *id) {
   return 0;
 }
 
+/* 
+** FUNCTION:    ArrayGrowDir
+** PURPOSE:     make sure the block directory can hold block ib.
+** INPUT:       {ARRAY *a},
+**              pointer to the array.
+**              {int ib},
+**              index of the block.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        the slot in front of each directory links to the
+**              previous, smaller directory, which is only released 
+**              in ArrayFreeDir.
+*/
+static void ArrayGrowDir(ARRAY *a, int ib) {
+  DATA **d;
+  int n;
+
+  if (ib < a->ndir) return;
+  n = a->ndir*2;
+  if (n < 8) n = 8;
+  while (n <= ib) n *= 2;
+  d = (DATA **) malloc(sizeof(DATA *)*(n+1));
+  d[0] = (DATA *) (a->dir?(a->dir-1):NULL);
+  d++;
+  if (a->ndir > 0) memcpy(d, a->dir, sizeof(DATA *)*a->ndir);
+  memset(d+a->ndir, 0, sizeof(DATA *)*(n-a->ndir));
+  a->ndir = n;
+  a->dir = d;
+}
+
+static void ArrayFreeDir(ARRAY *a) {
+  DATA **d, **d0;
+
+  if (a->dir == NULL) return;
+  d = a->dir-1;
+  while (d) {
+    d0 = (DATA **) d[0];
+    free(d);
+    d = d0;
+  }
+  a->dir = NULL;
+  a->ndir = 0;
+}
+
 /* 
 ** FUNCTION:    ArrayGet
 ** PURPOSE:     retrieve the i-th element of the array.
@@ -184,22 +240,20 @@ int ArrayInitID(ARRAY *a, int esize, int block, char *id) {
 **              pointer to the element. 
 **              NULL, if does not exist.
 ** SIDE EFFECT: 
-** NOTE:        
+** NOTE:        the block is found through the directory in O(1).
 */
 void *ArrayGet(ARRAY *a, int i) {
   DATA *p;
+  int ib;
   
   if (i < 0 || i >= a->dim) return NULL;
-  p = a->data;
-  while (i >= a->block) {
-    p = p->next;
-    i -= a->block;
-  }
+  ib = i/a->block;
+  p = a->dir[ib];
   if (p->dptr) {
-    return ((char *) p->dptr) + i*(a->esize);
+    return ((char *) p->dptr) + (i-ib*a->block)*(a->esize);
   } else {
     return NULL;
-    }
+  }
 }
 
 /* 
@@ -224,37 +278,39 @@ void *ArrayGet(ARRAY *a, int i) {
 void *ArraySet(ARRAY *a, int i, void *d, 
 	       void (*InitData)(void *, int)) {
   void *pt;
-  char *ct;
   DATA *p;
+  int ib, k;
  
-  if (a->dim == 0) {
+  if (a->dim == 0 && a->data == NULL) {
     a->data = (DATA *) malloc(sizeof(DATA));
     a->data->dptr = malloc(a->bsize);
     if (InitData) InitData(a->data->dptr, a->block);
     a->data->next = NULL;
-  }
-  p = a->data;
-  if (a->dim <= i) a->dim = i+1;
-  while (i >= a->block) {
-    if (!(p->next)) {
-      p->next = (DATA *) malloc(sizeof(DATA));
-      p->next->dptr = NULL;
-      p->next->next = NULL;
+    ArrayGrowDir(a, 0);
+    a->dir[0] = a->data;
+  }
+  ib = i/a->block;
+  i -= ib*a->block;
+  if (ib >= a->ndir || a->dir[ib] == NULL) {
+    ArrayGrowDir(a, ib);
+    for (k = ib-1; a->dir[k] == NULL; k--);
+    for (k++; k <= ib; k++) {
+      p = (DATA *) malloc(sizeof(DATA));
+      p->dptr = NULL;
+      p->next = NULL;
+      a->dir[k] = p;
+      a->dir[k-1]->next = p;
     }
-    p = p->next;
-    i -= a->block;
   }
+  p = a->dir[ib];
   
   if (!(p->dptr)) {
     p->dptr = malloc(a->bsize);
     if (InitData) InitData(p->dptr, a->block);
   }
   
-  ct = (char *) p->dptr;
-  for (; i > 0; i--) {
-    ct += a->esize;
-  }
-  pt = (void *) ct;
+  pt = (void *) (((char *) p->dptr) + i*a->esize);
+  if (a->dim <= ib*a->block+i) a->dim = ib*a->block+i+1;
   
   if (d) memcpy(pt, d, a->esize);
   return pt;
@@ -384,6 +440,7 @@ int ArrayFree(ARRAY *a, void (*FreeElem)(void *)) {
   if (!a) return 0;
   if (a->dim == 0) return 0;
   ArrayFreeData(a->data, a->esize, a->block, FreeElem);
+  ArrayFreeDir(a);
   a->dim = 0;
   a->data = NULL;
   return 0;
@@ -406,7 +463,7 @@ int ArrayFree(ARRAY *a, void (*FreeElem)(void *)) {
 int ArrayTrim(ARRAY *a, int n, void (*FreeElem)(void *)) {
   DATA *p;
   void *pt;
-  int i;
+  int i, ib, k;
 
   if (!a) return 0;
   if (a->dim <= n) return 0;
@@ -416,20 +473,19 @@ int ArrayTrim(ARRAY *a, int n, void (*FreeElem)(void *)) {
     return 0;
   }
 
-  i = n;
-  p = a->data;
-  while (i >= a->block) {
-    p = p->next;
-    i -= a->block;
-  }
+  ib = n/a->block;
+  i = n - ib*a->block;
+  p = a->dir[ib];
 
   if (i == 0) {
     ArrayFreeData(p, a->esize, a->block, FreeElem);
-    p = NULL;
+    a->dir[ib-1]->next = NULL;
+    for (k = ib; k < a->ndir; k++) a->dir[k] = NULL;
   } else {
     if (p->next) {
       ArrayFreeData(p->next, a->esize, a->block, FreeElem);
       p->next = NULL;
+      for (k = ib+1; k < a->ndir; k++) a->dir[k] = NULL;
     }
     if (p->dptr && FreeElem) {
       pt = ((char *) p->dptr) + i*(a->esize);
@@ -469,6 +525,7 @@ int SMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   } else {
     ma->id[0] = '\0';
   }
+  ma->tag = MGetTag();
   ma->maxsize = -1;
   ma->totalsize = 0;
   ma->cth = 0;
@@ -624,8 +681,16 @@ typedef struct _MDATA_ {
   int *index;
   LOCK *lock;
   void *data;
+  int ref;
 } MDATA;
 
+/* header in front of each NMulti element, csize is the size of the
+   memory attached to the element through AddMultiElemSize */
+typedef struct _MELEM_ {
+  int csize;
+  int pad;
+} MELEM;
+
 void InitMDataData(void *p, int n) {
   MDATA *d;
   int i;
@@ -635,6 +700,7 @@ void InitMDataData(void *p, int n) {
     d[i].index = NULL;
     d[i].data = NULL;
     d[i].lock = NULL;
+    d[i].ref = 0;
   }
 }
 
@@ -744,6 +810,28 @@ void AddMultiSize(MULTI *ma, int size) {
   _totalsize += size;
 }
 
+/* 
+** FUNCTION:    AddMultiElemSize
+** PURPOSE:     account for memory attached to an element of MULTI.
+** INPUT:       {MULTI *ma},
+**              pointer to the multi-dimensional array.
+**              {void *p},
+**              the element as returned by MultiSet.
+**              {int size},
+**              number of bytes attached to the element.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        NMulti records the size with the element, so that it
+**              is taken off totalsize again when the element is evicted.
+*/
+void AddMultiElemSize(MULTI *ma, void *p, int size) {
+#if USE_NMULTI == 1
+  MELEM *e = (MELEM *) (((char *) p) - sizeof(MELEM));
+  e->csize += size;
+#endif
+  AddMultiSize(ma, size);
+}
+
 void LimitMultiSize(MULTI *ma, double r) {
   if (ma == NULL) {
     _maxsize = r;
@@ -760,6 +848,15 @@ double TotalSize() {
 #endif
 }
 
+/* the part of TotalSize charged to tag t, see MSetTag */
+double TotalSizeTag(int t) {
+#if PMALLOC_CHECK == 2
+  return (double) mmsizetag(t);
+#else
+  return t == MTAG_OTHER ? _totalsize : 0.0;
+#endif
+}
+
 double TotalArraySize() {
   return _totalsize;
 }
@@ -772,6 +869,253 @@ inline int IdxCmp(int *i0, int *i1, int n) {
   return 0;
 }
 
+/* 
+** FUNCTION:    MSlabAlloc
+** PURPOSE:     carve n bytes out of the slab arena of a MULTI.
+** INPUT:       {MULTI *ma},
+**              pointer to the multi-dimensional array.
+**              {MSLAB * volatile *sp},
+**              the chunk list, &ma->slab for the blocks, &ma->eslab
+**              for the elements.
+**              {int n},
+**              number of bytes requested.
+** RETURN:      {void *},
+**              pointer to the memory, 8-byte aligned.
+** SIDE EFFECT: a new chunk is allocated when the current one is full.
+** NOTE:        the memory is released with MSlabFree, or with
+**              NMultiSlabTrim for the element chunks. the chunk
+**              memory is tracked in slabsize, the callers account for
+**              the pieces in use in totalsize, and for the evicted
+**              pieces on the free list in idlesize.
+*/
+static void *MSlabAlloc(MULTI *ma, MSLAB * volatile *sp, int n) {
+  MSLAB *c, *c1;
+  size_t off, size;
+  double ts;
+
+  n = MSlabAlign(n);
+  while (1) {
+    c = __atomic_load_n(sp, __ATOMIC_ACQUIRE);
+    if (c != NULL) {
+      off = __atomic_fetch_add(&c->used, (size_t) n, __ATOMIC_RELAXED);
+      if (off + n <= c->size) return c->buf + off;
+    }
+    size = MSLAB_MINSIZE;
+    if (c != NULL) {
+      size = 2*c->size;
+      if (size > MSLAB_MAXSIZE) size = MSLAB_MAXSIZE;
+    }
+    if (size < (size_t) n) size = n;
+    ts = MSlabAlign(sizeof(MSLAB)) + size;
+    int t0 = MSetThreadTag(ma->tag);
+    c1 = (MSLAB *) malloc(ts);
+    MSetThreadTag(t0);
+    c1->buf = (char *) c1 + MSlabAlign(sizeof(MSLAB));
+    c1->size = size;
+    c1->used = 0;
+    c1->idle = 0;
+    c1->next = c;
+    /* another thread may have installed a new chunk in the meantime */
+    if (__sync_bool_compare_and_swap(sp, c, c1)) {
+#pragma omp atomic
+      ma->slabsize += ts;
+    } else {
+      free(c1);
+    }
+  }
+}
+
+/* release all chunks of the slab arena at once */
+static void MSlabFree(MULTI *ma) {
+  MSLAB *c, *c1;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    if (i == 0) {
+      c = ma->slab;
+      ma->slab = NULL;
+    } else {
+      c = ma->eslab;
+      ma->eslab = NULL;
+    }
+    while (c != NULL) {
+      c1 = c->next;
+      free(c);
+      c = c1;
+    }
+  }
+  ma->efree = NULL;
+  ma->slabsize = 0;
+  ma->idlesize = 0;
+}
+
+static int CompareSlab(const void *c0, const void *c1) {
+  char *b0, *b1;
+
+  b0 = (*((MSLAB **) c0))->buf;
+  b1 = (*((MSLAB **) c1))->buf;
+  if (b0 < b1) return -1;
+  if (b0 > b1) return 1;
+  return 0;
+}
+
+/* the chunk of cs, sorted by address, holding the piece e */
+static MSLAB *FindSlab(MSLAB **cs, int nc, char *e) {
+  int i0, i1, i;
+
+  i0 = 0;
+  i1 = nc-1;
+  while (i0 <= i1) {
+    i = (i0+i1)/2;
+    if (e < cs[i]->buf) i1 = i-1;
+    else if (e >= cs[i]->buf + cs[i]->size) i0 = i+1;
+    else return cs[i];
+  }
+  return NULL;
+}
+
+/* 
+** FUNCTION:    NMultiSlabTrim
+** PURPOSE:     release the element chunks holding evicted pieces only.
+** INPUT:       {MULTI *ma},
+**              pointer to the multi-dimensional array.
+** RETURN:      
+** SIDE EFFECT: the pieces of the released chunks are taken off the 
+**              free list, slabsize and idlesize are reduced.
+** NOTE:        called at the end of NMultiEvictData, when no MultiSet
+**              is in progress. all pieces of an element chunk have the
+**              same size, so the chunk is empty when its evicted pieces
+**              fill the part carved out.
+*/
+static void NMultiSlabTrim(MULTI *ma) {
+  MSLAB *c, **cs, * volatile *pc;
+  void **pe;
+  size_t n, nu;
+  int i, nc;
+
+  if (ma->efree == NULL) return;
+  nc = 0;
+  for (c = ma->eslab; c != NULL; c = c->next) nc++;
+  if (nc == 0) return;
+  cs = malloc(sizeof(MSLAB *)*nc);
+  i = 0;
+  for (c = ma->eslab; c != NULL; c = c->next) {
+    c->idle = 0;
+    cs[i++] = c;
+  }
+  qsort(cs, nc, sizeof(MSLAB *), CompareSlab);
+  for (pe = (void **) ma->efree; pe != NULL; pe = (void **) *pe) {
+    c = FindSlab(cs, nc, (char *) pe);
+    if (c) c->idle++;
+  }
+  /* idle is kept only for the chunks to be released */
+  n = MSlabAlign(NMultiElemSize(ma));
+  for (i = 0; i < nc; i++) {
+    c = cs[i];
+    nu = c->used < c->size? c->used : c->size;
+    if (c->idle != nu/n) c->idle = 0;
+  }
+  pe = (void **) &ma->efree;
+  while (*pe != NULL) {
+    c = FindSlab(cs, nc, (char *) *pe);
+    if (c && c->idle) *pe = *((void **) *pe);
+    else pe = (void **) *pe;
+  }
+  pc = &ma->eslab;
+  while ((c = *pc) != NULL) {
+    if (c->idle) {
+      *pc = c->next;
+      ma->slabsize -= MSlabAlign(sizeof(MSLAB)) + c->size;
+      ma->idlesize -= c->idle*NMultiElemSize(ma);
+      free(c);
+    } else {
+      pc = &c->next;
+    }
+  }
+  free(cs);
+}
+
+/* get an element piece, reusing the evicted ones first */
+static void *NMultiElemAlloc(MULTI *ma, int n) {
+  void *e, *e1;
+  MELEM *h;
+  
+  while (1) {
+    e = __atomic_load_n(&ma->efree, __ATOMIC_ACQUIRE);
+    if (e == NULL) {
+      e = MSlabAlloc(ma, &ma->eslab, n);
+      break;
+    }
+    /* pieces are only pushed by the eviction, which runs when no
+       MultiSet is in progress, so the pop cannot suffer from ABA */
+    e1 = *((void **) e);
+    if (__sync_bool_compare_and_swap(&ma->efree, e, e1)) {
+#pragma omp atomic
+      ma->idlesize -= n;
+      break;
+    }
+  }
+  h = (MELEM *) e;
+  h->csize = 0;
+  h->pad = 0;
+#pragma omp atomic
+  ma->totalsize += n;
+#pragma omp atomic
+  _totalsize += n;
+  return e;
+}
+
+/* decide whether MultiSet should clean the array before insertion */
+static int MultiCleanMode(MULTI *ma) {
+  int cleanmode;
+  cleanmode = ma->clean_mode;
+  if (cleanmode < 0) {
+    if (_maxsize > 0 && ma->cth > 0) {
+      double ts = TotalSize();
+      double ats = TotalArraySize();
+      if (ts >= _maxsize && ma->totalsize > ma->cth*ats &&
+	  ma->idlesize <= 0) {
+	cleanmode = 1;
+      }
+    } else if (ma->maxsize > 0 && ma->totalsize >= ma->maxsize &&
+	       ma->idlesize <= 0) {
+      cleanmode = 0;
+    } else if (ma->clean_flag > 0) {
+      cleanmode = 0;
+    }
+  }
+  return cleanmode;
+}
+
+/* check the clean condition again once the clean lock is held */
+static int MultiCleanCheck(MULTI *ma, char *op) {
+  int clean = 1;
+  if (ma->clean_mode == 0) {
+    if ((ma->totalsize < ma->maxsize || ma->idlesize > 0) &&
+	ma->clean_flag <= 0) clean = 0;
+    if (clean) {
+      MPrintf(-1,
+	      "%s0 %s t=%g o=%g m=%g tt=%g to=%g tm=%g c=%d ch=%g\n",
+	      op, ma->id, ma->totalsize, ma->overheadsize, ma->maxsize,	    
+	      _totalsize, _overheadsize, _maxsize, ma->clean_flag, ma->cth);
+    }
+  } else if (ma->clean_mode == 1) {
+    double ts = TotalSize();
+    double ats = TotalArraySize();
+    if (ts < _maxsize || ma->totalsize <= ma->cth*ats ||
+	ma->idlesize > 0) clean = 0;
+    if (clean) {
+      MPrintf(-1,
+	      "%s1: %s t=%g o=%g m=%g tt=%g to=%g tm=%g c=%d ch=%g\n",
+	      op, ma->id, ma->totalsize, ma->overheadsize, ma->maxsize,
+	      _totalsize, _overheadsize, _maxsize, ma->clean_flag, ma->cth);
+    }
+  } else {
+    if (ma->totalsize <= 0 && ma->clean_flag <= 0) clean = 0;
+  }
+  return clean;
+}
+
 int NMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   int i, n, s;
   if (id != NULL) {
@@ -779,8 +1123,10 @@ int NMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   } else {
     ma->id[0] = '\0';
   }
+  ma->tag = MGetTag();
   ma->maxsize = -1;
   ma->totalsize = 0;
+  ma->overheadsize = 0;
   ma->cth = 0;
   ma->clean_mode = -1;
   ma->clean_flag = 0;
@@ -791,6 +1137,16 @@ int NMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   ma->block = (unsigned short *) malloc(s);
   ma->overheadsize += s;
   _overheadsize += s;
+  ma->slab = NULL;
+  ma->eslab = NULL;
+  ma->efree = NULL;
+  ma->slabsize = 0;
+  ma->idlesize = 0;
+  ma->numelem = 0;
+  ma->nhit = 0;
+  ma->nmiss = 0;
+  ma->nevict = 0;
+  ma->ihand = 0;
   n = HashSize(ma->ndim);
   ma->hsize = n;
   ma->hmask = ma->hsize-1;
@@ -842,15 +1198,20 @@ void *NMultiGet(MULTI *ma, int *k, LOCK **lock) {
   while (p) {
     pt = (MDATA *) p->dptr;
     for (m = 0; m < a->block && j < i; j++, m++) {
-      if (IdxCmp(pt->index, k, ma->ndim) == 0) {
+      /* the slot may just have been cleared by NMultiEvictBucket */
+      if (pt->index && IdxCmp(pt->index, k, ma->ndim) == 0) {
 	if (lock) *lock = pt->lock;
+	pt->ref = 1;
+#pragma omp atomic
+	ma->nhit++;
 	return pt->data;
       }
       pt++;
     }
     p = p->next;
   }
-  
+#pragma omp atomic
+  ma->nmiss++;
   return NULL;
 }
 
@@ -863,20 +1224,7 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
   DATA *p, *p0;
   int myrank = MyRankMPI()+1;
   int cleanmode;
-  cleanmode = ma->clean_mode;
-  if (cleanmode < 0) {
-    if (_maxsize > 0 && ma->cth > 0) {
-      double ts = TotalSize();
-      double ats = TotalArraySize();
-      if (ts >= _maxsize && ma->totalsize > ma->cth*ats) {
-	cleanmode = 1;
-      }
-    } else if (ma->maxsize > 0 && ma->totalsize >= ma->maxsize) {
-      cleanmode = 0;
-    } else if (ma->clean_flag > 0) {
-      cleanmode = 0;
-    }
-  }
+  cleanmode = MultiCleanMode(ma);
   if (cleanmode >= 0) {
     if (ma->clean_lock) {
       SetLock(ma->clean_lock);
@@ -884,7 +1232,11 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
     }
     if (ma->iset == 0) {
       ma->clean_mode = cleanmode;
-      NMultiFreeData(ma, FreeElem);
+      if (ma->clean_flag > 0) {
+	NMultiFreeData(ma, FreeElem);
+      } else {
+	NMultiEvictData(ma, FreeElem);
+      }
     }
   }
 #pragma omp atomic
@@ -902,14 +1254,18 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
       locked = 1;
     }
     if (a->dim == 0) {
-      size = sizeof(DATA);
-      a->data = (DATA *) malloc(size);
-      a->data->dptr = malloc(a->bsize);
-      size += a->bsize;
-      ma->totalsize += size;
-      _totalsize += size;
-      InitMDataData(a->data->dptr, a->block);
-      a->data->next = NULL;
+      /* the blocks of the bucket are kept after eviction */
+      if (a->data == NULL) {
+	size = sizeof(DATA)+a->bsize;
+	a->data = (DATA *) MSlabAlloc(ma, &ma->slab, size);
+	a->data->dptr = (char *) a->data + sizeof(DATA);
+	InitMDataData(a->data->dptr, a->block);
+	a->data->next = NULL;
+#pragma omp atomic
+	ma->overheadsize += size;
+#pragma omp atomic
+	_overheadsize += size;
+      }
       pt = (MDATA *) a->data->dptr;
     }
   } 
@@ -926,6 +1282,7 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
 	    memcpy(pt->data, d, ma->esize);
 	  }
 	  if (lock) *lock = pt->lock;
+	  pt->ref = 1;
 	  if (locked) {
 	    ReleaseLock(a->lock);
 	  }	  
@@ -960,6 +1317,7 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
 	      memcpy(pt->data, d, ma->esize);
 	    }
 	    if (lock) *lock = pt->lock;
+	    pt->ref = 1;
 	    if (locked) {
 	      ReleaseLock(a->lock);
 	    }
@@ -979,39 +1337,46 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
 	}
       }  
     }
-    if (m == a->block) {	
-      size = sizeof(DATA);
-      p0->next = (DATA *) malloc(size);
+    if (m == a->block) {
+      if (p0->next == NULL) {
+	size = sizeof(DATA)+a->bsize;
+	p0->next = (DATA *) MSlabAlloc(ma, &ma->slab, size);
+	p = p0->next;
+	p->dptr = (char *) p + sizeof(DATA);
+	InitMDataData(p->dptr, a->block);
+	p->next = NULL;
+#pragma omp atomic
+	ma->overheadsize += size;
+#pragma omp atomic
+	_overheadsize += size;
+      }
       p = p0->next;
-      p->dptr = malloc(a->bsize);
-      size += a->bsize;
-      ma->totalsize += size;
-      _totalsize += size;
-      InitMDataData(p->dptr, a->block);
-      p->next = NULL;
       pt = (MDATA *) p->dptr;
     }
   }
 
-  size = sizeof(LOCK);
+  /* header, data, index and lock of the element are one piece */
+  size = MSlabAlign(ma->esize);
+  m = MSlabAlign(ma->isize);
 #if USE_MPI == 2
-  pt->lock = (LOCK *) malloc(sizeof(LOCK));
+  pt->data = (char *) NMultiElemAlloc(ma, NMultiElemSize(ma)) + sizeof(MELEM);
+  pt->lock = (LOCK *) ((char *) pt->data + size + m);
   if (0 != InitLock(pt->lock)) {
-    free(pt->lock);
     pt->lock = NULL;
   }
 #else
+  pt->data = (char *) NMultiElemAlloc(ma, NMultiElemSize(ma)) + sizeof(MELEM);
   pt->lock = NULL;
 #endif
-  pt->data = malloc(ma->esize);
-  size += ma->esize + ma->isize;
-  ma->totalsize += size;
+  /* a new element is still being filled by the caller, it must not
+     be the first one taken by the clock */
+  pt->ref = 1;
+#pragma omp atomic
   ma->numelem++;
-  _totalsize += size;
   if (InitData) InitData(pt->data, 1);
   if (d) memcpy(pt->data, d, ma->esize);
   if (lock) *lock = pt->lock;  
-  int *idx = (int *) malloc(ma->isize);
+  int *idx = (int *) ((char *) pt->data + size);
   memcpy(idx, k, ma->isize);
   pt->index = idx;
   (a->dim)++;  
@@ -1021,37 +1386,152 @@ void *NMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
   return pt->data;
 }
 
-static int NMultiArrayFreeData(DATA *p, int esize, int block, 
+/* the blocks and elements live in the slab of the MULTI, only the
+   locks and the element contents need to be released here */
+static int NMultiArrayFreeData(DATA *p, int block, 
 			       void (*FreeElem)(void *)) { 
   MDATA *pt;
   int i;
   
-  if (p->next) {
-    NMultiArrayFreeData(p->next, esize, block, FreeElem);
-  }
-
-  if (p->dptr) {
+  for (; p != NULL; p = p->next) {
+    if (p->dptr == NULL) continue;
     pt = p->dptr;
     for (i = 0; i < block; i++) {
-      free(pt->index);
-      pt->index = NULL;
-      if (pt->lock) {
-	DestroyLock(pt->lock);
-	free(pt->lock);
-	pt->lock = NULL;
+      if (pt->data) {
+	if (pt->lock) {
+	  DestroyLock(pt->lock);
+	  pt->lock = NULL;
+	}
+	if (FreeElem) FreeElem(pt->data);
+	pt->data = NULL;
+	pt->index = NULL;
       }
-      if (FreeElem && pt->data) FreeElem(pt->data);
-      free(pt->data);
-      pt->data = NULL;
       pt++;
     }
-    free(p->dptr);
-    p->dptr = NULL;
   }
-  if (p) {
-    free(p);
-    p = NULL;
+  return 0;
+}
+
+/* release one element and put its piece on the free list */
+static void NMultiEvictElem(MULTI *ma, MDATA *pt, void (*FreeElem)(void *)) {
+  MELEM *e;
+  double size;
+  
+  e = (MELEM *) (((char *) pt->data) - sizeof(MELEM));
+  size = NMultiElemSize(ma) + e->csize;
+  if (pt->lock) {
+    DestroyLock(pt->lock);
+  }
+  if (FreeElem) FreeElem(pt->data);
+  *((void **) e) = ma->efree;
+  ma->efree = e;
+  ma->idlesize += NMultiElemSize(ma);
+  ma->totalsize -= size;
+  _totalsize -= size;
+  ma->numelem--;
+  ma->nevict++;
+}
+
+/* one visit of the clock to a bucket. the elements referenced since
+   the last visit get a second chance, the others are evicted, and
+   the survivors are compacted to the front of the bucket. */
+static void NMultiEvictBucket(MULTI *ma, ARRAY *a, 
+			      void (*FreeElem)(void *)) {
+  DATA *pr, *pw;
+  MDATA *r, *w;
+  int j, mr, mw, n;
+
+  n = a->dim;
+  pr = pw = a->data;
+  mr = mw = 0;
+  for (j = 0; j < n; j++) {
+    if (mr == a->block) {
+      pr = pr->next;
+      mr = 0;
+    }
+    r = ((MDATA *) pr->dptr) + mr;
+    mr++;
+    if (r->ref) {
+      if (mw == a->block) {
+	pw = pw->next;
+	mw = 0;
+      }
+      w = ((MDATA *) pw->dptr) + mw;
+      mw++;
+      r->ref = 0;
+      if (w != r) {
+	/* the index goes last, a MultiGet scanning the bucket sees
+	   either the old or the moved element */
+	w->index = NULL;
+	w->data = r->data;
+	w->lock = r->lock;
+	w->ref = 0;
+	__atomic_store_n(&w->index, r->index, __ATOMIC_RELEASE);
+      }
+    } else {
+      NMultiEvictElem(ma, r, FreeElem);
+    }
+  }
+  a->dim = 0;
+  for (pr = a->data; pr != pw; pr = pr->next) a->dim += a->block;
+  a->dim += mw;
+  InitMDataData(((MDATA *) pw->dptr) + mw, a->block - mw);
+  for (pr = pw->next; pr != NULL; pr = pr->next) {
+    InitMDataData(pr->dptr, a->block);
   }
+}
+
+/* 
+** FUNCTION:    NMultiEvictData
+** PURPOSE:     evict the cold elements of a size limited MULTI.
+** INPUT:       {MULTI *ma},
+**              pointer to the multi-dimensional array.
+**              {void (*FreeElem)(void *)},
+**              a function called before evicting each element.
+** RETURN:      {int},
+**              always 0.
+** SIDE EFFECT: 
+** NOTE:        the clock hand advances through the hash buckets until
+**              totalsize falls below MULTI_LOWWATER of the limit that
+**              triggered the eviction. like NMultiFreeData, it must
+**              only be called when no MultiSet is in progress. each
+**              bucket is compacted under its lock, and the element
+**              chunks left empty are released. the pieces still on the
+**              free list are reused by MultiSet, and count against the
+**              limit, so the next eviction waits until they are used up.
+*/
+int NMultiEvictData(MULTI *ma, void (*FreeElem)(void *)) {
+  ARRAY *a;
+  double target;
+  int i;
+#pragma omp flush
+  if (ma->lock) SetLock(ma->lock);
+  int clean = MultiCleanCheck(ma, "evict");
+  if (clean) {
+    ma->clean_thread = MyRankMPI();
+    if (ma->iset > 0 && ma->clean_mode >= 0) {
+      printf("invalid evict with iset: %s: %d %lud\n",
+	     ma->id, ma->clean_thread, ma->iset);
+      Abort(1);
+    }
+    if (ma->clean_mode == 1) {
+      target = MULTI_LOWWATER*ma->cth*TotalArraySize();
+    } else {
+      target = MULTI_LOWWATER*ma->maxsize;
+    }
+    for (i = 0; i < 2*ma->hsize && ma->totalsize > target; i++) {
+      a = &(ma->array[ma->ihand]);
+      ma->ihand = (ma->ihand+1) & ma->hmask;
+      if (a->dim == 0) continue;
+      if (a->lock) SetLock(a->lock);
+      NMultiEvictBucket(ma, a, FreeElem);
+      if (a->lock) ReleaseLock(a->lock);
+    }
+    NMultiSlabTrim(ma);
+  }
+  ma->clean_mode = -1;
+#pragma omp flush
+  if (ma->lock) ReleaseLock(ma->lock);
   return 0;
 }
 
@@ -1072,8 +1552,11 @@ void SetMultiCleanFlag(MULTI *ma) {
 
 int NMultiFreeDataOnly(ARRAY *a, void (*FreeElem)(void *)) {
   if (!a) return 0;
-  if (a->dim == 0) return 0;
-  NMultiArrayFreeData(a->data, a->esize, a->block, FreeElem);
+  /* an evicted bucket keeps its blocks with dim 0, they go with
+     the slab as well */
+  if (a->dim > 0) {
+    NMultiArrayFreeData(a->data, a->block, FreeElem);
+  }
   a->dim = 0;
   a->data = NULL;
   return 0;
@@ -1084,28 +1567,7 @@ int NMultiFreeData(MULTI *ma, void (*FreeElem)(void *)) {
   int i;
 #pragma omp flush
   if (ma->lock) SetLock(ma->lock);
-  int clean = 1;
-  if (ma->clean_mode == 0) {
-    if (ma->totalsize < ma->maxsize && ma->clean_flag <= 0) clean = 0;
-    if (clean) {
-      MPrintf(-1,
-	      "clean0 %s t=%g o=%g m=%g tt=%g to=%g tm=%g c=%d ch=%g\n",
-	      ma->id, ma->totalsize, ma->overheadsize, ma->maxsize,	    
-	      _totalsize, _overheadsize, _maxsize, ma->clean_flag, ma->cth);
-    }
-  } else if (ma->clean_mode == 1) {
-    double ts = TotalSize();
-    double ats = TotalArraySize();
-    if (ts < _maxsize || ma->totalsize <= ma->cth*ats) clean = 0;
-    if (clean) {
-      MPrintf(-1,
-	      "clean1: %s t=%g o=%g m=%g tt=%g to=%g tm=%g c=%d ch=%g\n",
-	      ma->id, ma->totalsize, ma->overheadsize, ma->maxsize,
-	      _totalsize, _overheadsize, _maxsize, ma->clean_flag, ma->cth);
-    }
-  } else {
-    if (ma->totalsize <= 0 && ma->clean_flag <= 0) clean = 0;
-  }
+  int clean = MultiCleanCheck(ma, "clean");
   if (clean) {
     ma->clean_thread = MyRankMPI();
     if (ma->iset > 0 && ma->clean_mode >= 0) {
@@ -1119,6 +1581,11 @@ int NMultiFreeData(MULTI *ma, void (*FreeElem)(void *)) {
       NMultiFreeDataOnly(a, FreeElem);
       if (a->lock) ReleaseLock(a->lock);
     }
+    /* only the hash buckets remain as overhead */
+    double ho = sizeof(unsigned short)*ma->ndim + sizeof(ARRAY)*ma->hsize;
+    _overheadsize -= ma->overheadsize - ho;
+    ma->overheadsize = ho;
+    MSlabFree(ma);
     _totalsize -= ma->totalsize;
     ma->totalsize = 0;
     ma->numelem = 0;
@@ -1130,6 +1597,45 @@ int NMultiFreeData(MULTI *ma, void (*FreeElem)(void *)) {
   return 0;
 }
 
+/*
+** FUNCTION:    NMultiWalk
+** PURPOSE:     call f for every element stored in the MULTI array.
+** INPUT:       {MULTI *ma},
+**              the array.
+**              {int (*f)(int *, void *, void *)},
+**              called with the index, the data and arg. a non-zero
+**              return stops the walk.
+**              {void *arg},
+**              passed through to f.
+** RETURN:      {int},
+**              number of elements visited.
+** SIDE EFFECT: 
+** NOTE:        not to be called while other threads modify the array.
+*/
+int NMultiWalk(MULTI *ma, int (*f)(int *, void *, void *), void *arg) {
+  ARRAY *a;
+  DATA *p;
+  MDATA *pt;
+  int i, j, m, n = 0;
+
+  if (ma->array == NULL) return 0;
+  for (i = 0; i < ma->hsize; i++) {
+    a = &(ma->array[i]);
+    p = a->data;
+    j = 0;
+    while (p) {
+      pt = (MDATA *) p->dptr;
+      for (m = 0; m < a->block && j < a->dim; j++, m++, pt++) {
+	if (pt->data == NULL) continue;
+	n++;
+	if (f(pt->index, pt->data, arg)) return n;
+      }
+      p = p->next;
+    }
+  }
+  return n;
+}
+
 int NMultiFree(MULTI *ma, void (*FreeElem)(void *)) {
   if (!ma) return 0;
   if (ma->ndim <= 0) return 0;
@@ -1165,6 +1671,7 @@ int MMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
   } else {
     ma->id[0] = '\0';
   }
+  ma->tag = MGetTag();
   ma->maxsize = -1;
   ma->totalsize = 0;
   ma->cth = 0;
@@ -1320,19 +1827,13 @@ int MMultiFreeData(MULTI *ma, void (*FreeElem)(void *)) {
   if (!ma) return 0;
   if (ma->ndim == 0) return 0;
   
-  a = ma->array;
-  ArrayFreeData(a->data, a->esize, a->block, FreeElem);
-  a->dim = 0;
-  a->data = NULL;
+  ArrayFree(ma->array, FreeElem);
   for (i = 0; i < ma->hsize; i++) {
     a = &(ma->ia[i]);
     ArrayFreeData(a->data, a->esize, a->block, NULL);
     a->dim = 0;
     a->data = NULL;
-    a = &(ma->da[i]);
-    ArrayFreeData(a->data, a->esize, a->block, FreeElem);
-    a->dim = 0;
-    a->data = NULL;
+    ArrayFree(&(ma->da[i]), FreeElem);
   }
   return 0;
 }
@@ -1357,6 +1858,341 @@ int MMultiFree(MULTI *ma, void (*FreeElem)(void *)) {
   return 0;
 }
 
+/*
+** the HMulti implementation stores the elements in a list of flat
+** open addressing tables. each slot holds a state word, the index
+** key, the element lock and the data inline. a slot is claimed with
+** a compare-and-swap, so MultiGet never takes a lock, and MultiSet
+** only takes the MULTI lock when a level is full and a larger one
+** has to be put in front. elements never move, so the pointers
+** handed out remain valid until the data is freed.
+*/
+#define HSLOT_EMPTY 0
+#define HSLOT_BUSY 1
+#define HSLOT_FULL 2
+#define HTABLE_MINBITS 10
+#define HTABLE_GROWBITS 2
+#define HSlot(t, i) ((t)->slots + ((size_t)(i))*(t)->ssize)
+#define HSlotKey(s) (((int *) (s)) + 1)
+#define HSlotLock(s, ma) ((LOCK *) ((s) + MSlabAlign(sizeof(int)+(ma)->isize)))
+#if USE_MPI == 2
+#define HDataOffset(ma) (MSlabAlign(sizeof(int)+(ma)->isize)+MSlabAlign(sizeof(LOCK)))
+#else
+#define HDataOffset(ma) (MSlabAlign(sizeof(int)+(ma)->isize))
+#endif
+#define HSlotData(s, ma) ((s) + HDataOffset(ma))
+
+static inline int HSlotState(char *s) {
+  return __atomic_load_n((int *) s, __ATOMIC_ACQUIRE);
+}
+
+static inline int HSlotWait(char *s) {
+  int st;
+  while ((st = HSlotState(s)) == HSLOT_BUSY);
+  return st;
+}
+
+static HTABLE *HTableNew(MULTI *ma, int nbits) {
+  HTABLE *t;
+  double size;
+
+  t = (HTABLE *) malloc(sizeof(HTABLE));
+  t->size = 1<<nbits;
+  t->mask = t->size-1;
+  t->limit = t->size/2;
+  t->nres = 0;
+  t->nfin = 0;
+  t->ssize = MSlabAlign(HDataOffset(ma) + ma->esize);
+  t->slots = (char *) calloc(t->size, t->ssize);
+  t->next = NULL;
+  size = sizeof(HTABLE) + ((double)t->size)*t->ssize;
+  ma->totalsize += size;
+  _totalsize += size;
+  return t;
+}
+
+int HMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id) {
+  int i, s;
+  if (id != NULL) {
+    strncpy(ma->id, id, MULTI_IDLEN-1);
+  } else {
+    ma->id[0] = '\0';
+  }
+  ma->tag = MGetTag();
+  ma->maxsize = -1;
+  ma->totalsize = 0;
+  ma->overheadsize = 0;
+  ma->numelem = 0;
+  ma->maxelem = 0;
+  ma->nhit = 0;
+  ma->nmiss = 0;
+  ma->nevict = 0;
+  ma->slabsize = 0;
+  ma->idlesize = 0;
+  ma->cth = 0;
+  ma->clean_mode = -1;
+  ma->clean_flag = 0;
+  ma->ndim = ndim;
+  ma->isize = sizeof(int)*ndim;
+  ma->esize = esize;
+  s = sizeof(unsigned short)*ndim;
+  ma->block = (unsigned short *) malloc(s);
+  for (i = 0; i < ndim; i++) ma->block[i] = block[i];
+  ma->overheadsize += s;
+  _overheadsize += s;
+  ma->hsize = 0;
+  ma->hmask = 0;
+  ma->array = NULL;
+  ma->htab = NULL;
+#if USE_MPI == 2
+  ma->lock = (LOCK *) malloc(sizeof(LOCK));
+  if (0 != InitLock(ma->lock)) {
+    printf("cannot InitLock0 in HMultiInit: %s\n", ma->id);
+    free(ma->lock);
+    ma->lock = NULL;
+    Abort(1);
+  }
+
+  ma->clean_lock = (LOCK *) malloc(sizeof(LOCK));
+  if (0 != InitLock(ma->clean_lock)) {
+    printf("cannot InitLock1 in HMultiInit: %s\n", ma->id);
+    free(ma->clean_lock);
+    ma->clean_lock = NULL;
+    Abort(1);
+  }
+#else
+  ma->lock = NULL;
+  ma->clean_lock = NULL;
+#endif
+  if (_multistats != NULL && ma->id[0]) {
+    ArrayAppend(_multistats, &ma, InitPointerData);    
+  }
+  ma->iset = 0;
+  return 0;
+}
+
+/* search a level for the key, waiting on slots being filled */
+static char *HTableFind(MULTI *ma, HTABLE *t, int *k, unsigned int h) {
+  int i, j, st;
+  char *s;
+
+  i = h & t->mask;
+  for (j = 0; j < t->size; j++) {
+    s = HSlot(t, i);
+    st = HSlotWait(s);
+    if (st == HSLOT_EMPTY) return NULL;
+    if (IdxCmp(HSlotKey(s), k, ma->ndim) == 0) return s;
+    i = (i+1) & t->mask;
+  }
+  return NULL;
+}
+
+/* freeze the full level t and put a larger one in front */
+static void HMultiGrow(MULTI *ma, HTABLE *t) {
+  HTABLE *n;
+  int nbits;
+
+  if (ma->lock) SetLock(ma->lock);
+  if (ma->htab == t) {
+    if (t == NULL) {
+      nbits = HTABLE_MINBITS + ma->ndim;
+    } else {
+      /* wait for the insertions already reserved in t */
+      while (__atomic_load_n(&t->nfin, __ATOMIC_ACQUIRE) < t->limit);
+      for (nbits = 0; (1<<nbits) < t->size; nbits++);
+      nbits += HTABLE_GROWBITS;
+    }
+    int t0 = MSetThreadTag(ma->tag);
+    n = HTableNew(ma, nbits);
+    MSetThreadTag(t0);
+    n->next = t;
+    __atomic_store_n(&ma->htab, n, __ATOMIC_RELEASE);
+  }
+  if (ma->lock) ReleaseLock(ma->lock);
+}
+
+void *HMultiGet(MULTI *ma, int *k, LOCK **lock) {
+  HTABLE *t;
+  char *s;
+  unsigned int h;
+
+  h = (unsigned int) Hash2(k, ma->ndim, 0, ma->ndim, 0x7FFFFFFF);
+  t = __atomic_load_n(&ma->htab, __ATOMIC_ACQUIRE);
+  for (; t != NULL; t = t->next) {
+    s = HTableFind(ma, t, k, h);
+    if (s) {
+#if USE_MPI == 2
+      if (lock) *lock = ma->lock?HSlotLock(s, ma):NULL;
+#else
+      if (lock) *lock = NULL;
+#endif
+#pragma omp atomic
+      ma->nhit++;
+      return HSlotData(s, ma);
+    }
+  }
+#pragma omp atomic
+  ma->nmiss++;
+  return NULL;
+}
+
+void *HMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
+		void (*InitData)(void *, int),
+		void (*FreeElem)(void *)) {
+  HTABLE *t, *t0;
+  char *s;
+  void *pt;
+  unsigned int h;
+  int i, j, st, clocked = 0;
+  int myrank = MyRankMPI()+1;
+  int cleanmode;
+
+  cleanmode = MultiCleanMode(ma);
+  if (cleanmode >= 0) {
+    if (ma->clean_lock) {
+      SetLock(ma->clean_lock);
+      clocked = 1;
+    }
+    if (ma->iset == 0) {
+      ma->clean_mode = cleanmode;
+      HMultiFreeData(ma, FreeElem);
+    }
+  }
+#pragma omp atomic
+  ma->iset += myrank;
+  if (clocked) {
+    ReleaseLock(ma->clean_lock);
+  }
+
+  h = (unsigned int) Hash2(k, ma->ndim, 0, ma->ndim, 0x7FFFFFFF);
+  while (1) {
+    t0 = __atomic_load_n(&ma->htab, __ATOMIC_ACQUIRE);
+    s = NULL;
+    if (t0 != NULL) {
+      /* the levels behind the first one are frozen */
+      for (t = t0->next; t != NULL; t = t->next) {
+	s = HTableFind(ma, t, k, h);
+	if (s) break;
+      }
+      if (s) break;
+      if (__atomic_fetch_add(&t0->nres, 1, __ATOMIC_ACQ_REL) < t0->limit) {
+	i = h & t0->mask;
+	for (j = 0; j < t0->size; j++) {
+	  s = HSlot(t0, i);
+	  st = HSlotState(s);
+	  if (st == HSLOT_EMPTY) {
+	    if (__sync_bool_compare_and_swap((int *) s,
+					     HSLOT_EMPTY, HSLOT_BUSY)) {
+	      memcpy(HSlotKey(s), k, ma->isize);
+	      pt = HSlotData(s, ma);
+#if USE_MPI == 2
+	      if (0 != InitLock(HSlotLock(s, ma))) {
+		printf("cannot InitLock in HMultiSet: %s\n", ma->id);
+		Abort(1);
+	      }
+#endif
+	      if (InitData) InitData(pt, 1);
+	      if (d) memcpy(pt, d, ma->esize);
+#pragma omp atomic
+	      ma->numelem++;
+	      __atomic_store_n((int *) s, HSLOT_FULL, __ATOMIC_RELEASE);
+	      __atomic_fetch_add(&t0->nfin, 1, __ATOMIC_RELEASE);
+	      d = NULL;
+	      break;
+	    }
+	  }
+	  st = HSlotWait(s);
+	  if (IdxCmp(HSlotKey(s), k, ma->ndim) == 0) {
+	    __atomic_fetch_add(&t0->nfin, 1, __ATOMIC_RELEASE);
+	    break;
+	  }
+	  i = (i+1) & t0->mask;
+	}
+	break;
+      }
+    }
+    HMultiGrow(ma, t0);
+  }
+
+  pt = HSlotData(s, ma);
+  if (d) memcpy(pt, d, ma->esize);
+#if USE_MPI == 2
+  if (lock) *lock = ma->lock?HSlotLock(s, ma):NULL;
+#else
+  if (lock) *lock = NULL;
+#endif
+  return pt;
+}
+
+int HMultiFreeData(MULTI *ma, void (*FreeElem)(void *)) {
+  HTABLE *t, *t1;
+  char *s;
+  int i;
+#pragma omp flush
+  if (ma->lock) SetLock(ma->lock);
+  int clean = MultiCleanCheck(ma, "clean");
+  if (clean) {
+    ma->clean_thread = MyRankMPI();
+    if (ma->iset > 0 && ma->clean_mode >= 0) {
+      printf("invalid clean with iset: %s: %d %lud\n",
+	     ma->id, ma->clean_thread, ma->iset);
+      Abort(1);
+    }
+    t = ma->htab;
+    ma->htab = NULL;
+    while (t != NULL) {
+      for (i = 0; i < t->size; i++) {
+	s = HSlot(t, i);
+	if (HSlotState(s) != HSLOT_FULL) continue;
+#if USE_MPI == 2
+	DestroyLock(HSlotLock(s, ma));
+#endif
+	if (FreeElem) FreeElem(HSlotData(s, ma));
+      }
+      t1 = t->next;
+      free(t->slots);
+      free(t);
+      t = t1;
+    }
+    _totalsize -= ma->totalsize;
+    ma->totalsize = 0;
+    ma->numelem = 0;
+    ma->clean_flag = 0;
+  }
+  ma->clean_mode = -1;
+#pragma omp flush
+  if (ma->lock) ReleaseLock(ma->lock);
+  return 0;
+}
+
+/* same as NMultiWalk for the open-addressing tables */
+int HMultiWalk(MULTI *ma, int (*f)(int *, void *, void *), void *arg) {
+  HTABLE *t;
+  char *s;
+  int i, n = 0;
+
+  for (t = ma->htab; t != NULL; t = t->next) {
+    for (i = 0; i < t->size; i++) {
+      s = HSlot(t, i);
+      if (HSlotState(s) != HSLOT_FULL) continue;
+      n++;
+      if (f(HSlotKey(s), HSlotData(s, ma), arg)) return n;
+    }
+  }
+  return n;
+}
+
+int HMultiFree(MULTI *ma, void (*FreeElem)(void *)) {
+  if (!ma) return 0;
+  if (ma->ndim <= 0) return 0;
+  HMultiFreeData(ma, FreeElem);
+  free(ma->block);
+  ma->block = NULL;
+  ma->ndim = 0;
+  ma->iset = 0;
+  return 0;
+}
+
 void InitIdxAry(IDXARY *ia, int n, int *d) {
   int k;
   ia->n = n;
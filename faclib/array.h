@@ -78,7 +78,9 @@
 
 #include "global.h"
 
+#ifndef USE_NMULTI
 #define USE_NMULTI 1
+#endif
 
 /* choose MULTI implementation */
 #if USE_NMULTI == 1
@@ -87,18 +89,28 @@
 #define MultiSet NMultiSet
 #define MultiFreeData NMultiFreeData
 #define MultiFree NMultiFree
+#define MultiWalk NMultiWalk
+#elif USE_NMULTI == 3
+#define MultiInit HMultiInit
+#define MultiGet HMultiGet
+#define MultiSet HMultiSet
+#define MultiFreeData HMultiFreeData
+#define MultiFree HMultiFree
+#define MultiWalk HMultiWalk
 #elif USE_NMULTI == 0
 #define MultiInit SMultiInit
 #define MultiGet SMultiGet
 #define MultiSet SMultiSet
 #define MultiFreeData SMultiFreeData
 #define MultiFree SMultiFree
+#define MultiWalk(ma, f, arg) (-1)
 #else
 #define MultiInit MMultiInit
 #define MultiGet MMultiGet
 #define MultiSet MMultiSet
 #define MultiFreeData MMultiFreeData
 #define MultiFree MMultiFree
+#define MultiWalk(ma, f, arg) (-1)
 #endif /*USE_NMULTI*/
 
 
@@ -125,7 +137,13 @@ typedef struct _DATA_ {
 **              number of elements in each block.
 **              {int dim},
 **              the size of the array.
-** NOTE:        
+**              {DATA **dir},
+**              directory of the blocks, dir[i] is the i-th block.
+**              {int ndir},
+**              capacity of the directory.
+** NOTE:        the blocks are also linked through DATA.next. when the
+**              directory grows, the old one is kept until the array
+**              is freed, so that concurrent readers remain valid.
 */
 typedef struct _ARRAY_ {
   char id[MULTI_IDLEN];
@@ -134,9 +152,76 @@ typedef struct _ARRAY_ {
   int bsize;
   volatile int dim;
   DATA  *data;
+  DATA ** volatile dir;
+  int ndir;
   LOCK *lock;
 } ARRAY;
 
+/*
+** STRUCT:      MSLAB
+** PURPOSE:     a chunk of the slab arena of a MULTI.
+** FIELDS:      {char *buf},
+**              the memory of the chunk.
+**              {size_t size, used},
+**              size of the chunk and number of bytes carved out.
+**              {size_t idle},
+**              evicted pieces of the chunk, counted by NMultiSlabTrim.
+**              {MSLAB *next},
+**              the previous chunk.
+** NOTE:        the elements, keys and locks of NMulti are carved out
+**              of the chunks, which are released all at once. the
+**              element chunks are kept apart from the block chunks,
+**              so that a chunk left with evicted elements only can be
+**              released after an eviction.
+*/
+typedef struct _MSLAB_ {
+  char *buf;
+  size_t size;
+  volatile size_t used;
+  size_t idle;
+  struct _MSLAB_ *next;
+} MSLAB;
+
+#define MSLAB_MINSIZE 4096
+#define MSLAB_MAXSIZE 1048576
+#define MSlabAlign(n) ((((n)+7)/8)*8)
+/* size of an NMulti element piece, header, data, index and lock */
+#if USE_MPI == 2
+#define NMultiElemSize(ma) \
+  (8 + MSlabAlign((ma)->esize) + MSlabAlign((ma)->isize) + sizeof(LOCK))
+#else
+#define NMultiElemSize(ma) \
+  (8 + MSlabAlign((ma)->esize) + MSlabAlign((ma)->isize))
+#endif
+
+/* size limited MULTI arrays are evicted down to this fraction */
+#define MULTI_LOWWATER 0.5
+
+/*
+** STRUCT:      HTABLE
+** PURPOSE:     one level of the open-addressing table used by HMulti.
+** FIELDS:      {int size, mask},
+**              number of slots, a power of 2, and size-1.
+**              {int limit},
+**              max number of insertions before the level is frozen.
+**              {int ssize},
+**              bytes per slot, state word, inline key, lock and data.
+**              {int nres, nfin},
+**              insertion reservations taken and completed.
+**              {char *slots},
+**              the slot storage.
+**              {HTABLE *next},
+**              the previous, smaller level, which is frozen.
+** NOTE:        elements never move once inserted, a full level is
+**              frozen and a new one 4 times larger is put in front.
+*/
+typedef struct _HTABLE_ {
+  int size, mask, limit, ssize;
+  volatile int nres, nfin;
+  char *slots;
+  struct _HTABLE_ *next;
+} HTABLE;
+
 /*
 ** STRUCT:      MULTI
 ** PURPOSE:     a multi-dimensional array.
@@ -149,6 +234,9 @@ typedef struct _ARRAY_ {
 **              {ARRAY *array},
 **              the multi-dimensional array is implemented as array 
 **              of arrays. 
+**              {int tag},
+**              allocation tag the storage is charged to, taken from
+**              MGetTag() at init.
 ** NOTE:        
 */
 typedef struct _MULTI_ {
@@ -165,6 +253,13 @@ typedef struct _MULTI_ {
   int isf, hsize, hmask, aidx;
   ARRAY *array;
   ARRAY *ia, *da;
+  /* lookups by MultiGet, a Set after a missed Get is not counted again */
+  unsigned long nhit, nmiss, nevict;
+  int ihand, tag;
+  double slabsize, idlesize;
+  MSLAB * volatile slab, * volatile eslab;
+  void * volatile efree;
+  HTABLE * volatile htab;
   LOCK *lock, *clean_lock;
 } MULTI;
 
@@ -221,6 +316,8 @@ int   MultiFreeLock(MULTI *ma,
 		    void (*FreeElem)(void *));
 int   NMultiFreeDataOnly(ARRAY *a, void (*FreeElem)(void *));
 int   NMultiFreeData(MULTI *ma, void (*FreeElem)(void *));
+int   NMultiEvictData(MULTI *ma, void (*FreeElem)(void *));
+int   NMultiWalk(MULTI *ma, int (*f)(int *, void *, void *), void *arg);
 
 /*
 ** yet another implementation of MULTI array
@@ -233,7 +330,21 @@ void *MMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
 int   MMultiFree(MULTI *ma, 
 		 void (*FreeElem)(void *));
 int   MMultiFreeData(MULTI *ma, void (*FreeElem)(void *));
+
+/*
+** lock-free open addressing implementation of MULTI array,
+** keys and data are stored inline in flat tables.
+*/
+int   HMultiInit(MULTI *ma, int esize, int ndim, int *block, char *id);
+void *HMultiGet(MULTI *ma, int *k, LOCK **lock);
+void *HMultiSet(MULTI *ma, int *k, void *d, LOCK **lock,
+		void (*InitData)(void *, int),
+		void (*FreeElem)(void *));
+int   HMultiFree(MULTI *ma, void (*FreeElem)(void *));
+int   HMultiFreeData(MULTI *ma, void (*FreeElem)(void *));
+int   HMultiWalk(MULTI *ma, int (*f)(int *, void *, void *), void *arg);
 void AddMultiSize(MULTI *ma, int size);
+void AddMultiElemSize(MULTI *ma, void *p, int size);
 void LimitMultiSize(MULTI *ma, double d);
 
 void  InitIntData(void *p, int n);
@@ -250,6 +361,7 @@ int          Bisect(void *p0, int n, int m, void *p,
 		    int (*comp)(const void *, const void *));
 void SetMultiCleanFlag(MULTI *ma);
 double TotalSize(void);
+double TotalSizeTag(int t);
 double TotalArraySize(void);
 void InitMatrix(MATRIX *m, int n);
 void FreeMatrix(MATRIX *m);
@@ -91,12 +91,15 @@ static int _ncsf5[NJQ][NJQ][NJQ][NJQ][NJQ];
 #define NCS 25
 static int _isclosed[NCS][NCS];
 			  
-#define MAXN1 50
-#define MAXN2 50
-#define MAXNK1 2501
-#define MAXNK2 2501
-#define MAXNK12 (MAXNK1*MAXNK2)
-static ARRAY _csary[MAXNK12];
+/* open-addressing hash index of all configurations in cfg_groups,
+** keyed on the full (n, kappa, nq) shell list, used by ConfigExists. */
+typedef struct _CFG_HASH_ {
+  unsigned long h;
+  CONFIG *c;
+} CFG_HASH;
+static CFG_HASH *_cfghash = NULL;
+static int _ncfghash = 0;
+static int _mcfghash = 0;
 
 int IsClosedComplex(int n, int nq) {
   if (n >= NCS) return 0;
@@ -2160,44 +2163,97 @@ int SDConfig(CONFIG *c, char *cs,
   return j;
 }
     
-int ConfigExists(CONFIG *cfg) {
-  int i, j, t, n, nele;
-  CONFIG *c;
-  int i0, i1, n1;
+static unsigned long ConfigHashKey(CONFIG *c) {
+  unsigned long h;
+  int i;
 
-  n = cfg->shells[0].n;
-  if (n > MAXN1) {
-    i0 = MAXNK1-1;
-  } else {
-    i0 = ShellToInt(cfg->shells[0].n, cfg->shells[0].kappa);
+  h = 14695981039346656037UL;
+  for (i = 0; i < c->n_shells; i++) {
+    h ^= ((unsigned long) c->shells[i].n) << 24;
+    h ^= ((unsigned long) (c->shells[i].kappa & 0xFFFF)) << 8;
+    h ^= (unsigned long) c->shells[i].nq;
+    h *= 1099511628211UL;
   }
-  if (cfg->shells[0].nq > 1) {
-    i1 = i0;
-  } else if (cfg->n_shells > 1 && cfg->shells[1].n <= MAXN2) {
-    i1 = ShellToInt(cfg->shells[1].n, cfg->shells[1].kappa);
-  } else {
-    i1 = MAXNK2-1;
+  h ^= h >> 29;
+  return h;
+}
+
+static int SameConfigShells(CONFIG *c1, CONFIG *c2) {
+  int t;
+
+  if (c1->n_shells != c2->n_shells) return 0;
+  for (t = 0; t < c1->n_shells; t++) {
+    if (c1->shells[t].n != c2->shells[t].n) return 0;
+    if (c1->shells[t].kappa != c2->shells[t].kappa) return 0;
+    if (c1->shells[t].nq != c2->shells[t].nq) return 0;
   }
-  n1 = i0*MAXNK2 + i1;
-  ARRAY *csa = &_csary[n1];
-  if (csa->dim == 0) return 0;
-  nele = 0;
-  for (i = 0; i < cfg->n_shells; i++) {
-    nele += cfg->shells[i].nq;
+  return 1;
+}
+
+static CFG_HASH *FindConfigHash(CONFIG *cfg, unsigned long h) {
+  unsigned long m;
+  CFG_HASH *e;
+
+  m = _mcfghash-1;
+  for (e = _cfghash + (h&m); e->c != NULL; 
+       e = _cfghash + ((e-_cfghash+1)&m)) {
+    if (e->h == h && SameConfigShells(cfg, e->c)) break;
   }
-  for (i = 0; i < csa->dim; i++) {
-    CONFIG **p = ArrayGet(csa, i);
-    c = *p;
-    if (nele != c->n_electrons) continue;
-    if (cfg->n_shells != c->n_shells) continue;
-    for (t = 0; t < c->n_shells; t++) {
-      if (cfg->shells[t].n != c->shells[t].n) break;
-      if (cfg->shells[t].kappa != c->shells[t].kappa) break;
-      if (cfg->shells[t].nq != c->shells[t].nq) break;
+  return e;
+}
+
+static void ClearConfigHash(void) {
+  if (_cfghash) free(_cfghash);
+  _cfghash = NULL;
+  _ncfghash = 0;
+  _mcfghash = 0;
+}
+
+static void AddConfigHash(CONFIG *cfg) {
+  CFG_HASH *e, *e0;
+  unsigned long h;
+  int i, m0;
+
+  if (cfg->n_shells <= 0) return;
+  if (2*(_ncfghash+1) > _mcfghash) {
+    e0 = _cfghash;
+    m0 = _mcfghash;
+    _mcfghash = m0>0? 2*m0 : 1024;
+    _cfghash = malloc(sizeof(CFG_HASH)*_mcfghash);
+    for (i = 0; i < _mcfghash; i++) {
+      _cfghash[i].c = NULL;
+    }
+    for (i = 0; i < m0; i++) {
+      if (e0[i].c == NULL) continue;
+      e = FindConfigHash(e0[i].c, e0[i].h);
+      *e = e0[i];
     }
-    if (t == c->n_shells) return 1;
+    if (e0) free(e0);
   }
-  return 0;
+  h = ConfigHashKey(cfg);
+  e = FindConfigHash(cfg, h);
+  if (e->c != NULL) return;
+  e->h = h;
+  e->c = cfg;
+  _ncfghash++;
+}
+
+/* 
+** FUNCTION:    ConfigExists
+** PURPOSE:     check whether a configuration is already in any group.
+** INPUT:       {CONFIG *cfg},
+**              configuration with its shells in the canonical order.
+** RETURN:      {int},
+**              1: exists, 0: not found.
+** SIDE EFFECT: 
+** NOTE:        expected O(1) lookup in the configuration hash index.
+*/
+int ConfigExists(CONFIG *cfg) {
+  CFG_HASH *e;
+
+  if (_ncfghash == 0 || cfg->n_shells <= 0) return 0;
+  e = FindConfigHash(cfg, ConfigHashKey(cfg));
+  return e->c != NULL;
 }
 
 /* 
@@ -2282,23 +2338,7 @@ int AddConfigToList(int k, CONFIG *cfg) {
   if (cfg->shells[0].n > cfg_groups[k].nmax) {
     cfg_groups[k].nmax = cfg->shells[0].n;
   }
-  int i0, i1, n1;
-  n = acfg->shells[0].n;
-  if (n > MAXN1) {
-    i0 = MAXNK1-1;
-  } else {
-    i0 = ShellToInt(acfg->shells[0].n, acfg->shells[0].kappa);
-  }
-  if (acfg->shells[0].nq > 1) {
-    i1 = i0;
-  } else if (acfg->n_shells > 1 && acfg->shells[1].n <= MAXN2) {
-    i1 = ShellToInt(acfg->shells[1].n, acfg->shells[1].kappa);
-  } else {
-    i1 = MAXNK2-1;
-  }
-  n1 = i0*MAXNK2 + i1;
-  ARRAY *csa = &_csary[n1];
-  ArrayAppend(csa, &acfg, InitPointerData);
+  AddConfigHash(acfg);
   
   return 0;
 }
@@ -2944,9 +2984,7 @@ int InitConfig(void) {
       }
     }
   }
-  for (i = 0; i < MAXNK12; i++) {
-    ArrayInit(&_csary[i], sizeof(CONFIG *), CONFIGS_BLOCK);
-  }
+  ClearConfigHash();
 
   SetClosedShellNR(0, 0);
   return 0; 
@@ -2994,6 +3032,13 @@ int RemoveGroup(int k) {
   strcpy(cfg_groups[k].name, "_all_");
   n_groups--;
 
+  ClearConfigHash();
+  for (i = 0; i < n_groups; i++) {
+    for (m = 0; m < cfg_groups[i].n_cfgs; m++) {
+      AddConfigHash(GetConfigFromGroup(i, m));
+    }
+  }
+
   for (i = 0; i < MAX_SYMMETRIES; i++) {
     sym = GetSymmetry(i);
     for (m = 0; m < sym->n_states; m++) {
@@ -3037,9 +3082,7 @@ int ReinitConfig(int m) {
       symmetry_list[i].n_states = 0;
     }
   }
-  for (i = 0; i < MAXNK12; i++) {
-    ArrayFree(&_csary[i], NULL);
-  }
+  ClearConfigHash();
 
   SetClosedShellNR(0, 0);
   return 0;
@@ -137,6 +137,7 @@ int SetCascade(int c, double a) {
 int InitCRM(void) {
   int i;
 
+  MSetTag(MTAG_CRM);
   for (i = 0; i < NDB1; i++) ion0.dbfiles[i] = NULL;
   ion0.nionized = 0;
   ion0.energy = NULL;
@@ -378,6 +379,7 @@ int AddIon(int nele, double n, char *pref) {
   int i;
   int m;
 
+  MSetTag(MTAG_CRM);
 #if USE_MPI == 2
   if (!MPIReady()) InitializeMPI(0, 1);
 #endif
@@ -884,6 +886,7 @@ int SetBlocks(double ni, char *ifn) {
   int swp, sfh;
   int s3nk[10000];
 
+  MSetTag(MTAG_CRM);
   for (i = 0; i < 10000; i++) s3nk[i] = 0;
   ion0.n = ni;
   ion0.n0 = ni;
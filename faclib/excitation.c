@@ -20,6 +20,9 @@
 #include "transition.h"
 #include "mbpt.h"
 #include "cf77.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 static char *rcsid="$Id$";
 #if __GNUC__ == 2
@@ -90,6 +93,31 @@ static MULTI *pk_array;
 static MULTI *qk_array;
 static MULTI *qkm_array;
 
+/* spill tier of pk_array and qk_array. the entries evicted under the
+   excitation:maxcache limit are appended to an unlinked scratch file
+   in the excitation:spill directory, which is mapped for reading, and
+   a later miss on the same key is served from the file instead of
+   being recomputed. the entries depend on the energy grids, so the
+   file is dropped by FreeExcitationQk at the end of each block. */
+typedef struct _CESPILL_REC_ {
+  int k[6];
+  int h[2];
+  long long off, size;
+} CESPILL_REC;
+
+typedef struct _CESPILL_ {
+  int fd;
+  char *map;
+  size_t msize;
+  long long fsize;
+  int nr, mr, mh;
+  CESPILL_REC *r;
+  int *hr;
+} CESPILL;
+
+static char _cespill_dir[1024] = "";
+static CESPILL _cespill = {-1, NULL, 0, 0, 0, 0, 0, NULL, NULL};
+
 static void InitCEPK(void *p, int n) {
   CEPK *d;
   int i;
@@ -100,6 +128,25 @@ static void InitCEPK(void *p, int n) {
   }
 }
 
+static void InitCEQK(void *p, int n) {
+  CEQK *d;
+  int i;
+  
+  d = (CEQK *) p;
+  for (i = 0; i < n; i++) {
+    d[i].qk = NULL;
+  }
+}
+
+/* done with the pointers from one MultiSet on pk_array or qk_array,
+   a size limited array is only evicted when no thread holds any. */
+static void ReleaseCEArray(MULTI *ma) {
+  int myrank = MyRankMPI()+1;
+#pragma omp atomic
+  ma->iset -= myrank;
+#pragma omp flush
+}
+
 void SetMaxCECache(int n) {
   if (n > 0) {
     maxcecache = n;
@@ -228,11 +275,266 @@ void FreeExcitationPkData(void *p) {
 }
 
 void FreeExcitationQkData(void *p) {
-  double *dp;
+  CEQK *dp;
+
+  dp = (CEQK *) p;
+  if (dp->qk) free(dp->qk);
+  dp->qk = NULL;
+}
+
+static void CESpillKey(int m, int *index, int *k) {
+  int i, n;
+
+  n = m == 0? 3 : 5;
+  k[0] = m;
+  for (i = 0; i < 5; i++) {
+    k[i+1] = i < n? index[i] : 0;
+  }
+}
+
+static unsigned long CESpillHash(int *k) {
+  unsigned long h;
+  int i;
+
+  h = 14695981039346656037UL;
+  for (i = 0; i < 6; i++) {
+    h ^= (unsigned long) (unsigned int) k[i];
+    h *= 1099511628211UL;
+  }
+  h ^= h >> 29;
+  return h;
+}
 
-  dp = *((double **) p);
-  free(dp);
-  *((double **) p) = NULL;
+/* slot of key k in the spill index, an empty slot holds -1 */
+static int *FindCESpill(int *k) {
+  unsigned long m;
+  int *e;
+
+  m = _cespill.mh-1;
+  for (e = _cespill.hr + (CESpillHash(k)&m); *e >= 0;
+       e = _cespill.hr + ((e-_cespill.hr+1)&m)) {
+    if (memcmp(_cespill.r[*e].k, k, sizeof(int)*6) == 0) break;
+  }
+  return e;
+}
+
+static void GrowCESpill(void) {
+  int i;
+
+  if (_cespill.nr == _cespill.mr) {
+    _cespill.mr = _cespill.mr>0? 2*_cespill.mr : 1024;
+    _cespill.r = realloc(_cespill.r, sizeof(CESPILL_REC)*_cespill.mr);
+  }
+  if (2*(_cespill.nr+1) > _cespill.mh) {
+    if (_cespill.hr) free(_cespill.hr);
+    _cespill.mh = _cespill.mh>0? 2*_cespill.mh : 2048;
+    _cespill.hr = malloc(sizeof(int)*_cespill.mh);
+    for (i = 0; i < _cespill.mh; i++) {
+      _cespill.hr[i] = -1;
+    }
+    for (i = 0; i < _cespill.nr; i++) {
+      *FindCESpill(_cespill.r[i].k) = i;
+    }
+  }
+}
+
+static void ResetCESpill(void) {
+  if (_cespill.map) {
+    munmap(_cespill.map, _cespill.msize);
+    _cespill.map = NULL;
+  }
+  _cespill.msize = 0;
+  if (_cespill.fd >= 0) {
+    close(_cespill.fd);
+    _cespill.fd = -1;
+  }
+  if (_cespill.r) free(_cespill.r);
+  if (_cespill.hr) free(_cespill.hr);
+  _cespill.r = NULL;
+  _cespill.hr = NULL;
+  _cespill.nr = 0;
+  _cespill.mr = 0;
+  _cespill.mh = 0;
+  _cespill.fsize = 0;
+}
+
+/* append ns segments as the record of key k, a key already in the
+   file is not written again. */
+static void WriteCESpill(int *k, int *h, int ns, void **seg, size_t *len) {
+  char fn[1100];
+  long long off;
+  ssize_t r;
+  int i, *e;
+
+#pragma omp critical(cespill)
+  {
+    if (_cespill.fd < 0 && _cespill_dir[0]) {
+      sprintf(fn, "%s/facce.XXXXXX", _cespill_dir);
+      _cespill.fd = mkstemp(fn);
+      if (_cespill.fd < 0) {
+	MPrintf(-1, "cannot open ce spill file %s: %s\n",
+		fn, strerror(errno));
+	_cespill_dir[0] = '\0';
+      } else {
+	unlink(fn);
+      }
+    }
+    if (_cespill.fd >= 0 && _cespill_dir[0]) {
+      GrowCESpill();
+      e = FindCESpill(k);
+      if (*e < 0) {
+	off = _cespill.fsize;
+	for (i = 0; i < ns; i++) {
+	  if (len[i] == 0) continue;
+	  r = pwrite(_cespill.fd, seg[i], len[i], off);
+	  if (r != (ssize_t) len[i]) {
+	    /* stop spilling, the entries evicted later are recomputed */
+	    MPrintf(-1, "cannot write ce spill file: %s\n",
+		    r < 0? strerror(errno) : "short write");
+	    _cespill_dir[0] = '\0';
+	    break;
+	  }
+	  off += len[i];
+	}
+	if (i == ns) {
+	  *e = _cespill.nr;
+	  memcpy(_cespill.r[*e].k, k, sizeof(int)*6);
+	  _cespill.r[*e].h[0] = h[0];
+	  _cespill.r[*e].h[1] = h[1];
+	  _cespill.r[*e].off = _cespill.fsize;
+	  _cespill.r[*e].size = off - _cespill.fsize;
+	  _cespill.fsize = off;
+	  _cespill.nr++;
+	}
+      }
+    }
+  }
+}
+
+/* a malloced copy of the record of key k, NULL if it was not spilled.
+   the mapping is extended to the end of the file when needed. */
+static char *ReadCESpill(int *k, int *h) {
+  CESPILL_REC *r;
+  char *p, *m;
+  int *e;
+
+  p = NULL;
+#pragma omp critical(cespill)
+  {
+    if (_cespill.nr > 0) {
+      e = FindCESpill(k);
+      if (*e >= 0) {
+	r = &(_cespill.r[*e]);
+	if (r->off + r->size > (long long) _cespill.msize) {
+	  if (_cespill.map) munmap(_cespill.map, _cespill.msize);
+	  _cespill.msize = _cespill.fsize;
+	  m = mmap(NULL, _cespill.msize, PROT_READ, MAP_SHARED,
+		   _cespill.fd, 0);
+	  if (m == MAP_FAILED) {
+	    _cespill.map = NULL;
+	    _cespill.msize = 0;
+	  } else {
+	    _cespill.map = m;
+	  }
+	}
+	if (_cespill.map) {
+	  p = malloc(r->size);
+	  memcpy(p, _cespill.map + r->off, r->size);
+	  h[0] = r->h[0];
+	  h[1] = r->h[1];
+	}
+      }
+    }
+  }
+  return p;
+}
+
+/* FreeElem of pk_array on eviction, spill the entry and free it */
+static void SpillExcitationPkData(void *p) {
+  CEPK *dp;
+  int k[6], h[2], q;
+  void *seg[4];
+  size_t len[4];
+
+  dp = (CEPK *) p;
+  if (dp->nkl > 0 && _cespill_dir[0]) {
+    q = dp->nkappa*n_tegrid;
+    CESpillKey(0, dp->index, k);
+    h[0] = dp->nkl;
+    h[1] = dp->nkappa;
+    seg[0] = dp->pkd;
+    seg[1] = dp->pke;
+    seg[2] = dp->kappa0;
+    seg[3] = dp->kappa1;
+    len[0] = sizeof(double)*q;
+    len[1] = len[0];
+    len[2] = sizeof(short)*dp->nkappa;
+    len[3] = len[2];
+    WriteCESpill(k, h, 4, seg, len);
+  }
+  FreeExcitationPkData(p);
+}
+
+static void SpillExcitationQkData(void *p) {
+  CEQK *dp;
+  int k[6], h[2];
+  size_t len;
+  void *seg;
+
+  dp = (CEQK *) p;
+  if (dp->qk && _cespill_dir[0]) {
+    CESpillKey(1, dp->index, k);
+    h[0] = dp->nqk;
+    h[1] = 0;
+    seg = dp->qk;
+    len = sizeof(double)*dp->nqk;
+    WriteCESpill(k, h, 1, &seg, &len);
+  }
+  FreeExcitationQkData(p);
+}
+
+/* page a spilled pk_array entry back in, 0 if it is not in the file */
+static int LoadExcitationPkData(CEPK *dp, int *index) {
+  int k[6], h[2], q;
+  size_t n0, n1;
+  char *b;
+
+  if (!_cespill_dir[0]) return 0;
+  CESpillKey(0, index, k);
+  b = ReadCESpill(k, h);
+  if (b == NULL) return 0;
+  q = h[1]*n_tegrid;
+  n0 = sizeof(double)*q;
+  n1 = sizeof(short)*h[1];
+  dp->nkappa = h[1];
+  dp->pkd = malloc(n0);
+  dp->pke = malloc(n0);
+  dp->kappa0 = malloc(n1);
+  dp->kappa1 = malloc(n1);
+  memcpy(dp->pkd, b, n0);
+  memcpy(dp->pke, b+n0, n0);
+  memcpy(dp->kappa0, b+2*n0, n1);
+  memcpy(dp->kappa1, b+2*n0+n1, n1);
+  free(b);
+  memcpy(dp->index, index, sizeof(int)*3);
+  AddMultiElemSize(pk_array, dp, 2*(n0+n1));
+  dp->nkl = h[0];
+  return 1;
+}
+
+static int LoadExcitationQkData(CEQK *dp, int *index) {
+  int k[6], h[2];
+  char *b;
+
+  if (!_cespill_dir[0]) return 0;
+  CESpillKey(1, index, k);
+  b = ReadCESpill(k, h);
+  if (b == NULL) return 0;
+  dp->nqk = h[0];
+  memcpy(dp->index, index, sizeof(int)*5);
+  AddMultiElemSize(qk_array, dp, sizeof(double)*h[0]);
+  dp->qk = (double *) b;
+  return 1;
 }
 
 CEPW_SCRATCH *GetCEPWScratch(void) {
@@ -454,19 +756,108 @@ int SetCEPWGrid(int ns, int *n, int *step) {
   return 0;
 }
 
+/* 
+** FUNCTION:    CERadialPkPW
+** PURPOSE:     radial integrals of one (kappa0, kappa1) partial wave
+**              pair over the energy transfer grid.
+** INPUT:       {CEPK_PW *w},
+**              the partial waves, and the buffers for the results.
+**              {int k0, k1, k},
+**              bound orbitals and the multipole rank.
+**              {double e1, e1w, mc, mc1},
+**              the scattered energy, its mass scaled value, and the
+**              collision mass factors.
+**              {int *noex},
+**              energies for which exchange has converged.
+** RETURN:      
+** SIDE EFFECT: w->nte is set to 0 if the first energy vanishes, 
+**              n_tegrid otherwise.
+** NOTE:        run as an OpenMP task from CERadialPk.
+*/
+static void CERadialPkPW(CEPK_PW *w, int k0, int k1, int k, double e1,
+			 double e1w, double mc, double mc1, int *noex) {
+  int i, js[4], ks[4], mode, km, kf[MAXNTE];
+  double te, e0, ew[MAXNTE], sd, se;
+
+  js[0] = 0;
+  ks[0] = k0;
+  js[2] = 0;
+  ks[2] = k1;
+  if (pw_type == 0) {
+    js[1] = w->j0;
+    js[3] = w->j1;
+  } else {
+    js[3] = w->j0;
+    js[1] = w->j1;
+  }
+  if (pw_type == 1 && egrid_type == 1) {
+    ks[3] = OrbitalIndex(0, w->km0, e1w);
+  } else if (pw_type == 0 && egrid_type == 0) {
+    ks[1] = OrbitalIndex(0, w->km0, e1w);
+  } else if (pw_type == 0 && egrid_type == 1) {
+    ks[3] = OrbitalIndex(0, w->km1, e1w);
+  } else if (pw_type == 1 && egrid_type == 0) {
+    ks[1] = OrbitalIndex(0, w->km1, e1w);
+  }
+  if (w->kl1 >= pw_scratch.qr && w->kl0 >= pw_scratch.qr) {
+    mode = -1;
+  } else {
+    mode = 1;
+  }
+  for (i = 0; i < n_tegrid; i++) {
+    te = tegrid[i];
+    e0 = e1 + te/mc1;
+    ew[i] = e0;
+    if (mc > 0) ew[i] *= mc;
+  }
+  if (pw_type == 0) {
+    km = w->km0;
+  } else {
+    km = w->km1;
+  }
+  kf[0] = OrbitalIndex(0, km, ew[0]);
+  for (i = 0; i < n_tegrid; i++) {
+    /* the remaining continua are only needed if the first energy
+       does not vanish, solve them together. */
+    if (i == 1) OrbitalIndexBatch(km, n_tegrid-1, ew+1, kf+1);
+    ks[1] = kf[i];
+    if (noex[i] == 0) {
+      SlaterTotal(&sd, &se, js, ks, k, mode);
+      if (i == 0) {
+	if (1.0+sd == 1.0 && 1.0+se == 1.0) {
+	  break;
+	}
+      }
+    } else {
+      se = 0.0;
+      SlaterTotal(&sd, NULL, js, ks, k, mode);
+      if (i == 0) {
+	if (1.0+sd == 1.0) {
+	  break;
+	}
+      }
+    }
+    w->sd[i] = sd;
+    w->se[i] = se;
+  }
+  w->nte = i;
+}
+
 int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k, int trylock) {
   int type, ko2, i, m, t, q;
-  int kf0, kf1, kpp0, kpp1, km0, km1;
+  int kpp0, kpp1, km0, km1;
   int kl0, kl1, kl0p, kl1p;
   int j0, j1, kl_max, j1min, j1max;
   ORBITAL *orb0, *orb1;
   int index[3];
-  double te, e0, e1, sd, se;
+  double e1, sd, se;
   double a, tdi[MAXNTE], tex[MAXNTE];
-  int js1, js3, js[4], ks[4];
   int nkappa, noex[MAXNTE];
   short *kappa0, *kappa1;
   double *pkd, *pke;
+  int nw, mw, iw;
+  CEPK_PW *pw;
+  double *wsd;
 
 #ifdef PERFORM_STATISTICS
   clock_t start, stop;
@@ -476,9 +867,9 @@ int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k, int trylock) {
   ko2 = k/2;  
   index[0] = ko2*MAXNE + ie;
   index[1] = k0;
-  index[2] = k1;    
+  index[2] = k1;
 
-  double e1w, e0w;
+  double e1w;
   type = -1;
   orb0 = GetOrbital(k0);
   orb1 = GetOrbital(k1);
@@ -492,7 +883,7 @@ int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k, int trylock) {
   LOCK *lock = NULL;
   int locked = 0;
   *pk = (CEPK *) MultiSet(pk_array, index, NULL, &lock,
-			  InitCEPK, FreeExcitationPkData);
+			  InitCEPK, SpillExcitationPkData);
   if (lock && (*pk)->nkl < 0) {
     if (trylock) {
       if (0 == TryLock(lock)) {
@@ -505,8 +896,9 @@ int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k, int trylock) {
       locked = 1;
     }
   }
-  if ((*pk)->nkl >= 0) {
+  if ((*pk)->nkl >= 0 || LoadExcitationPkData(*pk, index)) {
     if (locked) ReleaseLock(lock);
+#pragma omp flush
     return type;
   }
 
@@ -515,6 +907,13 @@ int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k, int trylock) {
   kappa1 = (short *) malloc(sizeof(short)*nkappa);
   pkd = (double *) malloc(sizeof(double)*(nkappa*n_tegrid));
   pke = (double *) malloc(sizeof(double)*(nkappa*n_tegrid));
+  mw = 4*(k+1);
+  pw = (CEPK_PW *) malloc(sizeof(CEPK_PW)*mw);
+  wsd = (double *) malloc(sizeof(double)*(2*mw*n_tegrid));
+  for (iw = 0; iw < mw; iw++) {
+    pw[iw].sd = wsd + 2*iw*n_tegrid;
+    pw[iw].se = pw[iw].sd + n_tegrid;
+  }
 
   e1 = egrid[ie];
   e1w = e1;
@@ -529,21 +928,8 @@ int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k, int trylock) {
     kl_max = pw_scratch.max_kl;
   }
   
-  js[0] = 0;
-  ks[0] = k0;
-  js[2] = 0;
-  ks[2] = k1;		
-
   q = 0;
   m = 0;
-  if (pw_type == 0) {
-    js1 = 1;
-    js3 = 3;
-  } else {
-    js1 = 3;
-    js3 = 1;
-  }
-
   for (i = 0; i < n_tegrid; i++) {
     noex[i] = 0;
     tdi[i] = 0.0;
@@ -565,96 +951,59 @@ int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k, int trylock) {
 	tex[i] = 0.0;
       }
     }
+    /* the partial wave pairs of one kl0 are independent given noex,
+       solve them as tasks, which idle threads of an enclosing parallel
+       region pick up, and reduce in the serial order afterwards. */
+    nw = 0;
     for (j0 = abs(kl0p-1); j0 <= kl0p+1; j0 += 2) {
       kpp0 = GetKappaFromJL(j0, kl0p); 
       km0 = kpp0;
-      if (kl0 < pw_scratch.qr) {
-	js[js1] = 0;
-      } else {
-	js[js1] = j0;
-	if (kpp0 > 0) km0 = -kpp0 - 1;
-      }
+      if (kl0 >= pw_scratch.qr && kpp0 > 0) km0 = -kpp0 - 1;
       j1min = abs(j0 - k);
       j1max = j0 + k;
-      if (pw_type == 1 && egrid_type == 1) {
-	kf1 = OrbitalIndex(0, km0, e1w);
-	ks[3] = kf1;
-      } else if (pw_type == 0 && egrid_type == 0) {
-	kf1 = OrbitalIndex(0, km0, e1w);
-	ks[1] = kf1;
-      }
       for (j1 = j1min; j1 <= j1max; j1 += 2) {
 	for (kl1p = j1 - 1; kl1p <= j1 + 1; kl1p += 2) {	
 	  kl1 = kl1p/2;
 	  kpp1 = GetKappaFromJL(j1, kl1p);
 	  km1 = kpp1;
-	  if (kl1 < pw_scratch.qr) {
-	    js[js3] = 0;
-	  } else {
-	    js[js3] = j1;
-	    if (kpp1 > 0) km1 = -kpp1 - 1;
-	  }
-	  if (pw_type == 0 && egrid_type == 1) {
-	    kf1 = OrbitalIndex(0, km1, e1w);
-	    ks[3] = kf1;
-	  } else if (pw_type == 1 && egrid_type == 0) {
-	    kf1 = OrbitalIndex(0, km1, e1w);
-	    ks[1] = kf1;
-	  }
-	  for (i = 0; i < n_tegrid; i++) {
-	    te = tegrid[i];
-	    e0 = e1 + te/mc1;
-	    e0w = e0;
-	    if (mc > 0) e0w *= mc;
-	    if (pw_type == 0) {
-	      kf0 = OrbitalIndex(0, km0, e0w);
-	      ks[1] = kf0;
-	    } else {
-	      kf0 = OrbitalIndex(0, km1, e0w);
-	      ks[1] = kf0;	      
-	    }
-	    
-	    if (noex[i] == 0) {
-	      if (kl1 >= pw_scratch.qr &&
-		  kl0 >= pw_scratch.qr) {
-		SlaterTotal(&sd, &se, js, ks, k, -1);
-	      } else {
-		SlaterTotal(&sd, &se, js, ks, k, 1);
-	      }
-	      if (i == 0) {
-		if (1.0+sd == 1.0 && 1.0+se == 1.0) {
-		  break;
-		}
-	      }
-	      tdi[i] += sd*sd;
-	      tex[i] += (sd+se)*(sd+se);
-	    } else {
-	      se = 0.0;
-	      if (kl1 >= pw_scratch.qr &&
-		  kl0 >= pw_scratch.qr) {
-		SlaterTotal(&sd, NULL, js, ks, k, -1);
-	      } else {
-		SlaterTotal(&sd, NULL, js, ks, k, 1);
-	      }
-	      if (i == 0) {
-		if (1.0+sd == 1.0) {
-		  break;
-		}
-	      }
-	    }
-	    pkd[q] = sd;
-	    pke[q] = se;
-	    q++;
-	  }
-	  if (i > 0) {
-	    kappa0[m] = kpp0;
-	    kappa1[m] = kpp1;
-	    m++;
-	  }
+	  if (kl1 >= pw_scratch.qr && kpp1 > 0) km1 = -kpp1 - 1;
+	  pw[nw].kl0 = kl0;
+	  pw[nw].kl1 = kl1;
+	  pw[nw].kpp0 = kpp0;
+	  pw[nw].kpp1 = kpp1;
+	  pw[nw].km0 = km0;
+	  pw[nw].km1 = km1;
+	  pw[nw].j0 = kl0 < pw_scratch.qr? 0 : j0;
+	  pw[nw].j1 = kl1 < pw_scratch.qr? 0 : j1;
+	  nw++;
+	}
+      }
+    }
+    for (iw = 0; iw < nw; iw++) {
+#pragma omp task default(shared) firstprivate(iw)
+      CERadialPkPW(&pw[iw], k0, k1, k, e1, e1w, mc, mc1, noex);
+    }
+#pragma omp taskwait
+    for (iw = 0; iw < nw; iw++) {
+      if (pw[iw].nte == 0) continue;
+      for (i = 0; i < n_tegrid; i++) {
+	sd = pw[iw].sd[i];
+	se = pw[iw].se[i];
+	if (noex[i] == 0) {
+	  tdi[i] += sd*sd;
+	  tex[i] += (sd+se)*(sd+se);
 	}
+	pkd[q] = sd;
+	pke[q] = se;
+	q++;
       }
+      kappa0[m] = pw[iw].kpp0;
+      kappa1[m] = pw[iw].kpp1;
+      m++;
     }
   }
+  free(pw);
+  free(wsd);
 
   (*pk)->nkappa = m;
   if (pw_type == 0) {
@@ -666,6 +1015,8 @@ int CERadialPk(CEPK **pk, int ie, int k0, int k1, int k, int trylock) {
   }
   (*pk)->pkd = ReallocNew(pkd, sizeof(double)*q);
   (*pk)->pke = ReallocNew(pke, sizeof(double)*q);  
+  memcpy((*pk)->index, index, sizeof(int)*3);
+  AddMultiElemSize(pk_array, *pk, 2*(sizeof(double)*q + sizeof(short)*m));
   (*pk)->nkl = t;
   
   if (locked) ReleaseLock(lock);
@@ -1016,7 +1367,7 @@ double TopUpQk(double b, double c, double k0, double a, double te, double e1) {
 }
 
 double *CERadialQkTable(int k0, int k1, int k2, int k3, int k, int trylock) {
-  int type, t, ie, ite, ipk, ipkp, nqk, nopb;
+  int type, t, ie, ite, ipk, ipkp, nqk, nopb, npk;
   int i, j, kl0, kl1, kl, nkappa, nkl, nkappap, nklp;
   CEPK *cepk, *cepkp, *tmp;
   short *kappa0, *kappa1, *kappa0p, *kappa1p;
@@ -1025,7 +1376,8 @@ double *CERadialQkTable(int k0, int k1, int k2, int k3, int k, int trylock) {
   double qk[MAXNKL], dqk[MAXNKL];
   double brq[MAXNTE][MAXNE+1];
   double rq[MAXNTE][MAXNE+1], e1, te, te0;
-  double drq[MAXNTE][MAXNE+1], *rqc, **p, *ptr;
+  double drq[MAXNTE][MAXNE+1], *rqc, *ptr;
+  CEQK *p;
   int index[5], mb, mk;
   int np = 3, one = 1;
   double logj, xb, xp[MAXNTE];
@@ -1042,9 +1394,9 @@ double *CERadialQkTable(int k0, int k1, int k2, int k3, int k, int trylock) {
   index[4] = k3;
   LOCK *lock = NULL;
   int locked = 0;
-  p = (double **) MultiSet(qk_array, index, NULL, &lock,
-			   InitPointerData, FreeExcitationQkData);
-  if (lock && !(*p)) {
+  p = (CEQK *) MultiSet(qk_array, index, NULL, &lock,
+			InitCEQK, SpillExcitationQkData);
+  if (lock && !(p->qk)) {
     if (trylock) {
       if (0 == TryLock(lock)) {
 	locked = 1;
@@ -1056,9 +1408,10 @@ double *CERadialQkTable(int k0, int k1, int k2, int k3, int k, int trylock) {
       locked = 1;
     }
   }
-  if (*p) {
+  if (p->qk || LoadExcitationQkData(p, index)) {
     if (locked) ReleaseLock(lock);
-    return *p;
+#pragma omp flush
+    return p->qk;
   }
   double mc = MColl();
   if (mc <= 0) mc = 1.0;
@@ -1102,8 +1455,10 @@ double *CERadialQkTable(int k0, int k1, int k2, int k3, int k, int trylock) {
     for (ie = n_egrid-1; ie >= 0; ie--) {
       e1 = egrid[ie];
       type = CERadialPk(&cepk, ie, k0, k1, k, 0);
+      npk = 1;
       if (k2 != k0 || k3 != k1) {
 	type = CERadialPk(&cepkp, ie, k2, k3, k, 0);
+	npk = 2;
       } else {
 	cepkp = cepk;
       }
@@ -1218,6 +1573,9 @@ double *CERadialQkTable(int k0, int k1, int k2, int k3, int k, int trylock) {
 	}
 	//printf("drq: %d %d %d %d %d %d %d %d %g %g %g %g %g %g %g %g %g %g\n", ie,(int)pw_scratch.kl[nklp],k0,k1,k2,k3,k,type,r,rd,b,dqk[nklp],dqk[nklp-1],c,s,d, drq[ite][ie], brq[ite][ie]); 
       }
+      for (i = 0; i < npk; i++) {
+	ReleaseCEArray(pk_array);
+      }
     }
   }  
 
@@ -1253,10 +1611,13 @@ double *CERadialQkTable(int k0, int k1, int k2, int k3, int k, int trylock) {
   stop = clock();
   timing.rad_qk += stop-start;
 #endif
-  if (p) *p = pd;
+  p->nqk = t;
+  memcpy(p->index, index, sizeof(int)*5);
+  AddMultiElemSize(qk_array, p, sizeof(double)*t);
+  p->qk = pd;
   if (locked) ReleaseLock(lock);
 #pragma omp flush
-  return *p;
+  return p->qk;
 }
 
 double *CERadialQkMSubTable(int k0, int k1, int k2, int k3, int k, int kp,
@@ -1278,8 +1639,9 @@ double *CERadialQkMSubTable(int k0, int k1, int k2, int k3, int k, int kp,
   double drq[MAXMSUB][MAXNTE][MAXNE+2];
   double brq[MAXMSUB][MAXNTE][MAXNE+2];
   double rqt[MAXMSUB], xp[MAXMSUB][MAXNTE];
-  double *rqc, **p;
-  int index[5], mb;
+  double *rqc;
+  CEQK *p;
+  int index[5], mb, npk;
   int np = 3, one = 1;
   double logj;
 #ifdef PERFORM_STATISTICS
@@ -1298,9 +1660,9 @@ double *CERadialQkMSubTable(int k0, int k1, int k2, int k3, int k, int kp,
   index[4] = k3;
   LOCK *lock = NULL;
   int locked = 0;
-  p = (double **) MultiSet(qk_array, index, NULL, &lock,
-			   InitPointerData, FreeExcitationQkData);
-  if (lock && !(*p)) {
+  p = (CEQK *) MultiSet(qk_array, index, NULL, &lock,
+			InitCEQK, SpillExcitationQkData);
+  if (lock && !(p->qk)) {
     if (trylock) {
       if (0 == TryLock(lock)) {
 	locked = 1;
@@ -1312,9 +1674,10 @@ double *CERadialQkMSubTable(int k0, int k1, int k2, int k3, int k, int kp,
       locked = 1;
     }
   }
-  if (*p) {
+  if (p->qk || LoadExcitationQkData(p, index)) {
     if (locked) ReleaseLock(lock);
-    return *p;
+#pragma omp flush
+    return p->qk;
   }
 
   nq = Min(k, kp)/2 + 1;
@@ -1377,11 +1740,13 @@ double *CERadialQkMSubTable(int k0, int k1, int k2, int k3, int k, int kp,
       kappa1 = cepk->kappa1;
       pkd = cepk->pkd;
       pke = cepk->pke;
+      npk = 1;
       if (kp == k && k2 == k0 && k3 == k1) {
 	cepkp = cepk;
 	type2 = type1;
       } else {
 	type2 = CERadialPk(&cepkp, ie, k2, k3, kp, 0);
+	npk = 2;
       }
       nklp = cepkp->nkl;
       if (nklp < nkl) nkl = nklp;
@@ -1531,6 +1896,9 @@ double *CERadialQkMSubTable(int k0, int k1, int k2, int k3, int k, int kp,
 	  }
 	}
       }
+      for (i = 0; i < npk; i++) {
+	ReleaseCEArray(pk_array);
+      }
     }
   }
 
@@ -1550,7 +1918,10 @@ double *CERadialQkMSubTable(int k0, int k1, int k2, int k3, int k, int kp,
   stop = clock();
   timing.rad_qk += stop-start;
 #endif
-  *p = pd;
+  p->nqk = nqk+1;
+  memcpy(p->index, index, sizeof(int)*5);
+  AddMultiElemSize(qk_array, p, sizeof(double)*(nqk+1));
+  p->qk = pd;
   if (locked) ReleaseLock(lock);
 #pragma omp flush
   return rqc;
@@ -1564,7 +1935,10 @@ int CERadialQk(double *rqc, double te, int k0, int k1, int k2, int k3,
   double *xte, x0;
   
   rqe = CERadialQkTable(k0, k1, k2, k3, k, trylock);
-  if (rqe == NULL) return -9999;
+  if (rqe == NULL) {
+    ReleaseCEArray(qk_array);
+    return -9999;
+  }
   if (n_tegrid == 1) {
     for (i = 0; i < n_egrid1; i++) {
       rqc[i] = rqe[i];
@@ -1621,6 +1995,7 @@ int CERadialQk(double *rqc, double te, int k0, int k1, int k2, int k3,
       }
     }
   }
+  ReleaseCEArray(qk_array);
  
   return type;
 }
@@ -1633,7 +2008,10 @@ int CERadialQkMSub(double *rqc, double te, int k0, int k1, int k2, int k3,
   double *xte, x0;
   
   rqe = CERadialQkMSubTable(k0, k1, k2, k3, k, kp, trylock);
-  if (rqe == NULL) return -9999;
+  if (rqe == NULL) {
+    ReleaseCEArray(qk_array);
+    return -9999;
+  }
   nq = Min(k, kp)/2 + 1;
 
   if (n_tegrid == 1) {
@@ -1670,6 +2048,7 @@ int CERadialQkMSub(double *rqc, double te, int k0, int k1, int k2, int k3,
       rqc += n_egrid1;
     }
   }  
+  ReleaseCEArray(qk_array);
   return type;
 }
 
@@ -2657,6 +3036,151 @@ int CollisionStrength(double *qkt, double *params, double *e, double *bethe,
   }
 }
 
+/* reorder window between the threads computing the collision strengths
+   and the file. the records are committed in the order of their work
+   items, i.e., the serial (lower, upper) order, whatever the number of
+   threads. the thread that completes the head of the window writes it
+   and whatever follows it, while the others carry on computing. */
+typedef struct _CE_WQUEUE_ {
+  long long head;
+  int m, np, nu;
+  char *st;
+  CE_RECORD **r;
+  LOCK lock, wlock;
+} CE_WQUEUE;
+
+#define CEWQUEUE 64
+
+static CE_WQUEUE *NewCEWQueue(int msub, int nparams, int nusr) {
+  CE_WQUEUE *q;
+  int i;
+
+#if USE_MPI == 2
+  if (NProcMPI() <= 1) return NULL;
+#else
+  return NULL;
+#endif
+  q = malloc(sizeof(CE_WQUEUE));
+  /* work items are numbered from 1 after ResetWidMPI */
+  q->head = 1;
+  q->m = CEWQUEUE*NProcMPI();
+  q->np = msub? 1 : nparams;
+  q->nu = nusr;
+  q->st = malloc(sizeof(char)*q->m);
+  q->r = malloc(sizeof(CE_RECORD *)*q->m);
+  for (i = 0; i < q->m; i++) {
+    q->st[i] = 0;
+    q->r[i] = NULL;
+  }
+  InitLock(&q->lock);
+  InitLock(&q->wlock);
+  return q;
+}
+
+static void FreeCEWQueue(CE_WQUEUE *q) {
+  if (q == NULL) return;
+  DestroyLock(&q->lock);
+  DestroyLock(&q->wlock);
+  free(q->st);
+  free(q->r);
+  free(q);
+}
+
+/* double the window, the slots keep their offset from the head */
+static void GrowCEWQueue(CE_WQUEUE *q) {
+  char *st;
+  CE_RECORD **r;
+  int i, j, m;
+
+  m = 2*q->m;
+  st = malloc(sizeof(char)*m);
+  r = malloc(sizeof(CE_RECORD *)*m);
+  for (i = 0; i < m; i++) {
+    st[i] = 0;
+    r[i] = NULL;
+  }
+  for (i = 0; i < q->m; i++) {
+    j = (q->head+i)%q->m;
+    st[(q->head+i)%m] = q->st[j];
+    r[(q->head+i)%m] = q->r[j];
+  }
+  free(q->st);
+  free(q->r);
+  q->st = st;
+  q->r = r;
+  q->m = m;
+}
+
+/* commit the consecutive finished records at the head of the window,
+   unless another thread is already doing so. */
+static void DrainCEWQueue(TFILE *f, CE_WQUEUE *q) {
+  CE_RECORD *r;
+  int i, st;
+
+  while (0 == TryLock(&q->wlock)) {
+    while (1) {
+      SetLock(&q->lock);
+      i = q->head%q->m;
+      st = q->st[i];
+      r = q->r[i];
+      if (st) {
+	q->st[i] = 0;
+	q->r[i] = NULL;
+	q->head++;
+      }
+      ReleaseLock(&q->lock);
+      if (st == 0) break;
+      if (r) {
+	WriteCERecord(f, r);
+	if (r->params) free(r->params);
+	free(r->strength);
+	free(r);
+      }
+    }
+#ifdef USEBF
+    BFileFlushRank(f);
+#endif
+    ReleaseLock(&q->wlock);
+    /* a record put at the head while the lock was held */
+    SetLock(&q->lock);
+    st = q->st[q->head%q->m];
+    ReleaseLock(&q->lock);
+    if (st == 0) break;
+  }
+}
+
+/* hand over the record of work item w, NULL if it has nothing to write */
+static void PutCEWQueue(TFILE *f, CE_WQUEUE *q, long long w, CE_RECORD *r) {
+  CE_RECORD *c;
+  int n, h;
+
+  c = NULL;
+  if (r) {
+    c = malloc(sizeof(CE_RECORD));
+    *c = *r;
+    n = q->np*r->nsub;
+    if (n > 0) {
+      c->params = malloc(sizeof(float)*n);
+      memcpy(c->params, r->params, sizeof(float)*n);
+    } else {
+      c->params = NULL;
+    }
+    n = q->nu*r->nsub;
+    c->strength = malloc(sizeof(float)*n);
+    memcpy(c->strength, r->strength, sizeof(float)*n);
+  }
+  SetLock(&q->lock);
+  while (w - q->head >= q->m) {
+    GrowCEWQueue(q);
+  }
+  n = w%q->m;
+  q->st[n] = 1;
+  q->r[n] = c;
+  h = w == q->head;
+  ReleaseLock(&q->lock);
+  if (h) DrainCEWQueue(f, q);
+}
+
 void ProcessCECache(int msub, int iuta, TFILE *f) {
   int ic, iz, jz, ie, skip, ilow, iup, nparams;
 
@@ -2672,7 +3196,7 @@ void ProcessCECache(int msub, int iuta, TFILE *f) {
     kb = malloc(sizeof(int)*nb);
     for (i = 0; i < nb; i++) kb[i] = 0;
     */
-    ResetWidMPI();    
+    ResetWidNMPI(cecache.nc);
 #pragma omp parallel default(shared) private(ic, iz, ilow, iup, skip)
     {
       for (ic = 0; ic < cecache.nc; ic++) {
@@ -2881,7 +3405,8 @@ void ProcessCECache(int msub, int iuta, TFILE *f) {
     */
   }
 
-  ResetWidMPI();
+  CE_WQUEUE *wq = NewCEWQueue(msub, nparams, n_usr);
+  ResetWidNMPI(cecache.nc);
 #pragma omp parallel default(shared) private(ic, ilow, iup, skip, ie)
   {
     int nsub, m, k, ip, iempty;
@@ -2909,7 +3434,10 @@ void ProcessCECache(int msub, int iuta, TFILE *f) {
       } else {
 	k = CollisionStrength(qkc, params, &e, bethe, ilow, iup, msub);
       }
-      if (k < 0) continue;
+      if (k < 0) {
+	if (wq) PutCEWQueue(f, wq, WidMPI(), NULL);
+	continue;
+      }
       r.bethe = bethe[0];
       r.born[0] = bethe[1];
       r.born[1] = bethe[2];
@@ -2945,13 +3473,19 @@ void ProcessCECache(int msub, int iuta, TFILE *f) {
 	  ip++;
 	}
       }
-      if (iempty == 0) {
+      if (wq) {
+	PutCEWQueue(f, wq, WidMPI(), iempty? NULL : &r);
+      } else if (iempty == 0) {
 	WriteCERecord(f, &r);
       }
     }
     if (msub || qk_mode == QK_FIT) free(r.params);
     free(r.strength);
   }
+  if (wq) {
+    DrainCEWQueue(f, wq);
+    FreeCEWQueue(wq);
+  }
 }
 
 int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
@@ -2981,6 +3515,7 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
   double rmin, rmax, bethe[3];
   int nc, ilow, iup;
 
+  MSetTag(MTAG_EXCITATION);
   iuta = IsUTA();
   if (iuta && msub) {
     printf("cannot call CETableMSub in UTA mode\n");
@@ -3228,6 +3763,9 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
     ce_hdr.egrid = egrid;
     ce_hdr.usr_egrid = usr_egrid;
     InitFile(f, &fhdr, &ce_hdr);
+    int *olow = malloc(sizeof(int)*nlow);
+    LevelTaskOrder(nlow, low, olow);
+    CE_WQUEUE *wq = NewCEWQueue(msub, ce_hdr.nparams, ce_hdr.n_usr);
     ResetWidMPI();
 #pragma omp parallel default(shared) private(i, j, lev1, lev2, e, ilow, iup, k, qkc, params, bethe, r, m, ip, nsub, ie, iempty)
     {
@@ -3241,7 +3779,9 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
     m = ce_hdr.n_usr * nsub;
     r.strength = (float *) malloc(sizeof(float)*m);    
     //ic = 0;
-    for (i = 0; i < nlow; i++) {
+    int io;
+    for (io = 0; io < nlow; io++) {
+      i = olow[io];
       lev1 = GetLevel(low[i]);
       for (j = 0; j < nup; j++) {
 	lev2 = GetLevel(up[j]);	
@@ -3263,7 +3803,10 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
 	} else {
 	  k = CollisionStrength(qkc, params, &e, bethe, ilow, iup, msub); 
 	}
-	if (k < 0) continue;
+	if (k < 0) {
+	  if (wq) PutCEWQueue(f, wq, WidMPI(), NULL);
+	  continue;
+	}
 	r.bethe = bethe[0];
 	r.born[0] = bethe[1];
 	r.born[1] = bethe[2];
@@ -3300,7 +3843,9 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
 	    ip++;
 	  }
 	}
-	if (iempty == 0) {
+	if (wq) {
+	  PutCEWQueue(f, wq, WidMPI(), iempty? NULL : &r);
+	} else if (iempty == 0) {
 	  WriteCERecord(f, &r);
 	}
       }
@@ -3308,6 +3853,11 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
     if (msub || qk_mode == QK_FIT) free(r.params);
     free(r.strength);
     }
+    if (wq) {
+      DrainCEWQueue(f, wq);
+      FreeCEWQueue(wq);
+    }
+    free(olow);
   /*
     cecache.low[ic] = ilow;
     cecache.up[ic] = iup;
@@ -3330,6 +3880,7 @@ int SaveExcitation(int nlow, int *low, int nup, int *up, int msub, char *fn) {
     ReinitRadial(2);
   }
   
+  ReportLoadMPI("SaveExcitation");
   ReinitExcitation(1);
   //FreeCECache(0);
   ArrayFreeLock(&subte, NULL);
@@ -3407,6 +3958,7 @@ int SaveExcitationEB(int nlow0, int *low0, int nup0, int *up0, char *fn) {
   if (GetLowUpEB(&nlow, &low, &nup, &up, nlow0, low0, nup0, up0) == -1)
     return 0;
 
+  MSetTag(MTAG_EXCITATION);
   nc = OverlapLowUp(nlow, low, nup, up);
 
   emin = 1E10;
@@ -3662,6 +4214,7 @@ int SaveExcitationEBD(int nlow0, int *low0, int nup0, int *up0, char *fn) {
   if (GetLowUpEB(&nlow, &low, &nup, &up, nlow0, low0, nup0, up0) == -1)
     return 0;
 
+  MSetTag(MTAG_EXCITATION);
   nc = OverlapLowUp(nlow, low, nup, up);
 
   emin = 1E10;
@@ -3910,6 +4463,7 @@ int SaveExcitationEBD(int nlow0, int *low0, int nup0, int *up0, char *fn) {
 int FreeExcitationQk(void) {
   MultiFreeData(qk_array, FreeExcitationQkData);
   MultiFreeData(pk_array, FreeExcitationPkData);
+  ResetCESpill();
   return 0;
 }
 
@@ -3926,7 +4480,7 @@ int InitExcitation(void) {
 
   ndim = 5;
   qk_array = (MULTI *) malloc(sizeof(MULTI));
-  MultiInit(qk_array, sizeof(double *), ndim, blocks2, "qk_array");
+  MultiInit(qk_array, sizeof(CEQK), ndim, blocks2, "qk_array");
 
   if (fpw) {
     fclose(fpw);
@@ -3975,4 +4529,14 @@ void SetOptionExcitation(char *s, char *sp, int ip, double dp) {
     pw_scratch.min_kl = ip;
     return;
   }
+  if (strcmp("excitation:maxcache", s) == 0) {
+    LimitMultiSize(pk_array, dp*1e6);
+    LimitMultiSize(qk_array, dp*1e6);
+    return;
+  }
+  if (strcmp("excitation:spill", s) == 0) {
+    ResetCESpill();
+    strncpy(_cespill_dir, sp, sizeof(_cespill_dir)-1);
+    return;
+  }
 }
@@ -43,8 +43,24 @@ typedef struct _CEPK_ {
   short *kappa1;
   double *pkd;
   double *pke;
+  int index[3];
 } CEPK;
 
+typedef struct _CEQK_ {
+  double *qk;
+  int nqk;
+  int index[5];
+} CEQK;
+
+typedef struct _CEPK_PW_ {
+  short kl0, kl1;
+  short kpp0, kpp1;
+  short km0, km1;
+  short j0, j1;
+  short nte;
+  double *sd, *se;
+} CEPK_PW;
+
 typedef struct _CEPKK_ {
   short kmin, kmax;
   CEPK **pk;
@@ -45,6 +45,18 @@
 #include "omalloc.h"
 #endif
 
+#if PMALLOC_CHECK != 2
+#define MTAG_OTHER      0
+#define MTAG_RADIAL     1
+#define MTAG_STRUCTURE  2
+#define MTAG_EXCITATION 3
+#define MTAG_CRM        4
+#define MTAG_MAX        8
+#define MSetTag(t)      0
+#define MSetThreadTag(t) (-1)
+#define MGetTag()       0
+#endif
+
 #include "sysdef.h"
 
 #if USE_MPI == 1
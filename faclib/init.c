@@ -67,15 +67,21 @@ int InitFac(void) {
   InitAngular();
   InitRecouple();
 
+  /* caches set up by each subsystem are charged to its tag */
+  MSetTag(MTAG_RADIAL);
   ierr = InitRadial();
+  MSetTag(MTAG_OTHER);
   if (ierr < 0) {
     printf("initialize failed in InitRadial\n");
     return ierr;
   }
   
   InitDBase();
+  MSetTag(MTAG_STRUCTURE);
   InitStructure();
+  MSetTag(MTAG_EXCITATION);
   InitExcitation();
+  MSetTag(MTAG_OTHER);
   InitRecombination();
   InitIonization();
   InitRMatrix();
@@ -104,10 +110,18 @@ void SetOption(char *s, char *sp, int ip, double dp) {
     SetOptionDBase(s, sp, ip, dp);
     return;
   }
+  if (strstr(s, "mpi:") == s) {
+    SetOptionMPI(s, sp, ip, dp);
+    return;
+  }
   if (strstr(s, "mbpt:") == s) {
     SetOptionMBPT(s, sp, ip, dp);
     return;
   }
+  if (strstr(s, "angular:") == s) {
+    SetOptionAngular(s, sp, ip, dp);
+    return;
+  }
   if (strstr(s, "radial:") == s) {
     SetOptionRadial(s, sp, ip, dp);
     return;
@@ -60,6 +60,11 @@ int NLSQFit(int np, double *p, double tol, int *ipvt,
 double Simpson(double *y, int ia, int ib);
 int NewtonCotes(double *r, double *x, int i0, int i1, int m, int id);
 int NewtonCotesIP(double *r, double *x, int i0, int i1, int m, int id);
+int SetQuadratureSIMD(int m);
+int QuadratureSIMD(void);
+void QuadProduct(int i0, int i1, double *x,
+		 double *a, double *b, double *c, double *d,
+		 int op, double *f, double *g);
 double RRCrossHn(double z, double e, int n);
 void PrepCECrossHeader(CE_HEADER *h, double *data);
 void PrepCECrossRecord(int k, CE_RECORD *r, CE_HEADER *h,
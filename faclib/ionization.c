@@ -1043,6 +1043,7 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
   int te_set, e_set, usr_set, iuta;
   double c, e0, e1;
 
+  MSetTag(MTAG_OTHER);
   iuta = IsUTA();
 
   emin = 1E10;
@@ -1239,12 +1240,16 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
     ci_hdr.egrid = egrid;
     ci_hdr.usr_egrid = usr_egrid;
     InitFile(file, &fhdr, &ci_hdr);
+    int *ob = malloc(sizeof(int)*nb);
+    LevelTaskOrder(nb, b, ob);
     ResetWidMPI();
 #pragma op parallel default(shared) private(i, j, lev1, lev2, e, nq, qku, qk, r, ip, ie)
     {
     r.strength = (float *) malloc(sizeof(float)*n_usr);
     r.params = (float *) malloc(sizeof(float)*nqk);
-    for (i = 0; i < nb; i++) {
+    int io;
+    for (io = 0; io < nb; io++) {
+      i = ob[io];
       lev1 = GetLevel(b[i]);
       for (j = 0; j < nf; j++) {
 	lev2 = GetLevel(f[j]);
@@ -1276,6 +1281,7 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
     free(r.params);
     free(r.strength);
     }
+    free(ob);
     DeinitFile(file, &fhdr);
 
     ReinitRadial(1);
@@ -1286,6 +1292,7 @@ int SaveIonization(int nb, int *b, int nf, int *f, char *fn) {
     e0 = e1;
   }
 
+  ReportLoadMPI("SaveIonization");
   ReinitRecombination(1);
   ReinitIonization(1);
 
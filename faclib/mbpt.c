@@ -2058,24 +2058,40 @@ void H22Term(MBPT_EFF **meff, CONFIG *c0, CONFIG *c1,
   if (IsOdd((s[0].kl+s[1].kl+s[2].kl+s[3].kl)/2)) return;
   if (IsOdd((s[4].kl+s[5].kl+s[6].kl+s[7].kl)/2)) return;
   int kk1p, kk2p, kk1m, kk2m, mr = MyRankMPI();
-  kk1m = 1+(kmax1-kmin1)/2;
-  //for (kk1p = kmin1; kk1p <= kmax1; kk1p += 2) {
-  for (kk1p = 0; kk1p < kk1m; kk1p++) {
-    mkk1 = kmin1/2 + (kk1p+mr)%kk1m;
-    kk1 = 2*mkk1;
-    m = 0;
-    mkk = mkk1*MKK;
+  int nk1, nk2, k1s[MKK], k2s[MKK], m1s[MKK], m2s[MKK];
+  /* the multipoles with a nonzero recoupling coeff., their slater
+     integrals are evaluated in one batch for each interaction */
+  for (kk1 = kmin1; kk1 <= kmax1; kk1 += 2) m1s[kk1/2] = 0;
+  for (kk2 = kmin2; kk2 <= kmax2; kk2 += 2) m2s[kk2/2] = 0;
+  for (kk1 = kmin1; kk1 <= kmax1; kk1 += 2) {
+    mkk = (kk1/2)*MKK;
     for (kk2 = kmin2; kk2 <= kmax2; kk2 += 2) {
       mkk2 = kk2/2;
       for (k = 0; k < mst; k++) {
 	if (fabs(a[mkk+mkk2][k]) > EPS30) {
-	  m = 1;
+	  m1s[kk1/2] = 1;
+	  m2s[mkk2] = 1;
 	  break;
 	}
       }
-      if (m == 1) break;
     }
-    if (m) {
+  }
+  nk1 = 0;
+  for (kk1 = kmin1; kk1 <= kmax1; kk1 += 2) {
+    if (m1s[kk1/2]) k1s[nk1++] = kk1;
+  }
+  nk2 = 0;
+  for (kk2 = kmin2; kk2 <= kmax2; kk2 += 2) {
+    if (m2s[kk2/2]) k2s[nk2++] = kk2;
+  }
+  PrepSlaterTotal(NULL, ks1, nk1, k1s, NULL, 0);
+  PrepSlaterTotal(NULL, ks2, nk2, k2s, NULL, 0);
+  kk1m = 1+(kmax1-kmin1)/2;
+  //for (kk1p = kmin1; kk1p <= kmax1; kk1p += 2) {
+  for (kk1p = 0; kk1p < kk1m; kk1p++) {
+    mkk1 = kmin1/2 + (kk1p+mr)%kk1m;
+    kk1 = 2*mkk1;
+    if (m1s[mkk1]) {
       SlaterTotal(&sd1, &se1, NULL, ks1, kk1, 0);
       a1[mkk1] = sd1 + se1;
     } else {
@@ -2087,19 +2103,7 @@ void H22Term(MBPT_EFF **meff, CONFIG *c0, CONFIG *c1,
   for (kk2p = 0; kk2p < kk2m; kk2p++) {
     mkk2 = kmin2/2 + (kk2p+mr)%kk2m;
     kk2 = 2*mkk2;
-    m = 0;
-    for (kk1 = kmin1; kk1 <= kmax1; kk1 += 2) {
-      mkk1 = kk1/2;
-      mkk = mkk1*MKK+mkk2;
-      for (k = 0; k < mst; k++) {
-	if (fabs(a[mkk][k]) > EPS30) {
-	  m = 1;
-	  break;
-	}
-      }      
-      if (m == 1) break;
-    }
-    if (m) {
+    if (m2s[mkk2]) {
       SlaterTotal(&sd2, &se2, NULL, ks2, kk2, 0);
       a2[mkk2] = sd2 + se2;
     } else {
@@ -4853,7 +4857,7 @@ int StructureMBPT1(char *fn, char *fn0, char *fn1,
     eu0[i] = 1e31;
     eu1[i] = -1e31;
   }
-  ResetWidMPI();
+  ResetWidNMPI(MAX_SYMMETRIES);
 #pragma omp parallel default(shared) private(isym, h, sym, ks, mks, m, mix, k, q, st, i, j, a, b, c, i0, mr)
   {
   mr = MPIRank(NULL);
@@ -5418,7 +5422,8 @@ int StructureMBPT1(char *fn, char *fn0, char *fn1,
       }
       double *dm = NULL;
       int *im = NULL;      
-      if (mbpt_msort) {
+      /* the dynamic MPI schedule relies on the largest-first order */
+      if (mbpt_msort || DynamicMPI()) {
 	dm = malloc(sizeof(double)*(icp1-icp0));
 	im = malloc(sizeof(int)*(icp1-icp0));
 	double amst = tmst/npr;
@@ -5634,6 +5639,7 @@ int StructureMBPT1(char *fn, char *fn0, char *fn1,
 	free(dm);
 	free(im);
       }
+      ReportLoadMPI("StructureMBPT1");
       MPrintf(-1, "MBPT Structure ... %12.5E %12.5E %12.5E %ld\n",
 	      WallTime()-tbg, TotalSize(), TotalArraySize(), mbpt_ignoren);
       fflush(stdout);
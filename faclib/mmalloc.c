@@ -15,33 +15,126 @@
  *   You should have received a copy of the GNU General Public License
  *   along with this program. If not, see <http://www.gnu.org/licenses/>.
  */
-
 #define _MMALLOC_H_ 1
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static size_t _tsize = 0;
-static double _dmsize = 0;
+/* the size header carries the byte count in its low bits and the
+** allocation tag in the top MTAG_BITS bits. */
+#define MTAG_MAX   8
+#define MTAG_BITS  8
+#define MTAG_SHIFT (8*sizeof(size_t)-MTAG_BITS)
+#define MSIZE_MASK ((((size_t)1)<<MTAG_SHIFT)-1)
+
+/* mmalloc.h is not included, it redefines malloc and free */
+int MSetTag(int t);
+int MSetThreadTag(int t);
+int MGetTag(void);
+size_t mmsizetag(int t);
+
+/*
+** STRUCT:      MCOUNT
+** PURPOSE:     per-thread allocation counters.
+** FIELDS:      {long size[]},
+**              bytes currently held, by tag.
+**              {size_t dsize},
+**              cumulative bytes requested through mmalloc.
+**              {MCOUNT *next},
+**              next thread in the registry.
+** NOTE:        only the owning thread writes its counters, so the
+**              hot path needs no atomic read-modify-write. frees
+**              are charged to the freeing thread, so a single
+**              counter may go negative, but the sum over the
+**              registry is exact. blocks are never released, a
+**              thread that exits still holds the balance of what
+**              it allocated.
+*/
+typedef struct _MCOUNT_ {
+  long size[MTAG_MAX];
+  size_t dsize;
+  struct _MCOUNT_ *next;
+} MCOUNT;
+
+static MCOUNT * volatile _mclist = NULL;
+static MCOUNT *_mcount = NULL;
+static int _mtagt = -1;
+#pragma omp threadprivate(_mcount, _mtagt)
+/* the phase tag is shared, so the workers of a parallel region are
+** charged to the phase the master thread is in. */
+static volatile int _mtag = 0;
+
+#define MTag() (_mtagt >= 0 ? _mtagt : _mtag)
+
+static MCOUNT *MCount(void) {
+  MCOUNT *c;
+
+  if (_mcount) return _mcount;
+  c = (MCOUNT *) calloc(1, sizeof(MCOUNT));
+  if (c == NULL) {
+    printf("mcount error\n");
+    exit(1);
+  }
+  do {
+    c->next = _mclist;
+  } while (!__sync_bool_compare_and_swap(&_mclist, c->next, c));
+  _mcount = c;
+  return c;
+}
+
+size_t mmsize(void);
+
+static inline void MCountAdd(int t, long d) {
+  MCOUNT *c = MCount();
+  __atomic_store_n(&c->size[t], c->size[t]+d, __ATOMIC_RELAXED);
+}
+
+static inline size_t MHeader(size_t size, int t) {
+  return (size&MSIZE_MASK) | (((size_t)t)<<MTAG_SHIFT);
+}
+
+/* set the phase tag, returns the previous one */
+int MSetTag(int t) {
+  int t0 = _mtag;
+  if (t >= 0 && t < MTAG_MAX) _mtag = t;
+  return t0;
+}
+
+/* override the phase tag in the calling thread, t < 0 clears it */
+int MSetThreadTag(int t) {
+  int t0 = _mtagt;
+  _mtagt = t < MTAG_MAX ? t : -1;
+  return t0;
+}
+
+int MGetTag(void) {
+  return MTag();
+}
 
 double dmsize() {
-  return _dmsize;
+  MCOUNT *c;
+  double s = 0;
+  for (c = _mclist; c; c = c->next) {
+    s += __atomic_load_n(&c->dsize, __ATOMIC_RELAXED);
+  }
+  return s;
 }
+
 void *mmalloc(size_t size) {
   size_t *p = NULL;
 
   p = (size_t *) malloc(size+sizeof(size_t));
   if (p == NULL) {
-    printf("malloc error: %zu %zu\n", size, _tsize);
+    printf("malloc error: %zu %zu\n", size, mmsize());
     int *ix = 0;
     *ix = 0;
   }
-  *p = size;
-#pragma omp atomic
-  _tsize += size;
-#pragma omp atomic
-  _dmsize += size;
+  int t = MTag();
+  *p = MHeader(size, t);
+  MCountAdd(t, size);
+  MCOUNT *c = _mcount;
+  __atomic_store_n(&c->dsize, c->dsize+size, __ATOMIC_RELAXED);
   return &p[1];
 }
 
@@ -51,32 +144,32 @@ void *mcalloc(size_t n, size_t size) {
 
   p = (size_t *) calloc(ns+sizeof(size_t), 1);
   if (p == NULL) {
-    printf("calloc error: %zu %zu %zu\n", n, size, _tsize);
+    printf("calloc error: %zu %zu %zu\n", n, size, mmsize());
     exit(1);
   }
-  *p = ns;
-#pragma omp atomic
-  _tsize += ns;
+  int t = MTag();
+  *p = MHeader(ns, t);
+  MCountAdd(t, ns);
   return &p[1];
 }
 
 void *mrealloc(void *p, size_t size) {
-  size_t *ps;
+  size_t *ps = NULL;
+  int t = MTag();
 
   if (p) {
     ps = (size_t *) p;
     ps--;
-#pragma omp atomic
-    _tsize -= ps[0];
+    t = ps[0]>>MTAG_SHIFT;
+    MCountAdd(t, -(long)(ps[0]&MSIZE_MASK));
   }
   ps = (size_t *) realloc(ps, size+sizeof(size_t));
   if (ps == NULL) {
-    printf("realloc error: %zu %zu\n", size, _tsize);
+    printf("realloc error: %zu %zu\n", size, mmsize());
     exit(1);
   }
-  *ps = size;
-#pragma omp atomic
-  _tsize += size;
+  *ps = MHeader(size, t);
+  MCountAdd(t, size);
   return &ps[1];
 }
 
@@ -86,11 +179,24 @@ void mfree(void *p) {
   if (!p) return;
   ps = (size_t *) p;
   ps--;
-#pragma omp atomic
-  _tsize -= ps[0];
+  MCountAdd(ps[0]>>MTAG_SHIFT, -(long)(ps[0]&MSIZE_MASK));
   free(ps);
 }
 
+size_t mmsizetag(int t) {
+  MCOUNT *c;
+  long s = 0;
+  int i;
+
+  for (c = _mclist; c; c = c->next) {
+    for (i = 0; i < MTAG_MAX; i++) {
+      if (t >= 0 && i != t) continue;
+      s += __atomic_load_n(&c->size[i], __ATOMIC_RELAXED);
+    }
+  }
+  return s > 0 ? s : 0;
+}
+
 size_t mmsize(void) {
-  return _tsize;
+  return mmsizetag(-1);
 }
@@ -25,10 +25,22 @@
 #define free(p)        mfree((p))
 #define msize()        mmsize()
 
+/* allocation tags for the per-subsystem breakdown of msize() */
+#define MTAG_OTHER      0
+#define MTAG_RADIAL     1
+#define MTAG_STRUCTURE  2
+#define MTAG_EXCITATION 3
+#define MTAG_CRM        4
+#define MTAG_MAX        8
+
 void *mmalloc(size_t size);
 void *mcalloc(size_t n, size_t x);
 void *mrealloc(void *p, size_t n);
 void mfree(void *p);
 size_t mmsize(void);
+size_t mmsizetag(int t);
+int MSetTag(int t);
+int MSetThreadTag(int t);
+int MGetTag(void);
 double dmsize();
 #endif
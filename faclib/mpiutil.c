@@ -27,11 +27,57 @@ static int _procid = -1;
 static int _initialized = 0;
 static LOCK *_plock = NULL;
 static LOCK *_mpilock = NULL;
-static volatile long long _cwid = -1;
+static volatile long long _cwid = 0;
+static long long _nwid = 0;
+static int _wchunk = 1;
+static int _wguided = 0;
 static MPID mpi = {0, 1, 0};
+static long long _wid0 = 0, _wid1 = 0;
 static double _tlock = 0, _tskip = 0;
 static long long _nlock = 0;
-#pragma omp threadprivate(mpi,_tlock,_tskip, _nlock)
+#pragma omp threadprivate(mpi,_wid0,_wid1,_tlock,_tskip, _nlock)
+
+/* dynamic schedule across MPI ranks. the shared counter lives in an
+** RMA window on rank 0. the work items are numbered continuously
+** across loops in _wabs, which ResetWidMPI brings back in line with
+** the counter, so all ranks agree on the numbering of the next loop
+** even if they called SkipMPI a different number of times. */
+static int _wdynamic = 0;
+#if USE_MPI == 1
+static double _tbusy = 0, _tbusy0 = 0;
+static MPI_Win _wwin = MPI_WIN_NULL;
+static long long *_wbuf = NULL;
+static long long _wabs = 0;
+
+/*
+** FUNCTION:    ClaimWidMPI
+** PURPOSE:     claim the next c work items.
+** INPUT:       {long long c},
+**              number of items to claim.
+** RETURN:      {long long},
+**              number of items claimed before, the claimed ones are
+**              numbered from the return value + 1.
+** SIDE EFFECT: 
+** NOTE:        a rank only walks past an item it does not own if the
+**              counter is already beyond it, so the claimed chunk
+**              never starts behind the current item of the caller.
+*/
+static long long ClaimWidMPI(long long c) {
+  long long v;
+
+  MPI_Fetch_and_op(&c, &v, MPI_LONG_LONG, 0, 0, MPI_SUM, _wwin);
+  MPI_Win_flush(0, _wwin);
+  return v;
+}
+
+/* accumulate the busy time of the work item just finished */
+static void CloseBusyMPI(double t) {
+  if (_tbusy0 > 0) {
+    _tbusy += t - _tbusy0;
+    _tbusy0 = 0;
+  }
+}
+#endif
 
 void SetProcID(int id) {
   _procid = id;
@@ -55,22 +101,54 @@ int SkipMPI() {
   int r = 0;
 #if USE_MPI == 1
   if (mpi.nproc > 1) {
-    if (mpi.wid%mpi.nproc != mpi.myrank) {
-      r = 1;
-    } 
-    mpi.wid++;
+    double t = WallTime();
+    CloseBusyMPI(t);
+    if (_wdynamic && _wwin != MPI_WIN_NULL) {
+      mpi.wid++;
+      _wabs++;
+      if (_wabs > _wid1) {
+	long long c = _wchunk;
+	if (_wguided && _nwid > 0) {
+	  long long n = (_nwid - mpi.wid)/(2*mpi.nproc);
+	  if (n > c) c = n;
+	}
+	_wid0 = ClaimWidMPI(c);
+	_wid1 = _wid0 + c;
+      }
+      if (_wabs <= _wid0) r = 1;
+    } else {
+      if (mpi.wid%mpi.nproc != mpi.myrank) {
+	r = 1;
+      } 
+      mpi.wid++;
+    }
+    if (!r) _tbusy0 = t;
   }
   return r;
 #elif USE_MPI == 2
+  /* every thread walks the same sequence of work items, numbered by
+  ** mpi.wid. a thread owns the items in (_wid0, _wid1], and claims
+  ** the next chunk from the shared counter _cwid with an atomic
+  ** fetch-add once it walks past its range. since _cwid never falls
+  ** behind the position of any thread, the new chunk starts at or
+  ** ahead of the current item, and the items before it belong to
+  ** other threads. */
   if (mpi.nproc > 1) {
 #ifdef OMP_STAT
     double t0 = WallTime();
 #endif    
-    SetLockNT(_mpilock);
-    mpi.wid++;      
-    if (mpi.wid <= _cwid) r = 1;
-    else _cwid = mpi.wid;
-    ReleaseLock(_mpilock);
+    mpi.wid++;
+    if (mpi.wid > _wid1) {
+      long long c = _wchunk;
+      if (_wguided && _nwid > 0) {
+	long long n = (_nwid - __atomic_load_n(&_cwid, __ATOMIC_RELAXED));
+	n /= 2*mpi.nproc;
+	if (n > c) c = n;
+      }
+      _wid0 = __atomic_fetch_add(&_cwid, c, __ATOMIC_RELAXED);
+      _wid1 = _wid0 + c;
+    }
+    if (mpi.wid <= _wid0) r = 1;
 #ifdef OMP_STAT
     double t1 = WallTime();
     _tskip += t1-t0;
@@ -175,17 +253,135 @@ long long CWidMPI() {
   return _cwid;
 }
 
-void ResetWidMPI(void) {
+/*
+** FUNCTION:    ResetWidNMPI
+** PURPOSE:     restart the numbering of work items handed out by
+**              SkipMPI.
+** INPUT:       {long long n},
+**              number of work items in the coming loop, 0 if unknown.
+** RETURN:      
+** SIDE EFFECT: with OpenMP, the shared counter and the chunk of each
+**              thread are cleared. the dynamic MPI schedule moves
+**              _wabs of all ranks to the window counter, which is
+**              collective over the ranks.
+** NOTE:        n is only used by the guided schedule, which hands out
+**              chunks of 1/(2*nproc) of the remaining items, but no
+**              less than the chunk size.
+*/
+void ResetWidNMPI(long long n) {
 #if USE_MPI == 2
   if (!MPIReady()) {
     printf("openmp not initialized\n");
     Abort(1);
   }
 #endif
-  _cwid = -1;  
+  _cwid = 0;
+  _nwid = n;
+#if USE_MPI == 1
+  CloseBusyMPI(WallTime());
+  mpi.wid = 0;
+  if (DynamicMPI()) {
+    /* once all ranks are done with the previous loop, the counter
+       is the end of the last chunk claimed by any rank */
+    long long w;
+    MPI_Allreduce(&_wid1, &w, 1, MPI_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+    _wabs = w;
+    _wid0 = w;
+    _wid1 = w;
+  }
+#else
 #pragma omp parallel
   {
   mpi.wid = 0;
+  _wid0 = 0;
+  _wid1 = 0;
+  }
+#endif
+}
+
+void ResetWidMPI(void) {
+  ResetWidNMPI(0);
+}
+
+/* 1 if SkipMPI hands out work to MPI ranks dynamically */
+int DynamicMPI(void) {
+#if USE_MPI == 1
+  return _wdynamic && _wwin != MPI_WIN_NULL && mpi.nproc > 1;
+#else
+  return 0;
+#endif
+}
+
+/*
+** FUNCTION:    TaskOrderMPI
+** PURPOSE:     order in which a loop walks its tasks.
+** INPUT:       {int n},
+**              number of tasks.
+**              {double *cost},
+**              estimated cost of each task, may be NULL if
+**              DynamicMPI() is 0.
+**              {int *k},
+**              output, the task to visit at each step.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        with the dynamic schedule the most expensive tasks go
+**              first, so the ranks do not wait on a large task handed
+**              out at the end. otherwise the natural order is kept.
+**              all ranks compute the same order from the same costs.
+*/
+void TaskOrderMPI(int n, double *cost, int *k) {
+  int i, t;
+
+  if (!DynamicMPI() || cost == NULL) {
+    for (i = 0; i < n; i++) k[i] = i;
+    return;
+  }
+  ArgSort(n, cost, k);
+  for (i = 0; i < n/2; i++) {
+    t = k[i];
+    k[i] = k[n-1-i];
+    k[n-1-i] = t;
+  }
+}
+
+/*
+** FUNCTION:    ReportLoadMPI
+** PURPOSE:     print the busy and idle time of each rank.
+** INPUT:       {char *s},
+**              label of the loop.
+** RETURN:      
+** SIDE EFFECT: the busy time is reset.
+** NOTE:        busy time is spent on the work items a rank took from
+**              SkipMPI since the last report. idle time is the
+**              difference to the busiest rank, which the others wait
+**              for at the end. collective over all ranks.
+*/
+void ReportLoadMPI(char *s) {
+#if USE_MPI == 1
+  double tmax;
+
+  if (mpi.nproc <= 1) return;
+  CloseBusyMPI(WallTime());
+  MPI_Allreduce(&_tbusy, &tmax, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPrintf(-1, "load %s: busy=%11.4E idle=%11.4E dynamic=%d\n",
+	  s, _tbusy, tmax-_tbusy, DynamicMPI());
+  _tbusy = 0;
+#endif
+}
+
+void SetOptionMPI(char *s, char *sp, int ip, double dp) {
+  if (0 == strcmp(s, "mpi:chunk")) {
+    _wchunk = ip;
+    if (_wchunk < 1) _wchunk = 1;
+    return;
+  }
+  if (0 == strcmp(s, "mpi:guided")) {
+    _wguided = ip;
+    return;
+  }
+  if (0 == strcmp(s, "mpi:dynamic")) {
+    _wdynamic = ip;
+    return;
   }
 }
 
@@ -228,6 +424,17 @@ void InitializeMPI(int n, int m) {
     printf("cannot initialize MPI\n");
     exit(1);
   }
+  if (mpi.nproc > 1) {
+    MPI_Aint ws = mpi.myrank == 0 ? sizeof(long long) : 0;
+    if (MPI_SUCCESS != MPI_Win_allocate(ws, sizeof(long long), MPI_INFO_NULL,
+					MPI_COMM_WORLD, &_wbuf, &_wwin)) {
+      _wwin = MPI_WIN_NULL;
+    } else {
+      if (mpi.myrank == 0) *_wbuf = 0;
+      MPI_Win_lock_all(0, _wwin);
+      MPI_Barrier(MPI_COMM_WORLD);
+    }
+  }
 #elif USE_MPI == 2
   D1MACH(1);
   if (n > 0) {
@@ -256,6 +463,8 @@ void InitializeMPI(int n, int m) {
     mpi.wid = 0;
     mpi.myrank = omp_get_thread_num();
     mpi.nproc = omp_get_num_threads();
+    _wid0 = 0;
+    _wid1 = 0;
     _tlock = 0;
     _tskip = 0;
   }
@@ -301,6 +510,10 @@ long long NumLock() {
 
 void FinalizeMPI() {
 #if USE_MPI == 1
+  if (_wwin != MPI_WIN_NULL) {
+    MPI_Win_unlock_all(_wwin);
+    MPI_Win_free(&_wwin);
+  }
   MPI_Finalize();
 #endif
   if (_plock) {
@@ -609,6 +822,39 @@ long BFileTell(BFILE *bf) {
   return ftell(bf->f);
 }
 
+/* 
+** FUNCTION:    BFileFlushRank
+** PURPOSE:     write out the buffer of the calling thread only.
+** INPUT:       {BFILE *bf},
+**              the buffered file.
+** RETURN:      {int},
+**              always 0.
+** SIDE EFFECT: 
+** NOTE:        what the thread wrote so far then precedes in the file
+**              whatever the other threads write afterwards.
+*/
+int BFileFlushRank(BFILE *bf) {
+  int mr;
+
+  if (bf->buf == NULL) return 0;
+#if USE_MPI == 2
+  mr = MPIRank(NULL);
+#else
+  mr = 0;
+#endif
+  if (bf->w[mr] > 0) {
+#if USE_MPI == 2
+    if (bf->nr > 1) SetLock(&bf->lock);
+#endif
+    fwrite(bf->buf+bf->nbuf*mr, 1, bf->w[mr], bf->f);
+    bf->w[mr] = 0;
+#if USE_MPI == 2
+    if (bf->nr > 1) ReleaseLock(&bf->lock);
+#endif
+  }
+  return 0;
+}
+
 int BFileFlush(BFILE *bf) {
   int i;
   if (bf->buf != NULL) {
@@ -70,6 +70,11 @@ long long WidMPI();
 long long CWidMPI();
 void SetWidMPI(long long w);
 void ResetWidMPI(void);
+void ResetWidNMPI(long long n);
+void SetOptionMPI(char *s, char *sp, int ip, double dp);
+int DynamicMPI(void);
+void TaskOrderMPI(int n, double *cost, int *k);
+void ReportLoadMPI(char *s);
 double WallTime();
 MPID *DataMPI();
 double TimeSkip();
@@ -89,6 +94,7 @@ char *BFileGetLine(char *s, int size, BFILE *f);
 int BFileSeek(BFILE *bf, long offset, int whence);
 long BFileTell(BFILE *bf);
 int BFileFlush(BFILE *bf);
+int BFileFlushRank(BFILE *bf);
 void InitializeMPI(int n, int m);
 void FinalizeMPI(void);
 RANDIDX *RandList(int n);
@@ -182,6 +182,9 @@ static int IntegrateRadial(double *p, double e, POTENTIAL *pot,
 			   int i1, double p1, int i2, double p2, int q);
 static double Amplitude(double *p, double e, int kl, POTENTIAL *pot, int i1);
 static int Phase(double *p, POTENTIAL *pot, int i1, double p0);
+static void CheckRadialSolution(ORBITAL *orb, POTENTIAL *pot);
+static int RadialFreeK(ORBITAL *orb, POTENTIAL *pot, double *wk);
+static int SetPotentialWK(POTENTIAL *pot, double e, int k, double *wk);
 
 double ZColl() {
   return _zcoll;
@@ -518,6 +521,11 @@ int RadialSolver(ORBITAL *orb, POTENTIAL *pot) {
   } else {
     ierr = RadialBasisOuter(orb, pot);
   }
+  CheckRadialSolution(orb, pot);
+  return ierr;
+}
+
+static void CheckRadialSolution(ORBITAL *orb, POTENTIAL *pot) {
   if (orb->wfun != NULL && orb->ilast > 0) orb->isol = 1;
   if (orb->wfun && _on_error >= 0) {
     if (isnan(orb->wfun[0]) || isnan(orb->wfun[pot->maxrp])) {
@@ -526,6 +534,61 @@ int RadialSolver(ORBITAL *orb, POTENTIAL *pot) {
 	      orb->wfun[0], orb->wfun[pot->maxrp]);
     }
   }
+}
+
+/* 
+** FUNCTION:    RadialFreeBatch
+** PURPOSE:     solve the free orbitals of one kappa at several energies.
+** INPUT:       {int n},
+**              number of orbitals.
+**              {ORBITAL *orb},
+**              orbitals with n = 0, the same kappa, and the energies set.
+**              {POTENTIAL *pot},
+**              the potential.
+** RETURN:      {int},
+**              0: success, otherwise the error of the failed orbital.
+** SIDE EFFECT: the wave functions are solved as in RadialSolver.
+** NOTE:        the kappa dependent terms of the W potential and of the
+**              effective potential are set up once for all energies.
+**              the W terms of pot are overwritten, so the caller must
+**              hold the orbital table lock as for RadialSolver.
+*/
+int RadialFreeBatch(int n, ORBITAL *orb, POTENTIAL *pot) {
+  int i, kappa, kl, kv, m5, ierr;
+  double *wk, x, r, kl1;
+
+  if (n <= 0) return 0;
+  kappa = orb[0].kappa;
+  if (_zcoll || _mcoll || kappa == 0) {
+    for (i = 0; i < n; i++) {
+      ierr = RadialSolver(orb+i, pot);
+      if (ierr) return ierr;
+    }
+    return 0;
+  }
+  kv = 0;
+  if (pot->pse) kv = IdxVT(kappa);
+  kl = (kappa < 0)? (-kappa-1):kappa;
+  kl1 = 0.5*kl*(kl+1);
+  m5 = pot->maxrp-5;
+  wk = malloc(sizeof(double)*3*pot->maxrp);
+  for (i = 0; i < pot->maxrp; i++) {
+    x = pot->dVT[kv][i];
+    wk[i] = x*x*0.75*FINE_STRUCTURE_CONST2;
+    wk[i+pot->maxrp] = - 2.0*kappa*x/pot->rad[i];
+    r = pot->rad[i];
+    r *= r;
+    wk[i+2*pot->maxrp] = pot->VT[kv][i];
+    if (i < m5) wk[i+2*pot->maxrp] += kl1/r;
+  }
+  ierr = 0;
+  for (i = 0; i < n; i++) {
+    orb[i].rfn = 0;
+    ierr = RadialFreeK(orb+i, pot, wk);
+    if (ierr) break;
+    CheckRadialSolution(orb+i, pot);
+  }
+  free(wk);
   return ierr;
 }
 
@@ -1842,13 +1905,18 @@ int RadialFreeInner(ORBITAL *orb, POTENTIAL *pot) {
 // Solve the Dirac equation for a free (continuum) electron 
 // wave function(energy > 0)
 int RadialFree(ORBITAL *orb, POTENTIAL *pot) {
+  if (_zcoll || _mcoll) return RadialFreeZMC(orb, pot);
+  return RadialFreeK(orb, pot, NULL);
+}
+
+/* wk, if not NULL, holds the kappa dependent terms set up in
+   RadialFreeBatch. */
+static int RadialFreeK(ORBITAL *orb, POTENTIAL *pot, double *wk) {
   int i, kl, nodes;
   int i2, i2p, i2m, i2p2, i2m2;
   double *p, po, qo, e, po1, bqp0;
   double dfact, da, cs, si, phase0;
 
-  if (_zcoll || _mcoll) return RadialFreeZMC(orb, pot);
-  
   int kv = 0;
   if (pot->pse) kv = IdxVT(orb->kappa);
   orb->kv = kv;
@@ -1870,7 +1938,11 @@ int RadialFree(ORBITAL *orb, POTENTIAL *pot) {
   }
   // Initialize effective W potential with correct constants 
   // etc
-  SetPotentialW(pot, e, kl, kv);
+  if (wk) {
+    SetPotentialWK(pot, e, kv, wk);
+  } else {
+    SetPotentialW(pot, e, kl, kv);
+  }
   kl = (kl < 0)? (-kl-1):kl;  
   p = malloc(2*pot->maxrp*sizeof(double));
   if (!p) return -1;
@@ -1878,7 +1950,13 @@ int RadialFree(ORBITAL *orb, POTENTIAL *pot) {
   // transformed radial Dirac equation Eq. (8) of
   // Gu (2002), Veff(r) = U + k(k+1)/r^2/2
   // effective potential is stored in pot
-  SetVEffective(kl, kv, pot);
+  if (wk) {
+    for (i = 0; i < pot->maxrp; i++) {
+      _veff[i] = wk[i+2*pot->maxrp] + pot->W[i];
+    }
+  } else {
+    SetVEffective(kl, kv, pot);
+  }
   
   // Determine cut-off points between region I
   // (Numerov solution to radial Dirac equation)
@@ -3422,6 +3500,31 @@ int SetPotentialW(POTENTIAL *pot, double e, int kappa, int k) {
   return 0;
 }
 
+/* same as SetPotentialW, with the kappa dependent terms precomputed
+   by RadialFreeBatch. */
+static int SetPotentialWK(POTENTIAL *pot, double e, int k, double *wk) {
+  int i;
+  double xi, r, x, y, z;
+
+  for (i = 0; i < pot->maxrp; i++) {
+    xi = e - pot->VT[k][i];
+    r = xi*FINE_STRUCTURE_CONST2*0.5 + 1.0;  
+    y = wk[i+pot->maxrp];
+    x = wk[i]/r;
+    z = pot->dVT2[k][i];
+    pot->W[i] = x + y + z;
+    pot->W[i] /= 4.0*r;
+    x = xi*xi;
+    pot->W[i] = x - pot->W[i];
+    pot->W[i] *= 0.5*FINE_STRUCTURE_CONST2;
+    pot->W[i] = -pot->W[i];
+  }
+
+  Differential(pot->W, pot->dW, 0, pot->maxrp-1, pot);
+  Differential(pot->dW, pot->dW2, 0, pot->maxrp-1, pot);
+  return 0;
+}
+
 int SetPotentialWZMC(POTENTIAL *pot, double e, int kappa, int k) {
   int i;
   double xi, r, r2, x, y, z, a2;
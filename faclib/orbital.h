@@ -84,6 +84,7 @@ int RadialRydberg(ORBITAL *orb, POTENTIAL *pot);
 int RadialBound(ORBITAL *orb, POTENTIAL *pot);
 int RadialFreeInner(ORBITAL *orb, POTENTIAL *pot);
 int RadialFree(ORBITAL *orb, POTENTIAL *pot);
+int RadialFreeBatch(int n, ORBITAL *orb, POTENTIAL *pot);
 int RadialFreeZMC(ORBITAL *orb, POTENTIAL *pot);
 int CountNodes(double *p, POTENTIAL *pot, int i1, int i2);
 double InnerProduct(int i1, int n, 
@@ -21,6 +21,8 @@
 #include "cf77.h"
 #include "structure.h"
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 static char *rcsid="$Id$";
 #if __GNUC__ == 2
@@ -175,6 +177,35 @@ static MULTI *moments_array;
 static MULTI *gos_array;
 static MULTI *yk_array;
 
+/* on-disk store of the bound-orbital slater, breit and yk integrals.
+   records are keyed by ShellToInt of the orbitals, which is stable across
+   runs, and the file name is a hash of the potential and radial grid. */
+typedef struct _RSTORE_REC_ {
+  int k[6];
+  double v;
+} RSTORE_REC;
+
+typedef struct _RSTORE_YREC_ {
+  int k[4];
+  long long off;
+} RSTORE_YREC;
+
+typedef struct _RSTORE_ {
+  int state;
+  unsigned long long hash;
+  char *map;
+  size_t size;
+  long long ns, nb, ny, nf;
+  RSTORE_REC *s, *b;
+  RSTORE_YREC *y;
+  float *f;
+} RSTORE;
+
+#define RSTORE_MAGIC "FACRSTO1"
+#define RSTORE_HEADER (8+5*sizeof(long long))
+static char _rstore_dir[1024] = "";
+static RSTORE _rstore = {0, 0, NULL, 0, 0, 0, 0, 0, NULL, NULL, NULL, NULL};
+
 #define MAXNAW 128
 static int n_awgrid = 0;
 static double awgrid[MAXNAW];
@@ -350,6 +381,412 @@ void SaveRadialMultipole(char *fn, int n, int nk, int *ks, int g) {
   fclose(f);
 }
 
+static unsigned long long RStoreFNV(unsigned long long h, void *p, size_t n) {
+  unsigned char *c = (unsigned char *) p;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    h ^= c[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/* hash of everything the bound orbitals depend on */
+static unsigned long long RStoreHash(void) {
+  unsigned long long h;
+  int i, x[4];
+  double d[6];
+
+  h = 14695981039346656037ULL;
+  h = RStoreFNV(h, RSTORE_MAGIC, 8);
+  x[0] = potential->maxrp;
+  x[1] = potential->mode;
+  x[2] = potential->ib;
+  x[3] = potential->nb;
+  h = RStoreFNV(h, x, sizeof(x));
+  d[0] = potential->N;
+  d[1] = potential->ar;
+  d[2] = potential->br;
+  d[3] = potential->qr;
+  d[4] = potential->rb;
+  d[5] = potential->bqp;
+  h = RStoreFNV(h, d, sizeof(d));
+  h = RStoreFNV(h, potential->rad, sizeof(double)*potential->maxrp);
+  h = RStoreFNV(h, potential->Z, sizeof(double)*potential->maxrp);
+  for (i = 0; i < NKSEP1; i++) {
+    h = RStoreFNV(h, potential->VT[i], sizeof(double)*potential->maxrp);
+  }
+  return h;
+}
+
+/* 
+** FUNCTION:    PotentialHash
+** PURPOSE:     hash of the potential, the radial grid, and the
+**              options of the hamiltonian.
+** INPUT:       
+** RETURN:      {unsigned long long},
+**              the hash.
+** SIDE EFFECT: 
+** NOTE:        quantities saved from a run, such as the hamiltonians
+**              of an incremental structure calculation, are only
+**              valid for the same hash. it extends the hash of the
+**              radial store with the breit, qed, mass shift and
+**              slater cut options, which change the matrix elements
+**              but not the orbitals.
+*/
+unsigned long long PotentialHash(void) {
+  unsigned long long h;
+  int x[13];
+  double d[7];
+
+  h = RStoreHash();
+  x[0] = qed.se;
+  x[1] = qed.mse;
+  x[2] = qed.sse;
+  x[3] = qed.pse;
+  x[4] = qed.vp;
+  x[5] = qed.nms;
+  x[6] = qed.sms;
+  x[7] = qed.br;
+  x[8] = qed.mbr;
+  x[9] = qed.nbr;
+  x[10] = qed.minbr;
+  x[11] = slater_cut.kl0;
+  x[12] = slater_cut.kl1;
+  h = RStoreFNV(h, x, sizeof(x));
+  d[0] = qed.xbr;
+  d[1] = qed.ose0;
+  d[2] = qed.ose1;
+  d[3] = qed.ase;
+  d[4] = qed.cse0;
+  d[5] = qed.cse1;
+  d[6] = qed.ise;
+  h = RStoreFNV(h, d, sizeof(d));
+  return h;
+}
+
+static void RStoreFileName(char *fn, unsigned long long h) {
+  sprintf(fn, "%s/%016llx.frc", _rstore_dir, h);
+}
+
+static int CompareRStoreRec(const void *p0, const void *p1) {
+  const int *k0 = ((const RSTORE_REC *) p0)->k;
+  const int *k1 = ((const RSTORE_REC *) p1)->k;
+  int i;
+
+  for (i = 0; i < 6; i++) {
+    if (k0[i] < k1[i]) return -1;
+    if (k0[i] > k1[i]) return 1;
+  }
+  return 0;
+}
+
+static int CompareRStoreYRec(const void *p0, const void *p1) {
+  const int *k0 = ((const RSTORE_YREC *) p0)->k;
+  const int *k1 = ((const RSTORE_YREC *) p1)->k;
+  int i;
+
+  for (i = 0; i < 3; i++) {
+    if (k0[i] < k1[i]) return -1;
+    if (k0[i] > k1[i]) return 1;
+  }
+  return 0;
+}
+
+/* map the store file of the current potential, if there is one */
+static void OpenRadialStore(void) {
+  char fn[1100];
+  struct stat st;
+  char *m;
+  long long *c;
+  int fd;
+
+  if (_rstore.state) return;
+#pragma omp critical(rstore)
+  {
+    if (_rstore.state == 0) {
+      _rstore.hash = RStoreHash();
+      RStoreFileName(fn, _rstore.hash);
+      _rstore.state = -1;
+      fd = open(fn, O_RDONLY);
+      if (fd >= 0) {
+	m = NULL;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t) RSTORE_HEADER) {
+	  m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	  if (m == MAP_FAILED) m = NULL;
+	}
+	close(fd);
+	if (m) {
+	  c = (long long *) (m + 8);
+	  if (memcmp(m, RSTORE_MAGIC, 8) != 0 ||
+	      (unsigned long long) c[0] != _rstore.hash ||
+	      st.st_size != (off_t) (RSTORE_HEADER + c[1]*sizeof(RSTORE_REC)
+				     + c[2]*sizeof(RSTORE_REC)
+				     + c[3]*sizeof(RSTORE_YREC)
+				     + c[4]*sizeof(float))) {
+	    MPrintf(-1, "invalid radial store: %s\n", fn);
+	    munmap(m, st.st_size);
+	  } else {
+	    _rstore.map = m;
+	    _rstore.size = st.st_size;
+	    _rstore.ns = c[1];
+	    _rstore.nb = c[2];
+	    _rstore.ny = c[3];
+	    _rstore.nf = c[4];
+	    _rstore.s = (RSTORE_REC *) (m + RSTORE_HEADER);
+	    _rstore.b = _rstore.s + _rstore.ns;
+	    _rstore.y = (RSTORE_YREC *) (_rstore.b + _rstore.nb);
+	    _rstore.f = (float *) (_rstore.y + _rstore.ny);
+	    _rstore.state = 1;
+	  }
+	}
+      }
+#pragma omp flush
+    }
+  }
+}
+
+static void CloseRadialStore(void) {
+  if (_rstore.state > 0) {
+    munmap(_rstore.map, _rstore.size);
+    _rstore.map = NULL;
+    _rstore.size = 0;
+  }
+  _rstore.state = 0;
+}
+
+/* shell keys of the orbital indices, 0 if any of them is not bound */
+static int RStoreKey(int n, int *k, int *s) {
+  ORBITAL *orb;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    orb = GetOrbital(k[i]);
+    if (orb == NULL || orb->n <= 0) return 0;
+    s[i] = ShellToInt(orb->n, orb->kappa);
+  }
+  return 1;
+}
+
+/* m = 0 for the slater, 1 for the breit integrals */
+static int RStoreRecKey(int m, int *index, int *k) {
+  if (!RStoreKey(4, index, k)) return 0;
+  if (m == 0) SortSlaterKey(k);
+  k[4] = index[4];
+  k[5] = 0;
+  return 1;
+}
+
+static int RStoreYRecKey(int *index, int *k) {
+  int i;
+
+  if (!RStoreKey(2, index, k)) return 0;
+  if (k[0] > k[1]) {
+    i = k[0];
+    k[0] = k[1];
+    k[1] = i;
+  }
+  k[2] = index[2];
+  k[3] = 0;
+  return 1;
+}
+
+static void LoadStoreDouble(int m, int *index, double *p) {
+  RSTORE_REC r, *q;
+
+  if (!_rstore_dir[0]) return;
+  OpenRadialStore();
+  if (_rstore.state <= 0) return;
+  if (!RStoreRecKey(m, index, r.k)) return;
+  if (m == 0) {
+    q = bsearch(&r, _rstore.s, _rstore.ns, sizeof(RSTORE_REC),
+		CompareRStoreRec);
+  } else {
+    q = bsearch(&r, _rstore.b, _rstore.nb, sizeof(RSTORE_REC),
+		CompareRStoreRec);
+  }
+  if (q) *p = q->v;
+}
+
+static void LoadStoreYk(int *index, FLTARY *syk) {
+  RSTORE_YREC r, *q;
+  int n;
+
+  if (!_rstore_dir[0]) return;
+  OpenRadialStore();
+  if (_rstore.state <= 0) return;
+  if (!RStoreYRecKey(index, r.k)) return;
+  q = bsearch(&r, _rstore.y, _rstore.ny, sizeof(RSTORE_YREC),
+	      CompareRStoreYRec);
+  if (q == NULL) return;
+  n = q->k[3];
+  syk->yk = malloc(sizeof(float)*n);
+  memcpy(syk->yk, _rstore.f + q->off, sizeof(float)*n);
+  AddMultiElemSize(yk_array, syk, sizeof(float)*n);
+  syk->npts = n;
+}
+
+typedef struct _RSTORE_COLLECT_ {
+  int m, n, nmax;
+  RSTORE_REC *r;
+  RSTORE_YREC *y;
+  long long nf, nfmax;
+  float *f;
+} RSTORE_COLLECT;
+
+static void RStoreAddRec(RSTORE_COLLECT *c, int *k, double v) {
+  if (c->n == c->nmax) {
+    c->nmax = c->nmax? 2*c->nmax : 1024;
+    c->r = realloc(c->r, sizeof(RSTORE_REC)*c->nmax);
+  }
+  memcpy(c->r[c->n].k, k, sizeof(int)*6);
+  c->r[c->n].v = v;
+  c->n++;
+}
+
+static void RStoreAddYRec(RSTORE_COLLECT *c, int *k, int n, float *f) {
+  if (c->n == c->nmax) {
+    c->nmax = c->nmax? 2*c->nmax : 1024;
+    c->y = realloc(c->y, sizeof(RSTORE_YREC)*c->nmax);
+  }
+  if (c->nf + n > c->nfmax) {
+    c->nfmax = Max(2*c->nfmax, c->nf+n);
+    c->f = realloc(c->f, sizeof(float)*c->nfmax);
+  }
+  memcpy(c->y[c->n].k, k, sizeof(int)*3);
+  c->y[c->n].k[3] = n;
+  c->y[c->n].off = c->nf;
+  memcpy(c->f + c->nf, f, sizeof(float)*n);
+  c->nf += n;
+  c->n++;
+}
+
+static int RStoreCollectRec(int *index, void *data, void *arg) {
+  RSTORE_COLLECT *c = (RSTORE_COLLECT *) arg;
+  double v = *((double *) data);
+  int k[6];
+
+  if (v && RStoreRecKey(c->m, index, k)) RStoreAddRec(c, k, v);
+  return 0;
+}
+
+static int RStoreCollectYRec(int *index, void *data, void *arg) {
+  RSTORE_COLLECT *c = (RSTORE_COLLECT *) arg;
+  FLTARY *d = (FLTARY *) data;
+  int k[4];
+
+  if (d->npts > 0 && RStoreYRecKey(index, k)) {
+    RStoreAddYRec(c, k, d->npts, d->yk);
+  }
+  return 0;
+}
+
+/* sort and drop duplicated keys, returns the new count */
+static int RStoreUnique(RSTORE_COLLECT *c, int y) {
+  int i, j;
+
+  if (c->n == 0) return 0;
+  if (y) {
+    qsort(c->y, c->n, sizeof(RSTORE_YREC), CompareRStoreYRec);
+  } else {
+    qsort(c->r, c->n, sizeof(RSTORE_REC), CompareRStoreRec);
+  }
+  for (i = 0, j = 1; j < c->n; j++) {
+    if (y) {
+      if (CompareRStoreYRec(&c->y[i], &c->y[j]) == 0) continue;
+      c->y[++i] = c->y[j];
+    } else {
+      if (CompareRStoreRec(&c->r[i], &c->r[j]) == 0) continue;
+      c->r[++i] = c->r[j];
+    }
+  }
+  c->n = i+1;
+  return c->n;
+}
+
+/*
+** FUNCTION:    SaveRadialStore
+** PURPOSE:     write the cached bound-orbital slater, breit and yk
+**              integrals to the on-disk store of the current potential.
+** INPUT:       
+** RETURN:      {int},
+**              number of records written, -1 on error.
+** SIDE EFFECT: the records already in the store are merged in, and
+**              the store is remapped on the next lookup.
+** NOTE:        the store directory is set with
+**              SetOption("radial:store", dir). the integrals are looked
+**              up in Slater, BreitS and GetYk before being computed.
+*/
+int SaveRadialStore(void) {
+  RSTORE_COLLECT c[3];
+  char fn[1100], tfn[1200];
+  long long h[5];
+  FILE *f;
+  int i, n;
+
+  if (!_rstore_dir[0] || potential->maxrp <= 0) return -1;
+  if (MyRankMPI() != 0) return 0;
+  OpenRadialStore();
+  for (i = 0; i < 3; i++) {
+    memset(&c[i], 0, sizeof(RSTORE_COLLECT));
+    c[i].m = i;
+  }
+  MultiWalk(slater_array, RStoreCollectRec, &c[0]);
+  MultiWalk(breit_array, RStoreCollectRec, &c[1]);
+  MultiWalk(yk_array, RStoreCollectYRec, &c[2]);
+  if (_rstore.state > 0) {
+    for (i = 0; i < _rstore.ns; i++) {
+      RStoreAddRec(&c[0], _rstore.s[i].k, _rstore.s[i].v);
+    }
+    for (i = 0; i < _rstore.nb; i++) {
+      RStoreAddRec(&c[1], _rstore.b[i].k, _rstore.b[i].v);
+    }
+    for (i = 0; i < _rstore.ny; i++) {
+      RStoreAddYRec(&c[2], _rstore.y[i].k, _rstore.y[i].k[3],
+		    _rstore.f + _rstore.y[i].off);
+    }
+  }
+  RStoreUnique(&c[0], 0);
+  RStoreUnique(&c[1], 0);
+  RStoreUnique(&c[2], 1);
+  
+  RStoreFileName(fn, _rstore.hash);
+  sprintf(tfn, "%s.%d", fn, (int) getpid());
+  f = fopen(tfn, "w");
+  n = -1;
+  if (f == NULL) {
+    MPrintf(-1, "cannot open radial store: %s\n", tfn);
+  } else {
+    h[0] = (long long) _rstore.hash;
+    h[1] = c[0].n;
+    h[2] = c[1].n;
+    h[3] = c[2].n;
+    h[4] = c[2].nf;
+    i = fwrite(RSTORE_MAGIC, 1, 8, f) == 8;
+    i = i && fwrite(h, sizeof(long long), 5, f) == 5;
+    i = i && fwrite(c[0].r, sizeof(RSTORE_REC), c[0].n, f) == (size_t) c[0].n;
+    i = i && fwrite(c[1].r, sizeof(RSTORE_REC), c[1].n, f) == (size_t) c[1].n;
+    i = i && fwrite(c[2].y, sizeof(RSTORE_YREC), c[2].n, f) == (size_t) c[2].n;
+    i = i && fwrite(c[2].f, sizeof(float), c[2].nf, f) == (size_t) c[2].nf;
+    if (fclose(f) != 0) i = 0;
+    if (i && rename(tfn, fn) == 0) {
+      n = c[0].n + c[1].n + c[2].n;
+      MPrintf(-1, "radial store: %s %d %d %d\n", fn, c[0].n, c[1].n, c[2].n);
+    } else {
+      MPrintf(-1, "cannot write radial store: %s\n", fn);
+      unlink(tfn);
+    }
+  }
+  for (i = 0; i < 3; i++) {
+    if (c[i].r) free(c[i].r);
+    if (c[i].y) free(c[i].y);
+    if (c[i].f) free(c[i].f);
+  }
+  CloseRadialStore();
+  return n;
+}
+
 double GetHXS(POTENTIAL *p) {
   double z, hs;
   double r0, r1;
@@ -577,12 +1014,12 @@ void SetOrbMap(int k, int n0, int n1, int n2) {
   if (n0 <= 0) n0 = NORBMAP0;
   if (n1 <= 0) n1 = NORBMAP1;
   if (n2 <= 0) n2 = NORBMAP2;
-  int i, j;
+  int i, j, m;
   if (_orbmap != NULL) {
     for (i = 0; i < _korbmap; i++) {
       free(_orbmap[i].opn);
       free(_orbmap[i].onn);
-      free(_orbmap[i].ozn);
+      if (_orbmap[i].ozn) free(_orbmap[i].ozn);
     }
     free(_orbmap);
   }
@@ -591,23 +1028,59 @@ void SetOrbMap(int k, int n0, int n1, int n2) {
   _norbmap0 = n0;
   _norbmap1 = n1;
   _norbmap2 = n2;  
+  for (m = 64; m < 2*_norbmap2; m *= 2);
   _orbmap = malloc(sizeof(ORBMAP)*_korbmap);  
   for (i = 0; i < _korbmap; i++) {
     _orbmap[i].nzn = 0;
     _orbmap[i].nmax = 1000000000;
     _orbmap[i].opn = malloc(sizeof(ORBITAL *)*_norbmap0);
     _orbmap[i].onn = malloc(sizeof(ORBITAL *)*_norbmap1);
-    _orbmap[i].ozn = malloc(sizeof(ORBITAL *)*_norbmap2);
+    _orbmap[i].mzn = m;
+    _orbmap[i].ozn = NULL;
     for (j = 0; j < _norbmap0; j++) {
       _orbmap[i].opn[j] = NULL;
     }
     for (j = 0; j < _norbmap1; j++) {
       _orbmap[i].onn[j] = NULL;
     }
-    for (j = 0; j < _norbmap2; j++) {
-      _orbmap[i].ozn[j] = NULL;
+  }
+}
+
+/*
+** the continuum orbitals of each kappa are banked in an open-addressing
+** table keyed on the energy quantized in units of EPS10. two energies
+** within EPS10 differ by at most one unit, so a lookup probes the three
+** neighbouring keys. the table is allocated on the first continuum of
+** a kappa with room for 2*norbmap2 entries and is never resized, so
+** that the lock-free read in OrbitalIndex never sees a stale table.
+*/
+static long ContinuumKey(double e) {
+  return (long) floor(e/EPS10);
+}
+
+static int ContinuumSlot(long q, int m) {
+  unsigned long x;
+
+  x = ((unsigned long) q)*0x9E3779B97F4A7C15UL;
+  x ^= x >> 32;
+  return (int) (x & (m-1));
+}
+
+static ORBITAL *FindContinuum(ORBMAP *om, double e) {
+  ORBITAL **oz, *orb;
+  long q;
+  int i, k, m;
+
+  oz = om->ozn;
+  if (oz == NULL) return NULL;
+  m = om->mzn;
+  q = ContinuumKey(e);
+  for (k = -1; k <= 1; k++) {
+    for (i = ContinuumSlot(q+k, m); (orb = oz[i]) != NULL; i = (i+1)&(m-1)) {
+      if (fabs(e-orb->energy) < EPS10) return orb;
     }
   }
+  return NULL;
 }
 
 int RestorePotential(char *fn, POTENTIAL *p) {
@@ -2297,6 +2770,7 @@ int OptimizeRadial(int ng, int *kg, int ic, double *weight, int ife) {
   double a, b, c, z, emin, smin, hxs[NXS2], ehx[NXS2], mse;
   int iter, i, j, i0, i1, k;
   
+  MSetTag(MTAG_RADIAL);
   if (potential->atom->atomic_number < EPS10) {
     printf("SetAtom has not been called\n");
     Abort(1);
@@ -3069,14 +3543,9 @@ int OrbitalIndex(int n, int kappa, double energy) {
     k = -n-1;
     orb = om->onn[k];
   } else {
-    for (k = 0; k < om->nzn; k++) {
-      //Check if  continuum wave function for requested energy
-      //has already been calculated 
-      if (fabs(energy-om->ozn[k]->energy) < EPS10) {
-	orb = om->ozn[k];
-	break;
-      }
-    }
+    //Check if  continuum wave function for requested energy
+    //has already been calculated 
+    orb = FindContinuum(om, energy);
   }
   if (orb == NULL) {
     if (orbitals->lock) {
@@ -3086,12 +3555,7 @@ int OrbitalIndex(int n, int kappa, double energy) {
       } else if (n < 0) {
 	orb = om->onn[k];
       } else {
-	for (; k < om->nzn; k++) {
-	  if (fabs(energy-om->ozn[k]->energy) < EPS10) {
-	    orb = om->ozn[k];
-	    break;
-	  }
-	}
+	orb = FindContinuum(om, energy);
       }
     }
     if (orb == NULL) {
@@ -3127,6 +3591,115 @@ int OrbitalIndex(int n, int kappa, double energy) {
   return orb->idx;
 }
 
+/* 
+** FUNCTION:    OrbitalIndexBatch
+** PURPOSE:     indices of the continuum orbitals of one kappa at 
+**              several energies.
+** INPUT:       {int kappa},
+**              kappa of the continua.
+**              {int ne, double *e},
+**              number of energies and the energies.
+**              {int *ks},
+**              the orbital indices on output.
+** RETURN:      {int},
+**              number of orbitals solved.
+** SIDE EFFECT: the missing continua are solved in one RadialFreeBatch
+**              call and added to the orbital table.
+** NOTE:        the solution runs under the orbital table lock, as in
+**              OrbitalIndex, since it sets the W terms of the shared
+**              potential. a continuum added by another thread since the
+**              lookup takes precedence.
+*/
+int OrbitalIndexBatch(int kappa, int ne, double *e, int *ks) {
+  ORBITAL *orb, *bo;
+  int i, j, nb, idx, isol, *ib, err;
+  int k = ((abs(kappa)-1)*2)+(kappa>0);
+  if (k >= _korbmap) {
+    printf("too large kappa, enlarge korbmap: %d >= %d\n",
+	   k, _korbmap);
+    Abort(1);
+  }
+  ORBMAP *om = &_orbmap[k];
+
+  nb = 0;
+  ib = NULL;
+  for (i = 0; i < ne; i++) {
+    orb = FindContinuum(om, e[i]);
+    if (orb != NULL && orb->isol) {
+      ks[i] = orb->idx;
+      continue;
+    }
+    for (j = 0; j < i; j++) {
+      if (ks[j] < 0 && fabs(e[i]-e[j]) < EPS10) break;
+    }
+    if (j < i) {
+      ks[i] = ks[j];
+    } else {
+      if (ib == NULL) ib = malloc(sizeof(int)*ne);
+      ib[nb] = i;
+      ks[i] = -(nb+1);
+      nb++;
+    }
+  }
+  if (nb == 0) return 0;
+
+#ifdef PERFORM_STATISTICS
+  clock_t start, stop;
+  start = clock();
+#endif
+  bo = malloc(sizeof(ORBITAL)*nb);
+  InitOrbitalData(bo, nb);
+  for (j = 0; j < nb; j++) {
+    bo[j].n = 0;
+    bo[j].kappa = kappa;
+    bo[j].energy = e[ib[j]];
+  }
+  if (orbitals->lock) SetLock(orbitals->lock);
+  potential->flag = -1;
+  err = RadialFreeBatch(nb, bo, potential);
+  if (err) {
+    printf("Error occured in RadialFreeBatch, %d\n", err);
+    printf("%d %d\n", nb, kappa);
+    exit(1);
+  }
+#ifdef PERFORM_STATISTICS
+  stop = clock();
+  rad_timing.dirac += stop - start;
+#endif
+
+  for (j = 0; j < nb; j++) {
+    orb = FindContinuum(om, bo[j].energy);
+    if (orb == NULL) {
+      orb = GetNewOrbitalNoLock(0, kappa, bo[j].energy);
+      idx = orb->idx;
+      isol = bo[j].isol;
+      bo[j].isol = 0;
+      memcpy(orb, &bo[j], sizeof(ORBITAL));
+      orb->idx = idx;
+#pragma omp flush
+      orb->isol = isol;
+    } else {
+      if (orb->isol == 0) {
+	err = SolveDirac(orb);
+	if (err < 0) {
+	  MPrintf(-1, "Error occured in solving Dirac eq. err = %d\n", err);
+	  Abort(1);
+	}
+      }
+      FreeOrbitalData(&bo[j]);
+    }
+    ib[j] = orb->idx;
+  }
+  if (orbitals->lock) ReleaseLock(orbitals->lock);
+#pragma omp flush
+  for (i = 0; i < ne; i++) {
+    if (ks[i] < 0) ks[i] = ib[-ks[i]-1];
+  }
+  free(bo);
+  free(ib);
+  return nb;
+}
+
 int OrbitalIndexNoLock0(int n, int kappa, double energy) {
   int i, j;
   ORBITAL *orb;
@@ -3190,13 +3763,7 @@ int OrbitalExistsNoLock(int n, int kappa, double energy) {
     k = -n-1;
     orb = om->onn[k];
   } else {
-    int i;
-    for (i = 0; i < om->nzn; i++) {
-      if (fabs(energy-om->ozn[i]->energy) < EPS10) {
-	orb = om->ozn[i];
-	break;
-      }
-    }
+    orb = FindContinuum(om, energy);
   }
   if (orb != NULL) return orb->idx;  
   return -1;
@@ -3261,7 +3828,18 @@ void AddOrbMap(ORBITAL *orb) {
 	     om->nzn, _norbmap2);
       Abort(1);
     }
-    om->ozn[om->nzn] = orb;
+    ORBITAL **oz = om->ozn;
+    if (oz == NULL) {
+      oz = malloc(sizeof(ORBITAL *)*om->mzn);
+      for (k = 0; k < om->mzn; k++) {
+	oz[k] = NULL;
+      }
+#pragma omp flush
+      om->ozn = oz;
+    }
+    for (k = ContinuumSlot(ContinuumKey(orb->energy), om->mzn);
+	 oz[k] != NULL; k = (k+1)&(om->mzn-1));
+    oz[k] = orb;
     om->nzn++;
   }
 }
@@ -3278,8 +3856,9 @@ void RemoveOrbMap(int m) {
     for (i = 0; i < _norbmap1; i++) {
       om->onn[i] = NULL;
     }
-    for (i = 0; i < om->nzn; i++) {
-      om->ozn[i] = NULL;
+    if (om->ozn) {
+      free(om->ozn);
+      om->ozn = NULL;
     }
     om->nzn = 0;
   }
@@ -3419,6 +3998,7 @@ int ClearOrbitalTable(int m) {
 
   if (orbitals->lock) SetLock(orbitals->lock);
   if (m == 0) {
+    CloseRadialStore();
     n_orbitals = 0;
     n_continua = 0;
     ArrayFree(orbitals, FreeOrbitalData);
@@ -3621,9 +4201,10 @@ double ZerothResidualConfig(CONFIG *cfg) {
   return r;
 }
   
-static double FKB(int ka, int kb, int k) {
+/* the angular factor of FKB, 0 if it vanishes */
+static double FKBAngle(int ka, int kb, int k) {
   int ja, jb, ia, ib;
-  double a, b;
+  double a;
   
   GetJLFromKappa(GetOrbital(ka)->kappa, &ja, &ia);
   GetJLFromKappa(GetOrbital(kb)->kappa, &jb, &ib);
@@ -3631,17 +4212,26 @@ static double FKB(int ka, int kb, int k) {
   if (!Triangle(ia, k, ia) || !Triangle(ib, k, ib)) return 0.0;
   a = W3j(ja, k, ja, 1, 0, -1)*W3j(jb, k, jb, 1, 0, -1);
   if (fabs(a) < EPS30) return 0.0; 
+  a *= (ja+1.0)*(jb+1.0);
+  if (IsEven((ja+jb)/2)) a = -a;
+
+  return a;
+}
+
+static double FKB(int ka, int kb, int k) {
+  double a, b;
+  
+  a = FKBAngle(ka, kb, k);
+  if (a == 0) return 0.0;
   Slater(&b, ka, kb, ka, kb, k/2, 0);
   
-  b *= a*(ja+1.0)*(jb+1.0);
-  if (IsEven((ja+jb)/2)) b = -b;
-
-  return b;
+  return b*a;
 }
 
-static double GKB(int ka, int kb, int k) {
+/* the angular factor of GKB, 0 if it vanishes */
+static double GKBAngle(int ka, int kb, int k) {
   int ja, jb, ia, ib;
-  double a, b;
+  double a;
   
   GetJLFromKappa(GetOrbital(ka)->kappa, &ja, &ia);
   GetJLFromKappa(GetOrbital(kb)->kappa, &jb, &ib);
@@ -3649,11 +4239,19 @@ static double GKB(int ka, int kb, int k) {
   if (IsOdd((ia+k+ib)/2) || !Triangle(ia, k, ib)) return 0.0;
   a = W3j(ja, k, jb, 1, 0, -1);
   if (fabs(a) < EPS30) return 0.0;
+  a = a*a*(ja+1.0)*(jb+1.0);
+  if (IsEven((ja+jb)/2)) a = -a;
+  return a;
+}  
+
+static double GKB(int ka, int kb, int k) {
+  double a, b;
+  
+  a = GKBAngle(ka, kb, k);
+  if (a == 0) return 0.0;
   Slater(&b, ka, kb, kb, ka, k/2, 0);
   
-  b *= a*a*(ja+1.0)*(jb+1.0);
-  if (IsEven((ja+jb)/2)) b = -b;
-  return b;
+  return b*a;
 }  
   
 static double ConfigEnergyVarianceParts0(SHELL *bra, int ia, int ib, 
@@ -4043,8 +4641,8 @@ double ConfigEnergyShiftCI(int nrs0, int nrs1) {
 }
 	  
 double ConfigEnergyShift(int ns, SHELL *bra, int ia, int ib, int m2) {
-  double qa, qb, a, b, c, sd, e;
-  int ja, jb, k, kmin, kmax;
+  double qa, qb, a, b, c, e, *w, *sk;
+  int ja, jb, k, kmin, kmax, m, nf, nk, *ks;
   int k0, k1;
 
   qa = bra[ia].nq;
@@ -4055,34 +4653,65 @@ double ConfigEnergyShift(int ns, SHELL *bra, int ia, int ib, int m2) {
   else {
     e = (qa-1.0)/ja - qb/jb;
     if (e != 0.0) {
+      k0 = OrbitalIndex(bra[ia].n, bra[ia].kappa, 0);
+      k1 = OrbitalIndex(bra[ib].n, bra[ib].kappa, 0);
+      /* the direct and exchange integrals are evaluated in one batch,
+	 w holds the angular coefficient of each */
+      m = ja + jb + 2;
+      ks = malloc(sizeof(int)*m*5);
+      w = malloc(sizeof(double)*m*2);
+      sk = w + m;
+      nk = 0;
       kmin = 4;
       kmax = 2*ja;
       k = 2*jb;
       kmax = Min(kmax, k);
-      a = 0.0;
-      k0 = OrbitalIndex(bra[ia].n, bra[ia].kappa, 0);
-      k1 = OrbitalIndex(bra[ib].n, bra[ib].kappa, 0);
       for (k = kmin; k <= kmax; k += 4) {
 	b = W6j(k, ja, ja, m2, jb, jb);	
 	if (fabs(b) > EPS30) {
-	  a += b*FKB(k0, k1, k);
+	  c = FKBAngle(k0, k1, k);
+	  if (c == 0) continue;
+	  m = 5*nk;
+	  ks[m] = k0;
+	  ks[m+1] = k1;
+	  ks[m+2] = k0;
+	  ks[m+3] = k1;
+	  ks[m+4] = k/2;
+	  w[nk++] = b*c;
 	}
       }
-      
-      if(IsOdd(m2/2)) a=-a;
-      
+      nf = nk;
       kmin = abs(ja-jb);
       kmax = ja + jb;
       c = 1.0/((ja+1.0)*(jb+1.0));
       for (k = kmin; k <= kmax; k += 2) {
+	a = GKBAngle(k0, k1, k);
+	if (a == 0) continue;
 	if (k == m2) {	  
 	  b = 1.0/(m2+1.0)-c;
 	} else {
 	  b = -c;
 	}
-	a += b*GKB(k0, k1, k);
+	m = 5*nk;
+	ks[m] = k0;
+	ks[m+1] = k1;
+	ks[m+2] = k1;
+	ks[m+3] = k0;
+	ks[m+4] = k/2;
+	w[nk++] = b*a;
+      }
+      SlaterBatch(nk, ks, sk, 0);
+      a = 0.0;
+      for (k = 0; k < nf; k++) {
+	a += w[k]*sk[k];
+      }
+      if(IsOdd(m2/2)) a=-a;
+      for (; k < nk; k++) {
+	a += w[k]*sk[k];
       }
       if (IsEven((ja+jb)/2)) a = -a;
+      free(ks);
+      free(w);
       e *= a;
     }
   }
@@ -4560,7 +5189,9 @@ double ZerothHamilton(ORBITAL *orb0, ORBITAL *orb1) {
 double ConfigHamilton(CONFIG *cfg, ORBITAL *orb0, ORBITAL *orb1, double xdf) {
   double t, y, a, nqp, q, kappa;
   int k0, k1, j2, kl, j2p, klp, minn, maxn;
-  int np, kp, kappap, kk, kkmin, kkmax, kk2, j;
+  int np, kp, kappap, kk, kkmin, kkmax, kk2, j, m, nk;
+  int *ks, *kn;
+  double *qk, *sk, *nq;
 
   if (orb0->kappa != orb1->kappa) return 0;
   k0 = orb0->idx;
@@ -4574,10 +5205,17 @@ double ConfigHamilton(CONFIG *cfg, ORBITAL *orb0, ORBITAL *orb1, double xdf) {
     maxn = orb0->n;
     minn = orb1->n;
   }
-  t = 0.0;
-  double te = 0.0;
-  double td = 0.0;
+  /* the exchange integrals of each shell are followed by the direct one,
+     which all share the Yk of (k0, k1), and are evaluated in one batch */
+  m = cfg->n_shells*(j2+2);
+  ks = malloc(sizeof(int)*m*5);
+  qk = malloc(sizeof(double)*m*2);
+  sk = qk + m;
+  kn = malloc(sizeof(int)*cfg->n_shells);
+  nq = malloc(sizeof(double)*cfg->n_shells);
+  nk = 0;
   for (j = 0; j < cfg->n_shells; j++) {
+    kn[j] = 0;
     np = (cfg->shells[j]).n;
     kappap = (cfg->shells[j]).kappa;
     kp = OrbitalIndex(np, kappap, 0);
@@ -4587,17 +5225,24 @@ double ConfigHamilton(CONFIG *cfg, ORBITAL *orb0, ORBITAL *orb1, double xdf) {
       if (np == orb0->n) nqp -= xdf;
       if (np == orb1->n) nqp -= xdf;
     }
+    nq[j] = nqp;
     if (nqp <= 0) continue;
     kkmin = abs(j2 - j2p);
     kkmax = (j2 + j2p);
     if (np > maxn) maxn = np;
     if (np < minn) minn = np;
-    a = 0.0;
     for (kk = kkmin; kk <= kkmax; kk += 2) {
-      y = 0;
       int kk2 = kk/2;
       if (IsEven((kl + klp + kk)/2)) {
-	Slater(&y, k0, kp, kp, k1, kk2, 0);
+	m = 5*nk;
+	ks[m] = k0;
+	ks[m+1] = kp;
+	ks[m+2] = kp;
+	ks[m+3] = k1;
+	ks[m+4] = kk2;
+	q = W3j(j2, kk, j2p, -1, 0, 1);
+	qk[nk++] = q;
+	kn[j]++;
       }
       /*
       if (qed.br < 0 || maxn <= qed.br) {
@@ -4609,16 +5254,39 @@ double ConfigHamilton(CONFIG *cfg, ORBITAL *orb0, ORBITAL *orb1, double xdf) {
 	}
       }
       */
+    }
+    m = 5*nk;
+    ks[m] = k0;
+    ks[m+1] = kp;
+    ks[m+2] = k1;
+    ks[m+3] = kp;
+    ks[m+4] = 0;
+    qk[nk++] = 0.0;
+  }
+  SlaterBatch(nk, ks, sk, 0);
+  t = 0.0;
+  double te = 0.0;
+  double td = 0.0;
+  m = 0;
+  for (j = 0; j < cfg->n_shells; j++) {
+    nqp = nq[j];
+    if (nqp <= 0) continue;
+    a = 0.0;
+    for (kk = 0; kk < kn[j]; kk++, m++) {
+      y = sk[m];
       if (y) {
-	q = W3j(j2, kk, j2p, -1, 0, 1);
+	q = qk[m];
 	a += y*q*q;
       }
     }
     te -= nqp*a;
-    y = 0;
-    Slater(&y, k0, kp, k1, kp, 0, 0);
+    y = sk[m++];
     td += nqp*y;
   }
+  free(ks);
+  free(qk);
+  free(kn);
+  free(nq);
   y = 0;
   ResidualPotential(&y, k0, k1);
   t = td + te + y;
@@ -5747,6 +6415,135 @@ int SlaterTotal(double *sd, double *se, int *j, int *ks, int k, int mode) {
   return 0;
 }
 
+/* add the key (k0, k1, k2, k3, k) to kb, unless it is already there */
+static int AddSlaterKey(int nb, int *kb, int k0, int k1, int k2, int k3,
+			int k) {
+  int i, *p;
+
+  for (i = 0; i < nb; i++) {
+    p = kb + 5*i;
+    if (p[0] == k0 && p[1] == k1 && p[2] == k2 && p[3] == k3 && p[4] == k) {
+      return nb;
+    }
+  }
+  p = kb + 5*nb;
+  p[0] = k0;
+  p[1] = k1;
+  p[2] = k2;
+  p[3] = k3;
+  p[4] = k;
+  return nb+1;
+}
+
+/* the integrals of a set of orbitals are batched together, if the
+   first one is in the cache, the batch has been done */
+static int SlaterCached(int *kb) {
+  int index[5];
+  double *p;
+
+  memcpy(index, kb, sizeof(int)*5);
+  SortSlaterKey(index);
+  p = (double *) MultiGet(slater_array, index, NULL);
+  return p && *p;
+}
+
+/*
+** FUNCTION:    PrepSlaterTotal
+** PURPOSE:     evaluate the slater integrals of SlaterTotal for several
+**              multipoles in one SlaterBatch.
+** INPUT:       {int *j, int *ks, int mode},
+**              same as in SlaterTotal.
+**              {int nk, int *kk},
+**              number of multipoles and the multipoles (2k).
+**              {int *dx},
+**              parts needed for each multipole, 0: none, 1: the direct
+**              part, 2: the direct and exchange parts. NULL for 2.
+** RETURN:      {int},
+**              number of integrals evaluated.
+** SIDE EFFECT: the integrals are added to slater_array, where the
+**              Slater calls of SlaterTotal find them.
+** NOTE:        only the coulomb integrals of Slater are batched, the
+**              Breit and mass shift terms are still evaluated by
+**              SlaterTotal. the integrals that SlaterTotal evaluates
+**              without the cache (mode 2) are left alone.
+*/
+int PrepSlaterTotal(int *j, int *ks, int nk, int *kk, int *dx, int mode) {
+  int i, t, k, tmin, tmax, tt, nb, xe;
+  int kl0, kl1, kl2, kl3, js[4], *kb;
+  ORBITAL *orb0, *orb1, *orb2, *orb3;
+  double *sb;
+
+  if (nk <= 0 || abs(mode) >= 2) return 0;
+  orb0 = GetOrbitalSolved(ks[0]);
+  orb1 = GetOrbitalSolved(ks[1]);
+  orb2 = GetOrbitalSolved(ks[2]);
+  orb3 = GetOrbitalSolved(ks[3]);
+  if (orb0->wfun == NULL || orb1->wfun == NULL ||
+      orb2->wfun == NULL || orb3->wfun == NULL) return 0;
+  if (orb1->n < 0 || orb3->n < 0) return 0;
+  kl0 = GetLFromKappa(orb0->kappa);
+  kl1 = GetLFromKappa(orb1->kappa);
+  kl2 = GetLFromKappa(orb2->kappa);
+  kl3 = GetLFromKappa(orb3->kappa);
+  if (kl1 > slater_cut.kl1 && kl3 > slater_cut.kl1) return 0;
+  if (kl0 > slater_cut.kl1 && kl2 > slater_cut.kl1) return 0;
+  if (qed.br == 0 && IsOdd((kl0+kl1+kl2+kl3)/2)) return 0;
+  xe = 1;
+  if (kl1 > slater_cut.kl0 && kl3 > slater_cut.kl0) xe = 0;
+  if (kl0 > slater_cut.kl0 && kl2 > slater_cut.kl0) xe = 0;
+  /* the exchange of continua depends on the collision options */
+  if (orb0->n == 0 || orb1->n == 0 || orb2->n == 0 || orb3->n == 0) xe = 0;
+  if (ks[0] == ks[1] || ks[2] == ks[3]) xe = 0;
+
+  for (i = 0; i < 4; i++) {
+    js[i] = j? j[i] : 0;
+  }
+  if (js[0] <= 0) js[0] = GetJFromKappa(orb0->kappa);
+  if (js[1] <= 0) js[1] = GetJFromKappa(orb1->kappa);
+  if (js[2] <= 0) js[2] = GetJFromKappa(orb2->kappa);
+  if (js[3] <= 0) js[3] = GetJFromKappa(orb3->kappa);
+  tmin = abs(js[0] - js[3]);
+  tt = abs(js[1] - js[2]);
+  tmin = Max(tt, tmin);
+  tmax = js[0] + js[3];
+  tt = js[1] + js[2];
+  tmax = Min(tt, tmax);
+  tmax = Min(tmax, GetMaxRank());
+  if (IsOdd(tmin)) tmin++;
+  tt = 1;
+  if (xe && tmax >= tmin) tt += 1 + (tmax-tmin)/2;
+
+  kb = malloc(sizeof(int)*5*nk*tt);
+  nb = 0;
+  for (i = 0; i < nk; i++) {
+    if (dx && dx[i] == 0) continue;
+    k = kk[i];
+    if (Triangle(js[0], js[2], k) && Triangle(js[1], js[3], k) &&
+	IsEven((kl0+kl2+k)/2) && IsEven((kl1+kl3+k)/2)) {
+      nb = AddSlaterKey(nb, kb, ks[0], ks[1], ks[2], ks[3], k/2);
+      if (nb == 1 && SlaterCached(kb)) goto DONE;
+    }
+    if (!xe || (dx && dx[i] < 2)) continue;
+    for (t = tmin; t <= tmax; t += 2) {
+      if (IsOdd((kl0+kl3+t)/2) || IsOdd((kl1+kl2+t)/2)) continue;
+      if (fabs(W6j(js[0], js[2], k, js[1], js[3], t)) <= EPS30) continue;
+      nb = AddSlaterKey(nb, kb, ks[0], ks[1], ks[3], ks[2], t/2);
+      if (nb == 1 && SlaterCached(kb)) goto DONE;
+    }
+  }
+  if (nb > 0) {
+    sb = malloc(sizeof(double)*nb);
+    SlaterBatch(nb, kb, sb, mode);
+    free(sb);
+  }
+  free(kb);
+  return nb;
+
+ DONE:
+  free(kb);
+  return 0;
+}
+
 double SelfEnergyRatio(ORBITAL *orb, ORBITAL *horb) {
   int i, k, m, npts;
   double *p, *q, e, z;
@@ -6365,7 +7162,7 @@ int BreitSYK(int k0, int k1, int k, double *z) {
     if (byk != NULL) {
       int size = sizeof(float)*npts;
       byk->yk = malloc(size);
-      AddMultiSize(xbreit_array[4], size);
+      AddMultiElemSize(xbreit_array[4], byk, size);
       for (i = 0; i < npts; i++) {
 	byk->yk[i] = z[i];
       }
@@ -6400,6 +7197,7 @@ double BreitS(int k0, int k1, int k2, int k3, int k) {
       SetLock(lock);
       locked = 1;
     }
+    if (p0 && !(*p0)) LoadStoreDouble(1, index, p0);
     if (p0 && *p0) {
       r = *p0;
       if (locked) ReleaseLock(lock);
@@ -6587,7 +7385,7 @@ int BreitX(ORBITAL *orb0, ORBITAL *orb1, int k, int m, int w, int mbr,
   if (byk) {
     int size = sizeof(float)*npts;
     byk->yk = malloc(size);
-    AddMultiSize(xbreit_array[m], size);
+    AddMultiElemSize(xbreit_array[m], byk, size);
     for (i = 0; i < npts; i++) {
       byk->yk[i] = y[i];
     }
@@ -6965,6 +7763,7 @@ int Slater(double *s, int k0, int k1, int k2, int k3, int k, int mode) {
       SetLock(lock);
       locked = 1;
     }
+    if (p && !(*p)) LoadStoreDouble(0, index, p);
   } else {
     p = NULL;
   }
@@ -7043,6 +7842,150 @@ int Slater(double *s, int k0, int k1, int k2, int k3, int k, int mode) {
   return 0;
 }
 
+typedef struct _SLATER_BATCH_ {
+  int k0, k2, k, i;
+} SLATER_BATCH;
+
+static int CompareSlaterBatch(const void *p0, const void *p1) {
+  const SLATER_BATCH *b0 = (const SLATER_BATCH *) p0;
+  const SLATER_BATCH *b1 = (const SLATER_BATCH *) p1;
+
+  if (b0->k0 != b1->k0) return b0->k0 < b1->k0? -1 : 1;
+  if (b0->k2 != b1->k2) return b0->k2 < b1->k2? -1 : 1;
+  if (b0->k != b1->k) return b0->k < b1->k? -1 : 1;
+  return b0->i - b1->i;
+}
+
+/*
+** FUNCTION:    SlaterBatch
+** PURPOSE:     calculate a list of slater integrals, computing the
+**              Yk of each (k0, k2, k) once for all integrals sharing it.
+** INPUT:       {int n},
+**              number of integrals.
+**              {int *ks},
+**              5*n indices, (k0, k1, k2, k3, k) of each integral, as
+**              the arguments of Slater.
+**              {double *s},
+**              the integrals on output.
+**              {int mode},
+**              same as in Slater.
+** RETURN:      {int},
+**              always 0.
+** SIDE EFFECT: the computed integrals are added to slater_array.
+** NOTE:        the integrals of two bound orbitals against a shared Yk
+**              are evaluated directly with NewtonCotes, which gives the
+**              same result as Integrate without its full grid sweeps.
+*/
+int SlaterBatch(int n, int *ks, double *s, int mode) {
+  int i, j, m, t, ilast, npts, np, nm;
+  int index[5];
+  double **p, *x, *r, norm;
+  ORBITAL *orb0, *orb1, *orb2, *orb3;
+  LOCK **lock;
+  SLATER_BATCH *b;
+  int myrank = MyRankMPI()+1;
+#ifdef PERFORM_STATISTICS
+  clock_t start, stop; 
+  start = clock();
+#endif
+
+  if (n <= 0) return 0;
+  if (abs(mode) >= 2) {
+    for (i = 0; i < n; i++) {
+      Slater(s+i, ks[5*i], ks[5*i+1], ks[5*i+2], ks[5*i+3], ks[5*i+4], mode);
+    }
+    return 0;
+  }
+  p = malloc(sizeof(double *)*n);
+  lock = malloc(sizeof(LOCK *)*n);
+  b = malloc(sizeof(SLATER_BATCH)*n);
+  np = 0;
+  nm = 0;
+  for (i = 0; i < n; i++) {
+    memcpy(index, ks+5*i, sizeof(int)*5);
+    SortSlaterKey(index);
+    lock[i] = NULL;
+    p[i] = (double *) MultiSet(slater_array, index, NULL, &(lock[i]),
+			       InitDoubleData, NULL);
+    s[i] = 0.0;
+    if (p[i]) {
+      np++;
+      if (*p[i]) {
+	s[i] = *p[i];
+	continue;
+      }
+      LoadStoreDouble(0, index, s+i);
+      if (s[i]) continue;
+    }
+    b[nm].k0 = ks[5*i];
+    b[nm].k2 = ks[5*i+2];
+    b[nm].k = ks[5*i+4];
+    b[nm].i = i;
+    nm++;
+  }
+  if (nm > 0) {
+    qsort(b, nm, sizeof(SLATER_BATCH), CompareSlaterBatch);
+    npts = potential->maxrp;
+    x = malloc(sizeof(double)*npts*2);
+    r = x + npts;
+    t = mode >= 0? 1 : 2;
+    for (m = 0; m < nm; m++) {
+      if (m == 0 || b[m].k0 != b[m-1].k0 || b[m].k2 != b[m-1].k2 ||
+	  b[m].k != b[m-1].k) {
+	orb0 = GetOrbitalSolved(b[m].k0);
+	orb2 = GetOrbitalSolved(b[m].k2);
+	GetYk(b[m].k, _yk, orb0, orb2, b[m].k0, b[m].k2, -t);
+	for (i = 0; i < npts; i++) {
+	  _yk[i] /= potential->rad[i];
+	}
+      }
+      j = b[m].i;
+      orb1 = GetOrbitalSolved(ks[5*j+1]);
+      orb3 = GetOrbitalSolved(ks[5*j+3]);
+      if (orb1->n > 0 && orb3->n > 0) {
+	ilast = Min(orb1->ilast, orb3->ilast);
+	if (ilast > 0) {
+	  QuadProduct(0, ilast, x, Large(orb1), Large(orb3),
+		      Small(orb1), Small(orb3), t == 1, _yk,
+		      potential->dr_drho);
+	  r[0] = 0.0;
+	  NewtonCotes(r, x, 0, ilast, t, 0);
+	  s[j] = r[ilast];
+	}
+      } else {
+	Integrate(_yk, orb1, orb3, t, s+j, 0);
+      }
+      if (t == 2) {
+	norm  = GetOrbital(ks[5*j])->qr_norm;
+	norm *= orb1->qr_norm;
+	norm *= GetOrbital(ks[5*j+2])->qr_norm;
+	norm *= orb3->qr_norm;
+	s[j] *= norm;
+      }
+    }
+    free(x);
+  }
+  for (i = 0; i < n; i++) {
+    if (p[i] == NULL || *p[i]) continue;
+    if (lock[i]) SetLock(lock[i]);
+    if (!(*p[i])) *p[i] = s[i];
+    if (lock[i]) ReleaseLock(lock[i]);
+  }
+  if (np > 0) {
+#pragma omp atomic
+    slater_array->iset -= myrank*np;
+  }
+#pragma omp flush
+  free(p);
+  free(lock);
+  free(b);
+#ifdef PERFORM_STATISTICS 
+  stop = clock();
+  rad_timing.radial_2e += stop - start;
+#endif
+  return 0;
+}
+
 /* reorder the orbital index appears in the slater integral, so that it is
    in a form: a <= b <= d, a <= c, and if (a == b), c <= d. */ 
 void SortSlaterKey(int *kd) {
@@ -7299,6 +8242,7 @@ int GetYk(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2,
       SetLock(lock);
       locked = 1;
     }
+    if (syk->npts <= 0) LoadStoreYk(index, syk);
     if (syk->npts > 0) {
       npts = syk->npts-2;
       for (i = npts-1; i < potential->maxrp; i++) {
@@ -7361,7 +8305,7 @@ int GetYk(int k, double *yk, ORBITAL *orb1, ORBITAL *orb2,
     if (syk != NULL) {
       int size = sizeof(float)*(npts+2);
       syk->yk = malloc(size);
-      AddMultiSize(yk_array, size);
+      AddMultiElemSize(yk_array, syk, size);
       for (i = 0; i < npts ; i++) {
 	syk->yk[i] = yk[i];
       }
@@ -7546,11 +8490,9 @@ int IntegrateSubRegion(int i0, int i1,
     small2 = Small(orb2);
     switch (type) {
     case 1: /* type = 1 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * large2[i];
-	x[i] += small1[i] * small2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
+      QuadProduct(i0, i1, x, large1, large2, small1, small2, 1,
+		  f, potential->dr_drho);
+      i = i1+1;
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -7594,10 +8536,9 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 2: /* type = 2 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * large2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
+      QuadProduct(i0, i1, x, large1, large2, NULL, NULL, 0,
+		  f, potential->dr_drho);
+      i = i1+1;
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -7637,10 +8578,9 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 3: /*type = 3 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = small1[i] * small2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
+      QuadProduct(i0, i1, x, small1, small2, NULL, NULL, 0,
+		  f, potential->dr_drho);
+      i = i1+1;
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -7680,11 +8620,9 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 4: /*type = 4 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * small2[i];
-	x[i] += small1[i] * large2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
+      QuadProduct(i0, i1, x, large1, small2, small1, large2, 1,
+		  f, potential->dr_drho);
+      i = i1+1;
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -7728,11 +8666,9 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 5: /* type = 5 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * small2[i];
-	x[i] -= small1[i] * large2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      } 
+      QuadProduct(i0, i1, x, large1, small2, small1, large2, -1,
+		  f, potential->dr_drho);
+      i = i1+1;
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -7776,10 +8712,9 @@ int IntegrateSubRegion(int i0, int i1,
       }
       break;
     case 6: /* type = 6 */
-      for (i = i0; i <= i1; i++) {
-	x[i] = large1[i] * small2[i];
-	x[i] *= f[i]*potential->dr_drho[i];
-      }
+      QuadProduct(i0, i1, x, large1, small2, NULL, NULL, 0,
+		  f, potential->dr_drho);
+      i = i1+1;
       if (i1 == orb1->ilast && orb1->n == 0 && i < potential->maxrp) {
 	if (i <= orb2->ilast) {
 	  ip = i+1;
@@ -8715,6 +9650,7 @@ int ReinitRadial(int m) {
 #pragma omp master
   {
   SetSlaterCut(-1, -1);
+  CloseRadialStore();
   ClearOrbitalTable(m);
   FreeSimpleArray(slater_array);
   FreeBreitArray();
@@ -8939,6 +9875,88 @@ void RemoveOrbitalLock(void) {
   }
 }
 
+/*
+** FUNCTION:    TestQuadrature
+** PURPOSE:     benchmark the scalar and vectorized quadrature kernels.
+** INPUT:       {int n},
+**              number of repetitions.
+** RETURN:      {int},
+**              the kernel level in use.
+** SIDE EFFECT: 
+** NOTE:        for all pairs of the solved bound orbitals, the product
+**              integral, the cumulative integral, and the Yk with
+**              GetYk1 are evaluated with each kernel level. the time
+**              and the largest difference from the scalar results are
+**              printed.
+*/
+int TestQuadrature(int n) {
+  ORBITAL **orb, *orb1;
+  int i, j, m, q, s, t, ns, nb, np, npts;
+  double t0, t1, d, dmax, *r0, *r1, *f;
+  char *name[3] = {"product", "cumulative", "yk"};
+
+  ns = QuadratureSIMD();
+  npts = potential->maxrp;
+  orb = malloc(sizeof(ORBITAL *)*n_orbitals);
+  nb = 0;
+  for (i = 0; i < n_orbitals; i++) {
+    orb1 = GetOrbital(i);
+    if (orb1->n > 0 && orb1->isol) orb[nb++] = orb1;
+  }
+  np = nb*nb;
+  r0 = malloc(sizeof(double)*(np*2+npts));
+  r1 = r0 + np;
+  f = r1 + np;
+  for (i = 0; i < npts; i++) {
+    f[i] = 1.0/potential->rad[i];
+  }
+  if (n <= 0) n = 1;
+  for (t = 0; t < 3; t++) {
+    for (s = 0; s <= ns; s++) {
+      SetQuadratureSIMD(s);
+      t0 = WallTime();
+      for (q = 0; q < n; q++) {
+	m = 0;
+	for (i = 0; i < nb; i++) {
+	  for (j = 0; j < nb; j++) {
+	    switch (t) {
+	    case 0:
+	      Integrate(f, orb[i], orb[j], 1, r1+m, 0);
+	      break;
+	    case 1:
+	      Integrate(f, orb[i], orb[j], -1, _zk, 0);
+	      r1[m] = _zk[npts/2];
+	      break;
+	    default:
+	      GetYk1(1, _yk, orb[i], orb[j], -1);
+	      r1[m] = _yk[npts/2];
+	      break;
+	    }
+	    m++;
+	  }
+	}
+      }
+      t1 = WallTime();
+      dmax = 0.0;
+      if (s == 0) {
+	memcpy(r0, r1, sizeof(double)*np);
+      } else {
+	for (m = 0; m < np; m++) {
+	  d = fabs(r1[m] - r0[m]);
+	  if (r0[m]) d /= fabs(r0[m]);
+	  if (d > dmax) dmax = d;
+	}
+      }
+      printf("quadrature %-10s simd=%d norb=%d n=%d time=%10.3E diff=%10.3E\n",
+	     name[t], s, nb, n*np, t1-t0, dmax);
+    }
+  }
+  SetQuadratureSIMD(ns);
+  free(orb);
+  free(r0);
+  return ns;
+}
+
 int TestIntegrate0(void) {
   ORBITAL *orb1, *orb2, *orb3, *orb4;
   int k1, k2, k3, k4, k, i, i0=1500;
@@ -9764,7 +10782,7 @@ void SetOrbNMax(int kmin, int kmax, int nmax) {
     SetOnErrorOrb(ie);
     return;
   }
-  ResetWidMPI();
+  ResetWidNMPI(2*(kmax-kmin+1));
 #pragma omp parallel default(shared)
   {
     int kappa, k, k2, j;
@@ -9858,6 +10876,15 @@ int SetNMaxKappa(int kappa, int nmax) {
 }
 
 void SetOptionRadial(char *s, char *sp, int ip, double dp) {
+  if (0 == strcmp(s, "radial:simd")) {
+    SetQuadratureSIMD(ip);
+    return;
+  }
+  if (0 == strcmp(s, "radial:store")) {
+    strncpy(_rstore_dir, sp, sizeof(_rstore_dir)-1);
+    CloseRadialStore();
+    return;
+  }
   if (0 == strcmp(s, "radial:refine_maxfun")) {
     _refine_maxfun = ip;
     return;
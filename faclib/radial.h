@@ -47,7 +47,8 @@ typedef struct _orbmap_ {
   ORBITAL **opn;
   ORBITAL **onn;
   int nzn, nmax;
-  ORBITAL **ozn;
+  int mzn;
+  ORBITAL ** volatile ozn;
 } ORBMAP;
 
 double *WLarge(ORBITAL *orb);
@@ -93,6 +94,7 @@ int WaveFuncTable(char *s, int n, int kappa, double e);
 /* get the index of the given orbital in the table */
 //int OrbitalIndexNoLock(int n, int kappa, double energy);
 int OrbitalIndex(int n, int kappa, double energy);
+int OrbitalIndexBatch(int kappa, int ne, double *e, int *ks);
 int OrbitalExistsNoLock(int n, int kappa, double energy);
 int OrbitalExists(int n, int kappa, double energy);
 //int AddOrbital(ORBITAL *orb);
@@ -104,6 +106,7 @@ void AddOrbMap(ORBITAL *orb);
 void RemoveOrbMap(int m);
 ORBITAL *GetNewOrbitalNoLock(int n, int kappa, double e);
 ORBITAL *GetNewOrbital(int n, int kappa, double e);
+void FreeOrbitalData(void *p);
 int GetNumBounds(void);
 int GetNumOrbitals(void);
 int GetNumContinua(void);
@@ -153,12 +156,14 @@ int IntegrateSinCos(int j, double *x, double *y,
 		    double *phase, double *dphase, 
 		    int i0, double *r, int t, double *ext);
 int SlaterTotal(double *sd, double *se, int *js, int *ks, int k, int mode);
+int PrepSlaterTotal(int *j, int *ks, int nk, int *kk, int *dx, int mode);
 double *Vinti(int k0, int k1);
 double QED1E(int k0, int k1);
 double SelfEnergy(ORBITAL *orb1, ORBITAL *orb2);
 double SelfEnergyRatioWelton(ORBITAL *orb, ORBITAL *horb);
 double SelfEnergyRatio(ORBITAL *orb, ORBITAL *horb);
 int Slater(double *s, int k0, int k1, int k2, int k3, int k, int mode);
+int SlaterBatch(int n, int *ks, double *s, int mode);
 int BreitX(ORBITAL *orb0, ORBITAL *orb1, int k, int m, int w, int mbr,
 	   double e, double *y);
 double BreitC(int n, int m, int k, int k0, int k1, int k2, int k3);
@@ -196,6 +201,7 @@ int InitRadial(void);
 int ReinitRadial(int m);
 void SetRadialCleanFlags(void);
 int TestIntegrate(void);
+int TestQuadrature(int n);
 int RestorePotential(char *fn, POTENTIAL *p);
 int SavePotential(char *fn, POTENTIAL *p);
 int ModifyPotential(char *fn, POTENTIAL *p);
@@ -220,6 +226,8 @@ void ElectronDensity(char *ofn, int n, int *ilev, int t);
 void SetOptionRadial(char *s, char *sp, int ip, double dp);
 void SaveRadialMultipole(char *fn, int n, int nk, int *ks, int g);
 void LoadRadialMultipole(char *fn);
+int SaveRadialStore(void);
+unsigned long long PotentialHash(void);
 void PlasmaScreen(int m, int vxf,
 		  double zps, double nps, double tps, double ups,
 		  int nz, double *zw);
@@ -1247,7 +1247,7 @@ double CompleteReducedW7(REDUCED_COEFF *w7_o, REDUCED_COEFF *w7_e,
 }
 
 /* 
-** FUNCTION:    ReducedW
+** FUNCTION:    ReducedWDirect
 ** PURPOSE:     reduced matrix elements of W=AxA only in
 **              the angular space. 
 ** INPUT:       {RCFP_STATE *bra, *ket},
@@ -1263,8 +1263,8 @@ double CompleteReducedW7(REDUCED_COEFF *w7_o, REDUCED_COEFF *w7_e,
 ** NOTE:        if the input is inconsistent, 0.0 is returned,
 **              and warning is issued.
 */
-double ReducedW(RCFP_STATE *bra, RCFP_STATE *ket, 
-		int k_j, int q_m1, int q_m2){
+static double ReducedWDirect(RCFP_STATE *bra, RCFP_STATE *ket, 
+			     int k_j, int q_m1, int q_m2){
   double coeff, w6j1, a1, a2;
   RCFP_STATE run;
   int k_q, run_nu, Jrun, min_run, max_run;
@@ -1368,7 +1368,7 @@ double ReducedW(RCFP_STATE *bra, RCFP_STATE *ket,
 }
 
 /* 
-** FUNCTION:    ReducedWxW0
+** FUNCTION:    ReducedWxW0Direct
 ** PURPOSE:     reduced matrix element of WxW with final rank 0
 ** INPUT:       {RCFP_STATE *bra, *ket},
 **              pointer to the bra and ket states.
@@ -1382,8 +1382,8 @@ double ReducedW(RCFP_STATE *bra, RCFP_STATE *ket,
 ** NOTE:        if the input is inconsistent, 0.0 is returned,
 **              and warning is issued.
 */
-double ReducedWxW0(RCFP_STATE *bra, RCFP_STATE *ket,
-		   int k_j, int q_m1, int q_m2, int q_m3, int q_m4) {
+static double ReducedWxW0Direct(RCFP_STATE *bra, RCFP_STATE *ket, int k_j,
+				int q_m1, int q_m2, int q_m3, int q_m4) {
   int no_run;
   RCFP_STATE run;
   double coeff, coeff1;
@@ -1420,8 +1420,8 @@ double ReducedWxW0(RCFP_STATE *bra, RCFP_STATE *ket,
       run.subshellMQ = run.nq - (jrun +1)/2;
       if (Qrun >= abs(run.subshellMQ)) {
 	if (W6jTriangle(kj2, kj2, 0, Jket, Jbra, Jrun)) {
-	  coeff1 = (ReducedW(bra, &run, k_j, q_m1, q_m2) *
-		    ReducedW(&run, ket, k_j, q_m3, q_m4));
+	  coeff1 = (ReducedWDirect(bra, &run, k_j, q_m1, q_m2) *
+		    ReducedWDirect(&run, ket, k_j, q_m3, q_m4));
 	  if (IsOdd((kj2 - Jbra + Jrun)/2)) coeff1 = -coeff1;
 	  coeff += coeff1;
 	}
@@ -1692,7 +1692,7 @@ double ReducedWxA(RCFP_STATE *bra, RCFP_STATE *ket,
 }
 
 /* 
-** FUNCTION:    ReducedA
+** FUNCTION:    ReducedADirect
 ** PURPOSE:     reduced matrix element of A. 
 **              i.e., the regular coeff. of fractional parentage.
 ** INPUT:       {RCFP_STATE *bra, *ket},
@@ -1706,7 +1706,7 @@ double ReducedWxA(RCFP_STATE *bra, RCFP_STATE *ket,
 ** NOTE:        if the input is inconsistent, 0.0 is returned,
 **              and warning is issued.
 */    
-double ReducedA(RCFP_STATE *bra, RCFP_STATE *ket, int q_m) {
+static double ReducedADirect(RCFP_STATE *bra, RCFP_STATE *ket, int q_m) {
   double coeff;
   int bra_nu, ket_nu;  
   int Jbra, jbra, Jket, jket, Qbra, Qket;
@@ -1754,6 +1754,281 @@ double ReducedA(RCFP_STATE *bra, RCFP_STATE *ket, int q_m) {
   return coeff;
 }
 
+/*
+** VARIABLE:    rcfp_first, rcfp_ready, rcfp_ta, rcfp_tw, rcfp_tw0
+** TYPE:        static arrays.
+** PURPOSE:     dense tables of ReducedA, ReducedW and ReducedWxW0
+**              between the tabulated terms of one subshell j <= 9/2.
+** NOTE:        the tables for a given j are built on the first
+**              request. the terms of j=(2*i+1)/2 are indexed
+**              rcfp_first[i] to rcfp_first[i+1]-1 in terms_jj.
+**              an entry is addressed by the bra and ket terms, the
+**              occupation number of the ket, the rank, and the
+**              quasi-spin projections of the components.
+*/
+#define RCFP_NJ 5
+static int rcfp_first[RCFP_NJ+1] = {0, 2, 5, 11, 25, 63};
+static volatile int rcfp_ready[RCFP_NJ] = {0, 0, 0, 0, 0};
+static double *rcfp_ta[RCFP_NJ];
+static double *rcfp_tw[RCFP_NJ];
+static double *rcfp_tw0[RCFP_NJ];
+
+static void BuildRCFPTable(int ij) {
+  RCFP_STATE bra, ket;
+  int j, ns, nq, nk, ib, ik, q, k, q1, q2, i;
+  double *ta, *tw, *tw0;
+
+#pragma omp critical(rcfp_table)
+  {
+    if (!rcfp_ready[ij]) {
+      j = 2*ij + 1;
+      ns = rcfp_first[ij+1] - rcfp_first[ij];
+      nq = j + 2;
+      nk = j + 1;
+      ta = malloc(sizeof(double)*ns*ns*nq*2);
+      tw = malloc(sizeof(double)*ns*ns*nq*nk*4);
+      tw0 = malloc(sizeof(double)*ns*ns*nq*nk);
+      bra.n = 0;
+      ket.n = 0;
+      for (ib = 0; ib < ns; ib++) {
+	bra.state = rcfp_first[ij] + ib;
+	for (ik = 0; ik < ns; ik++) {
+	  ket.state = rcfp_first[ij] + ik;
+	  for (q = 0; q < nq; q++) {
+	    i = (ib*ns + ik)*nq + q;
+	    ket.nq = q;
+	    ket.subshellMQ = q - (j+1)/2;
+	    for (q1 = 0; q1 < 2; q1++) {
+	      bra.nq = q + 2*q1 - 1;
+	      bra.subshellMQ = bra.nq - (j+1)/2;
+	      ta[i*2 + q1] = ReducedADirect(&bra, &ket, 2*q1-1);
+	    }
+	    for (k = 0; k < nk; k++) {
+	      for (q1 = 0; q1 < 2; q1++) {
+		for (q2 = 0; q2 < 2; q2++) {
+		  bra.nq = q + 2*(q1 + q2) - 2;
+		  bra.subshellMQ = bra.nq - (j+1)/2;
+		  tw[((i*nk) + k)*4 + q1*2 + q2] = 
+		    ReducedWDirect(&bra, &ket, k, 2*q1-1, 2*q2-1);
+		}
+	      }
+	      bra.nq = q;
+	      bra.subshellMQ = q - (j+1)/2;
+	      tw0[i*nk + k] = ReducedWxW0Direct(&bra, &ket, k, 1, -1, 1, -1);
+	    }
+	  }
+	}
+      }
+      rcfp_ta[ij] = ta;
+      rcfp_tw[ij] = tw;
+      rcfp_tw0[ij] = tw0;
+#pragma omp flush
+      rcfp_ready[ij] = 1;
+    }
+  }
+}
+
+/*
+** FUNCTION:    RCFPTableIndex
+** PURPOSE:     locate the bra-ket pair in the dense tables.
+** INPUT:       {RCFP_STATE *bra, *ket},
+**              bra and ket states.
+**              {int dq},
+**              change of the occupation number by the operator.
+**              {int *jp},
+**              on output, 2j of the subshell when the pair is found.
+** RETURN:      {int},
+**              >= 0: index of the pair and ket occupation.
+**              -1:   not in the tables, evaluate directly.
+**              -2:   the matrix element vanishes.
+** SIDE EFFECT: the tables of the subshell are built if needed.
+** NOTE:        
+*/
+static int RCFPTableIndex(RCFP_STATE *bra, RCFP_STATE *ket, int dq,
+			  int *jp) {
+  int j, ij, ns;
+
+  if (bra->state < 0 || bra->state >= 63 ||
+      ket->state < 0 || ket->state >= 63) return -1;
+  j = terms_jj[ket->state].j;
+  if (terms_jj[bra->state].j != j) return -1;
+  if (ket->nq < 0 || ket->nq > j+1) return -1;
+  if (ket->subshellMQ != ket->nq - (j+1)/2 ||
+      bra->subshellMQ != bra->nq - (j+1)/2) return -1;
+  if (bra->nq - ket->nq != dq) return -2;
+  ij = j/2;
+  if (!rcfp_ready[ij]) BuildRCFPTable(ij);
+  ns = rcfp_first[ij+1] - rcfp_first[ij];
+  *jp = j;
+  return ((bra->state - rcfp_first[ij])*ns + 
+	  (ket->state - rcfp_first[ij]))*(j+2) + ket->nq;
+}
+
+/* 
+** FUNCTION:    ReducedA
+** PURPOSE:     reduced matrix element of A. 
+** INPUT:       {RCFP_STATE *bra, *ket},
+**              pointers to the bra and ket states.
+**              {int q_m},
+**              quasi-spin projection of the operator.
+** RETURN:      {double},
+**              result.
+** SIDE EFFECT: 
+** NOTE:        tabulated terms are looked up in the dense tables,
+**              otherwise ReducedADirect is called.
+*/    
+double ReducedA(RCFP_STATE *bra, RCFP_STATE *ket, int q_m) {
+  int i, j;
+
+  i = RCFPTableIndex(bra, ket, q_m, &j);
+  if (i >= 0) return rcfp_ta[j/2][i*2 + (q_m > 0)];
+  if (i == -2) return 0.0;
+  return ReducedADirect(bra, ket, q_m);
+}
+
+/* 
+** FUNCTION:    ReducedW
+** PURPOSE:     reduced matrix elements of W=AxA only in
+**              the angular space. 
+** INPUT:       {RCFP_STATE *bra, *ket},
+**              bra and ket states
+**              {int k_j},
+**              rank of the coupled operator in the angular space.
+**              {int q_m1, q_m2},
+**              the quasi-spin projection of the components.
+** RETURN:      {double}
+**              result
+** SIDE EFFECT: 
+** NOTE:        see ReducedA.
+*/
+double ReducedW(RCFP_STATE *bra, RCFP_STATE *ket, 
+		int k_j, int q_m1, int q_m2) {
+  int i, j;
+
+  i = RCFPTableIndex(bra, ket, q_m1 + q_m2, &j);
+  if (i >= 0) {
+    if (k_j >= 0 && k_j <= j) {
+      return rcfp_tw[j/2][(i*(j+1) + k_j)*4 + (q_m1 > 0)*2 + (q_m2 > 0)];
+    }
+  } else if (i == -2) return 0.0;
+  return ReducedWDirect(bra, ket, k_j, q_m1, q_m2);
+}
+
+/* 
+** FUNCTION:    ReducedWxW0
+** PURPOSE:     reduced matrix element of WxW with final rank 0
+** INPUT:       {RCFP_STATE *bra, *ket},
+**              pointer to the bra and ket states.
+**              {int k_j},
+**              rank of the component W.
+**              {int q_m1, q_m2, q_m3, q_m4},
+**              quasi-spin projection of all components of W.
+** RETURN:      {double},
+**              result.
+** SIDE EFFECT: 
+** NOTE:        only the combination (1, -1, 1, -1) is tabulated.
+*/
+double ReducedWxW0(RCFP_STATE *bra, RCFP_STATE *ket,
+		   int k_j, int q_m1, int q_m2, int q_m3, int q_m4) {
+  int i, j;
+
+  if (q_m1 == 1 && q_m2 == -1 && q_m3 == 1 && q_m4 == -1) {
+    i = RCFPTableIndex(bra, ket, 0, &j);
+    if (i >= 0) {
+      if (k_j >= 0 && k_j <= j) return rcfp_tw0[j/2][i*(j+1) + k_j];
+    } else if (i == -2) return 0.0;
+  }
+  return ReducedWxW0Direct(bra, ket, k_j, q_m1, q_m2, q_m3, q_m4);
+}
+
+/* 
+** FUNCTION:    ReducedWBatch
+** PURPOSE:     ReducedW for a vector of ranks of the same
+**              bra and ket states.
+** INPUT:       {RCFP_STATE *bra, *ket},
+**              bra and ket states
+**              {int n},
+**              number of ranks.
+**              {int *kk},
+**              ranks of the coupled operator, times 2.
+**              {int q_m1, q_m2},
+**              the quasi-spin projection of the components.
+**              {double *r},
+**              results on output.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        the pair is located in the tables only once.
+*/
+void ReducedWBatch(RCFP_STATE *bra, RCFP_STATE *ket, int n, int *kk,
+		   int q_m1, int q_m2, double *r) {
+  int i, m, j, k, q;
+  double *t;
+
+  i = RCFPTableIndex(bra, ket, q_m1 + q_m2, &j);
+  if (i == -1) {
+    for (m = 0; m < n; m++) {
+      r[m] = ReducedWDirect(bra, ket, kk[m]/2, q_m1, q_m2);
+    }
+    return;
+  }
+  if (i == -2) {
+    for (m = 0; m < n; m++) r[m] = 0.0;
+    return;
+  }
+  q = (q_m1 > 0)*2 + (q_m2 > 0);
+  t = rcfp_tw[j/2] + i*(j+1)*4 + q;
+  for (m = 0; m < n; m++) {
+    k = kk[m]/2;
+    if (k >= 0 && k <= j) r[m] = t[k*4];
+    else r[m] = ReducedWDirect(bra, ket, k, q_m1, q_m2);
+  }
+}
+
+/* 
+** FUNCTION:    ReducedWxW0Batch
+** PURPOSE:     ReducedWxW0 for a vector of ranks of the same
+**              bra and ket states.
+** INPUT:       {RCFP_STATE *bra, *ket},
+**              bra and ket states
+**              {int n},
+**              number of ranks.
+**              {int *kk},
+**              ranks of the component W, times 2.
+**              {int q_m1, q_m2, q_m3, q_m4},
+**              quasi-spin projection of all components of W.
+**              {double *r},
+**              results on output.
+** RETURN:      
+** SIDE EFFECT: 
+** NOTE:        
+*/
+void ReducedWxW0Batch(RCFP_STATE *bra, RCFP_STATE *ket, int n, int *kk,
+		      int q_m1, int q_m2, int q_m3, int q_m4, double *r) {
+  int i, m, j, k;
+  double *t;
+
+  i = -1;
+  if (q_m1 == 1 && q_m2 == -1 && q_m3 == 1 && q_m4 == -1) {
+    i = RCFPTableIndex(bra, ket, 0, &j);
+  }
+  if (i == -1) {
+    for (m = 0; m < n; m++) {
+      r[m] = ReducedWxW0Direct(bra, ket, kk[m]/2, q_m1, q_m2, q_m3, q_m4);
+    }
+    return;
+  }
+  if (i == -2) {
+    for (m = 0; m < n; m++) r[m] = 0.0;
+    return;
+  }
+  t = rcfp_tw0[j/2] + i*(j+1);
+  for (m = 0; m < n; m++) {
+    k = kk[m]/2;
+    if (k >= 0 && k <= j) r[m] = t[k];
+    else r[m] = ReducedWxW0Direct(bra, ket, k, q_m1, q_m2, q_m3, q_m4);
+  }
+}
+
 /* 
 ** FUNCTION:    QSpaceDelta
 ** PURPOSE:     determine if the quasi-spin values are consistent.
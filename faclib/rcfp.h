@@ -198,6 +198,10 @@ double ReducedWxA(RCFP_STATE *bra, RCFP_STATE *ket,
 		  int k_j1, int kk_j2, int q_m1,
 		  int q_m2, int q_m3);
 double ReducedA(RCFP_STATE *bra, RCFP_STATE *ket, int q_m);
+void   ReducedWBatch(RCFP_STATE *bra, RCFP_STATE *ket, int n, int *kk,
+		     int q_m1, int q_m2, double *r);
+void   ReducedWxW0Batch(RCFP_STATE *bra, RCFP_STATE *ket, int n, int *kk,
+			int q_m1, int q_m2, int q_m3, int q_m4, double *r);
 int    QSpaceDelta(RCFP_STATE *sub_state);
 int    RCFPTermIndex(int j, int nu, int Nr, int subshellJ);
 double ClebschGordanQuasispin(int ja, int ma, int jb, int mb, 
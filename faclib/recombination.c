@@ -621,7 +621,7 @@ int RRRadialMultipoleTable(double *qr, int k0, int k1, int m) {
   double **p, *qk;
   int kappaf, jf, klf, kf;
   int ite, ie, i;
-  double aw, e, pref;
+  double aw, pref;
   int mode, gauge;
 
   klf = k1;
@@ -667,11 +667,12 @@ int RRRadialMultipoleTable(double *qr, int k0, int k1, int m) {
   qk = pd;
   /* the factor 2 comes from the conitinuum norm */
   pref = sqrt(2.0);  
+  int kfs[MAXNE];
+  OrbitalIndexBatch(kappaf, n_egrid, egrid, kfs);
   for (ite = 0; ite < n_tegrid; ite++) {
     aw = FINE_STRUCTURE_CONST * tegrid[ite];        
     for (ie = 0; ie < n_egrid; ie++) {
-      e = egrid[ie];
-      kf = OrbitalIndex(0, kappaf, e);
+      kf = kfs[ie];
       if (mode == M_NR && m != 1) {
 	qk[ie] = MultipoleRadialNR(m, k0, kf, gauge);
       } else {
@@ -692,7 +693,7 @@ int RRRadialMultipoleTable(double *qr, int k0, int k1, int m) {
 }
     
 int RRRadialQkTable(double *qr, int k0, int k1, int m) {
-  int index[3], k, nqk;
+  int index[3], k, nqk, kfs[MAXNE];
   double **p, *qk, tq[MAXNE];
   double r0, r1, tq0[MAXNE];
   ORBITAL *orb;
@@ -700,7 +701,7 @@ int RRRadialQkTable(double *qr, int k0, int k1, int m) {
   int kappaf, jf, klf, kf;
   int jfmin, jfmax;
   int ite, ie, i;
-  double eb, aw, e, pref;
+  double eb, aw, pref;
   int mode, gauge;
   int nh, klh;
   double hparams[NPARAMS];
@@ -791,9 +792,9 @@ int RRRadialQkTable(double *qr, int k0, int k1, int m) {
 	  continue;
 	}
 	kappaf = GetKappaFromJL(jf, klf);
+	OrbitalIndexBatch(kappaf, n_egrid, egrid, kfs);
 	for (ie = 0; ie < n_egrid; ie++) {
-	  e = egrid[ie];
-	  kf = OrbitalIndex(0, kappaf, e);
+	  kf = kfs[ie];
 	  if (mode == M_NR && m != 1) {
 	    r0 = MultipoleRadialNR(m, k0, kf, gauge);
 	    if (k1 == k0) {
@@ -1670,12 +1671,12 @@ int AutoionizeRate(double *rate, double *e, int rec, int f, int msub) {
 }
 
 int AIRadial1E(double *ai_pk, int kb, int kappaf) {
-  int kf;
+  int kf[MAXNE];
   int i;
 
+  OrbitalIndexBatch(kappaf, n_egrid, egrid, kf);
   for (i = 0; i < n_egrid; i++) {
-    kf = OrbitalIndex(0, kappaf, egrid[i]);
-    ResidualPotential(ai_pk+i, kf, kb);
+    ResidualPotential(ai_pk+i, kf[i], kb);
   }
   return 0;
 }  
@@ -1684,7 +1685,7 @@ int AIRadialPk(double **ai_pk, int k0, int k1, int kb, int kappaf,
 	       int k, int trylock) {
   int i, kf;
   int ks[4];
-  double e, sd, se;
+  double sd, se;
   double **p;
   int index[5];
 
@@ -1719,10 +1720,11 @@ int AIRadialPk(double **ai_pk, int k0, int k1, int kb, int kappaf,
     return 0;
   } 
   double *pd = (double *) malloc(sizeof(double)*n_egrid);
+  int kfs[MAXNE];
   *ai_pk = pd;
+  OrbitalIndexBatch(kappaf, n_egrid, egrid, kfs);
   for (i = 0; i < n_egrid; i++) {
-    e = egrid[i];
-    kf = OrbitalIndex(0, kappaf, e);
+    kf = kfs[i];
     ks[0] = k0;
     ks[1] = kf;
     ks[2] = k1;
@@ -2227,6 +2229,7 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
   int te_set, e_set, usr_set, iuta;
   double c, e0, e1;
 
+  MSetTag(MTAG_OTHER);
   iuta = IsUTA();
 
   if (m != -1 && GetTransitionGauge() != G_BABUSHKIN && qk_mode == QK_FIT) {
@@ -2383,6 +2386,8 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
     rr_hdr.usr_egrid_type = usr_egrid_type;
         
     InitFile(f, &fhdr, &rr_hdr);
+    int *oup = malloc(sizeof(int)*nup);
+    LevelTaskOrder(nup, up, oup);
     ResetWidMPI();
 #pragma omp parallel default(shared) private(r, i, j, lev1, lev2, e, nq, ip, ie, rqu, qc, eb)
     {
@@ -2390,7 +2395,9 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
       r.params = (float *) malloc(sizeof(float)*nqk);
     }
     r.strength = (float *) malloc(sizeof(float)*n_usr);
-    for (i = 0; i < nup; i++) {
+    int io;
+    for (io = 0; io < nup; io++) {
+      i = oup[io];
       lev1 = GetLevel(up[i]);
       for (j = 0; j < nlow; j++) {
 	lev2 = GetLevel(low[j]);
@@ -2425,6 +2432,7 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
     }
     free(r.strength);
     }
+    free(oup);
     
     DeinitFile(f, &fhdr);    
     ReinitRadial(1);
@@ -2434,6 +2442,7 @@ int SaveRecRR(int nlow, int *low, int nup, int *up,
     e0 = e1;
   }
       
+  ReportLoadMPI("SaveRecRR");
   ReinitRecombination(1);
 
   ArrayFreeLock(&subte, NULL);
@@ -2465,6 +2474,7 @@ int SaveAI(int nlow, int *low, int nup, int *up, char *fn,
   int isub, n_egrid0;
   int e_set, iuta;
 
+  MSetTag(MTAG_OTHER);
   iuta = IsUTA();
   if (iuta && msub) {
     printf("cannot call AITableMSub with UTA mode\n");
@@ -2582,9 +2592,13 @@ int SaveAI(int nlow, int *low, int nup, int *up, char *fn,
       ai_hdr1.egrid = egrid;
       InitFile(f, &fhdr, &ai_hdr1);
     }
+    int *olow = malloc(sizeof(int)*nlow);
+    LevelTaskOrder(nlow, low, olow);
 #pragma omp parallel default(shared) private(i, j, lev1, lev2, e, k, s, r, r1, s1, t, rt)
     {
-    for (i = 0; i < nlow; i++) {
+    int io;
+    for (io = 0; io < nlow; io++) {
+      i = olow[io];
       int ilow = low[i];
       lev1 = GetLevel(ilow);
       for (j = 0; j < nup; j++) {
@@ -2643,6 +2657,7 @@ int SaveAI(int nlow, int *low, int nup, int *up, char *fn,
       ProcessAICache(msub, iuta, f);
       }
     */
+    free(olow);
     DeinitFile(f, &fhdr);
     ReinitRadial(1);
     FreeRecQk();
@@ -2651,6 +2666,7 @@ int SaveAI(int nlow, int *low, int nup, int *up, char *fn,
     e0 = e1;
   }
 
+  ReportLoadMPI("SaveAI");
   ReinitRecombination(1);
   //FreeAICache(0);
   ArrayFreeLock(&subte, NULL);
@@ -2977,7 +2993,7 @@ int FreeRecPk(void) {
 }
 
 int FreeRecQk(void) {
-  if (qk_array->array == NULL) return 0;
+  if (qk_array->ndim == 0) return 0;
   MultiFreeData(qk_array, FreeRecPkData);
   return 0;
 }
@@ -56,6 +56,25 @@ static int max_rank = MAXRANK;
 */
 static MULTI *interact_shells;
 
+/*
+** VARIABLE:    formula_cache
+** TYPE:        static MULTI *
+** PURPOSE:     the recoupling formulas generated by RecoupleTensor,
+**              indexed by the coupling scheme and the ordering of
+**              the shells the operators act on.
+** NOTE:        the keys are hashes spread over a wide range, so the
+**              cache is always a hashed MULTI, even when the dense
+**              backend is chosen with USE_NMULTI.
+*/
+static MULTI *formula_cache;
+#if USE_NMULTI == 3
+#define FormulaCacheInit HMultiInit
+#define FormulaCacheSet HMultiSet
+#else
+#define FormulaCacheInit NMultiInit
+#define FormulaCacheSet NMultiSet
+#endif
+
 #ifdef PERFORM_STATISTICS
 static RECOUPLE_TIMING timing = {0, 0, 0, 0};
 /* 
@@ -393,16 +412,6 @@ int AngularZ(double **coeff, int **kk, int nk,
   if (s1->index == s2->index) { /* interacting shells are the same */
     n_interact = 1;
     interact[0] = s1->index;
-    for (m = 0; m < nk; m++) {
-      rank[0] = (*kk)[m];
-      rank[1] = (*kk)[m];
-      (*coeff)[m] = DecoupleShell(n_shells, bra, ket, 
-				  n_interact, interact, rank);
-#if (FAC_DEBUG >= DEBUG_RECOUPLE)
-    fprintf(debug_log, "AngularZ: Decouple %d %lf\n", m, (*coeff)[m]);
-#endif
-     
-    }
     st1 = bra[n_shells - s1->index -1];
     st2 = ket[n_shells - s1->index -1];
     rcfp_bra.state = RCFPTermIndex(s1->j, (st1).nu, 
@@ -414,10 +423,15 @@ int AngularZ(double **coeff, int **kk, int nk,
 				   (st2).Nr, (st2).shellJ);
     rcfp_ket.nq = s1->nq_ket;
     rcfp_ket.subshellMQ = rcfp_ket.nq - (s1->j + 1)/2;
-    for (k = 0; k < nk; k++) {
-      (*coeff)[k] *= ReducedW(&rcfp_bra, &rcfp_ket, (*kk)[k]/2, 1, -1);
+    ReducedWBatch(&rcfp_bra, &rcfp_ket, nk, *kk, 1, -1, *coeff);
+    for (m = 0; m < nk; m++) {
+      if (!(*coeff)[m]) continue;
+      rank[0] = (*kk)[m];
+      rank[1] = (*kk)[m];
+      (*coeff)[m] *= DecoupleShell(n_shells, bra, ket, 
+				   n_interact, interact, rank);
 #if (FAC_DEBUG >= DEBUG_RECOUPLE)
-    fprintf(debug_log, "AngularZ: %d %lf\n", k, (*coeff)[k]);
+    fprintf(debug_log, "AngularZ: %d %lf\n", m, (*coeff)[m]);
 #endif
     }
 
@@ -533,7 +547,7 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
   double *coeff1;
   int *kk1, nk1;
   int i, j;
-  double r, a, b;  
+  double r, a, ra[4];  
   RCFP_STATE rcfp_bra[4], rcfp_ket[4];
 
 #ifdef PERFORM_STATISTICS
@@ -595,12 +609,12 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
   rank[0] = 0;
   
   if (nops[0] == 4) { /* 4 identical interacting shells */
+    ReducedWxW0Batch(rcfp_bra, rcfp_ket, nk1, kk1, 1, -1, 1, -1, coeff1);
+    rank[1] = 0;      
+    a = DecoupleShell(n_shells, bra, ket, 
+		      n_interact, interact, rank); 
     for (m = 0; m < nk1; m++){
-      rank[1] = 0;      
-      a = DecoupleShell(n_shells, bra, ket, 
-			n_interact, interact, rank); 
-      b = ReducedWxW0(rcfp_bra, rcfp_ket, kk1[m]/2, 1, -1, 1, -1);
-      coeff1[m] = a*b;
+      coeff1[m] = a*coeff1[m];
     }
     recouple_operators = 0;
   } else if (nops[0] == 3 && nops[1] == 1) { /* 1 x 3 */
@@ -692,18 +706,25 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	kk1[m++] = k;
       }
     }      
+    ReducedWBatch(rcfp_bra+1, rcfp_ket+1, nk1, kk1,
+		  qm[order[1]], qm[order[2]], coeff1);
+    ra[0] = ReducedA(rcfp_bra, rcfp_ket, qm[order[3]]);
+    ra[1] = ReducedA(rcfp_bra+2, rcfp_ket+2, qm[order[0]]);
     for (m = 0; m < nk1; m++){
+      if (!coeff1[m] || !ra[0] || !ra[1]) {
+	coeff1[m] = 0.0;
+	continue;
+      }
       rank[1] = s[order[3]].j;
       rank[2] = s[order[3]].j;
       rank[3] = kk1[m];
       rank[4] = s[order[0]].j;
       rank[5] = rank[4];
-      coeff1[m] = DecoupleShell(n_shells, bra, ket, 
-				n_interact, interact, rank); 
-      coeff1[m] *= ReducedA(rcfp_bra, rcfp_ket, qm[order[3]]);
-      coeff1[m] *= ReducedW(rcfp_bra+1, rcfp_ket+1, kk1[m]/2,
-			    qm[order[1]], qm[order[2]]);
-      coeff1[m] *= ReducedA(rcfp_bra+2, rcfp_ket+2, qm[order[0]]);
+      r = DecoupleShell(n_shells, bra, ket, 
+			n_interact, interact, rank); 
+      r *= ra[0];
+      coeff1[m] = r*coeff1[m];
+      coeff1[m] *= ra[1];
     }
     recouple_operators = 5;
   } else if (nops[0] == 2 && nops[1] == 2) { /* 2 x 2 */
@@ -728,31 +749,28 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	    order[0], order[1], order[2], order[3], nk1);
 #endif
 
+    ReducedWBatch(rcfp_bra, rcfp_ket, nk1, kk1, 
+		  qm[order[2]], qm[order[3]], coeff1);
     for (m = 0; m < nk1; m++){
-      rank[1] = kk1[m];
-      rank[2] = rank[1];
-      rank[3] = rank[1];
-      coeff1[m] = DecoupleShell(n_shells, bra, ket, 
-				n_interact, interact, rank); 
-
 #if (FAC_DEBUG >= DEBUG_RECOUPLE)
       fprintf(debug_log, "2x2 rank: %d, %lf \n", kk1[m], coeff1[m]);
-#endif
-
-      r = ReducedW(rcfp_bra, rcfp_ket, kk1[m]/2, 
-		   qm[order[2]], qm[order[3]]);
-      coeff1[m] *= r;
-
-#if (FAC_DEBUG >= DEBUG_RECOUPLE)
-      fprintf(debug_log, "2x2 rank: %d, %lf \n", kk1[m], r);
       fprintf(debug_log, "%d %d %d %d %d %d %d %d \n", 
 	      rcfp_bra[0].state, rcfp_bra[0].nq, rcfp_bra[0].subshellMQ,
 	      rcfp_ket[0].state, rcfp_ket[0].nq, rcfp_ket[0].subshellMQ,
 	      qm[order[2]], qm[order[3]]);
 #endif
-
+      if (!coeff1[m]) continue;
       r = ReducedW(rcfp_bra+1, rcfp_ket+1, kk1[m]/2,
 		   qm[order[0]], qm[order[1]]);
+      if (!r) {
+	coeff1[m] = 0.0;
+	continue;
+      }
+      rank[1] = kk1[m];
+      rank[2] = rank[1];
+      rank[3] = rank[1];
+      coeff1[m] *= DecoupleShell(n_shells, bra, ket, 
+				 n_interact, interact, rank); 
       coeff1[m] *= r;
 
 #if (FAC_DEBUG >= DEBUG_RECOUPLE)
@@ -781,18 +799,24 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	kk1[m++] = k;
       }
     }
+    ReducedWBatch(rcfp_bra, rcfp_ket, nk1, kk1,
+		  qm[order[2]], qm[order[3]], coeff1);
+    ra[0] = ReducedA(rcfp_bra+1, rcfp_ket+1, qm[order[1]]);
+    ra[1] = ReducedA(rcfp_bra+2, rcfp_ket+2, qm[order[0]]);
     for (m = 0; m < nk1; m++) {
+      if (!coeff1[m] || !ra[0] || !ra[1]) {
+	coeff1[m] = 0.0;
+	continue;
+      }
       rank[1] = kk1[m];
       rank[2] = kk1[m];
       rank[3] = s[order[1]].j;
       rank[4] = s[order[0]].j;
       rank[5] = rank[4];
-      coeff1[m] = DecoupleShell(n_shells, bra, ket, 
-				n_interact, interact, rank); 
-      coeff1[m] *= ReducedW(rcfp_bra, rcfp_ket, kk1[m]/2,
-			    qm[order[2]], qm[order[3]]);
-      coeff1[m] *= ReducedA(rcfp_bra+1, rcfp_ket+1, qm[order[1]]);
-      coeff1[m] *= ReducedA(rcfp_bra+2, rcfp_ket+2, qm[order[0]]);
+      coeff1[m] *= DecoupleShell(n_shells, bra, ket, 
+				 n_interact, interact, rank); 
+      coeff1[m] *= ra[0];
+      coeff1[m] *= ra[1];
     }
     recouple_operators = 7;
   } else if (nops[0] == 1 && nops[1] == 1 && nops[2] == 2) { /* 2 x 1 x 1 */
@@ -811,41 +835,30 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	kk1[m++] = k;
       }
     }
+    ReducedWBatch(rcfp_bra+2, rcfp_ket+2, nk1, kk1,
+		  qm[order[0]], qm[order[1]], coeff1);
+    ra[0] = ReducedA(rcfp_bra, rcfp_ket, qm[order[3]]);
+    ra[1] = ReducedA(rcfp_bra+1, rcfp_ket+1, qm[order[2]]);
     for (m = 0; m < nk1; m++) {
+      if (!coeff1[m] || !ra[0] || !ra[1]) {
+	coeff1[m] = 0.0;
+	continue;
+      }
       rank[1] = s[order[3]].j;
       rank[2] = s[order[3]].j;
       rank[3] = s[order[2]].j;
       rank[4] = kk1[m];
       rank[5] = rank[4];
-      coeff1[m] = DecoupleShell(n_shells, bra, ket, 
-				n_interact, interact, rank); 
-
-#if (FAC_DEBUG > DEBUG_RECOUPLE)
-      fprintf(debug_log, "2x1x1 rank, %d %lf \n", kk1[m], coeff1[m]);
-#endif
-
-      r = ReducedA(rcfp_bra, rcfp_ket, qm[order[3]]);
-      coeff1[m] *= r;
-
-#if (FAC_DEBUG > DEBUG_RECOUPLE)
-      fprintf(debug_log, "2x1x1 rank, %d %lf \n", kk1[m], r);
-#endif
-
-      r = ReducedA(rcfp_bra+1, rcfp_ket+1, qm[order[2]]);
-      coeff1[m] *= r;
-
-#if (FAC_DEBUG > DEBUG_RECOUPLE)
-      fprintf(debug_log, "2x1x1 rank, %d %lf \n", kk1[m], r);
-#endif
-
-      r = ReducedW(rcfp_bra+2, rcfp_ket+2, kk1[m]/2,
-		   qm[order[0]], qm[order[1]]);
-      coeff1[m] *= r;
+      r = DecoupleShell(n_shells, bra, ket, 
+			n_interact, interact, rank); 
+      r *= ra[0];
+      r *= ra[1];
+      coeff1[m] = r*coeff1[m];
 
 #if (FAC_DEBUG > DEBUG_RECOUPLE)
-      fprintf(debug_log, "2x1x1 rank, %d %lf \n", kk1[m], r);
+      fprintf(debug_log, "2x1x1 rank, %d %lf %lf %lf\n", 
+	      kk1[m], ra[0], ra[1], coeff1[m]);
 #endif
-
     }
     recouple_operators = 8;
   } else { /* 1 x 1 x 1 x 1 */
@@ -866,7 +879,15 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
 	kk1[m++] = k;
       }
     }
+    ra[0] = ReducedA(rcfp_bra, rcfp_ket, qm[order[3]]);
+    ra[1] = ReducedA(rcfp_bra+1, rcfp_ket+1, qm[order[2]]);
+    ra[2] = ReducedA(rcfp_bra+2, rcfp_ket+2, qm[order[1]]);
+    ra[3] = ReducedA(rcfp_bra+3, rcfp_ket+3, qm[order[0]]);
     for (m = 0; m < nk1; m++) {
+      if (!ra[0] || !ra[1] || !ra[2] || !ra[3]) {
+	coeff1[m] = 0.0;
+	continue;
+      }
       rank[1] = s[order[3]].j;
       rank[2] = rank[1];
       rank[3] = s[order[2]].j;
@@ -876,10 +897,10 @@ int AngularZxZ0(double **coeff, int **kk, int nk,
       rank[7] = rank[6];
       coeff1[m] = DecoupleShell(n_shells, bra, ket, 
 				n_interact, interact, rank);
-      coeff1[m] *= ReducedA(rcfp_bra, rcfp_ket, qm[order[3]]);
-      coeff1[m] *= ReducedA(rcfp_bra+1, rcfp_ket+1, qm[order[2]]);
-      coeff1[m] *= ReducedA(rcfp_bra+2, rcfp_ket+2, qm[order[1]]);
-      coeff1[m] *= ReducedA(rcfp_bra+3, rcfp_ket+3, qm[order[0]]);
+      coeff1[m] *= ra[0];
+      coeff1[m] *= ra[1];
+      coeff1[m] *= ra[2];
+      coeff1[m] *= ra[3];
     }
     recouple_operators = 9;
   }
@@ -1822,16 +1843,141 @@ int CoupleSuccessive(int n, int *ik, int itr, TRIADS tr, int *i0) {
   return itr;
 }
 
+static void InitFormulaDatum(void *p, int n) {
+  FORMULA_DATUM *d;
+  int i;
+
+  d = (FORMULA_DATUM *) p;
+  for (i = 0; i < n; i++) {
+    d[i].ns = 0;
+  }
+}
+
+/* 
+** FUNCTION:    FormulaIndex
+** PURPOSE:     the index of a formula in formula_cache.
+** INPUT:       {int ns},
+**              number of operators.
+**              {INTERACT_SHELL *s},
+**              the operators.
+**              {FORMULA *fm},
+**              the formula with tr1 set up.
+**              {int *index},
+**              the 2 indexes on output.
+**              {int *u},
+**              the distinct shell indexes in ascending order 
+**              on output.
+** RETURN:      {int},
+**              0: the formula can be cached.
+**              -1: otherwise.
+** SIDE EFFECT: 
+** NOTE:        the generated formula depends on the triads tr1 
+**              and the ordering of the shell indexes of the 
+**              operators only. the operators are keyed by the rank 
+**              of their shell in u. tr1 is hashed into the index, 
+**              and compared with the saved one when the entry is
+**              retrieved.
+*/
+static int FormulaIndex(int ns, INTERACT_SHELL *s, FORMULA *fm, 
+			int *index, int *u) {
+  unsigned int h;
+  int i, j, k, nu;
+
+  if (ns > MAXFNS) return -1;
+  h = 0;
+  for (i = 1; i < ns; i++) {
+    for (j = 1; j <= 3; j++) {
+      h = 31*h + fm->tr1[i][j];
+    }
+  }
+  index[0] = ns + 16*(h & 0x7FFFFF);
+  nu = 0;
+  for (i = 0; i < ns; i++) {
+    for (j = 0; j < nu; j++) {
+      if (u[j] >= s[i].index) break;
+    }
+    if (j < nu && u[j] == s[i].index) continue;
+    for (k = nu; k > j; k--) u[k] = u[k-1];
+    u[j] = s[i].index;
+    nu++;
+  }
+  index[1] = 0;
+  for (i = 0; i < ns; i++) {
+    for (j = 0; u[j] != s[i].index; j++);
+    index[1] |= j << (4*i);
+  }
+  return 0;
+}
+
+/* 
+** FUNCTION:    RecoupleTensor
+** PURPOSE:     set up the formula recoupling the tensor operators 
+**              acting on the interacting shells.
+** INPUT:       {int ns},
+**              number of operators.
+**              {INTERACT_SHELL *s},
+**              the operators.
+**              {FORMULA *fm},
+**              the formula with tr1 set up by TriadsZ.
+** RETURN:      {int},
+**              number of interacting shells.
+** SIDE EFFECT: the NJGRAF data of the calling thread hold the 
+**              formula on return.
+** NOTE:        the formula only depends on the coupling scheme and
+**              the ordering of the shells the operators act on. it 
+**              is generated once, and later calls restore it from 
+**              formula_cache instead of calling NJFORM again.
+*/
 int RecoupleTensor(int ns, INTERACT_SHELL *s, FORMULA *fm) {
   int ninter, nop;
   int *inter, *interp, *irank, *order;
   int i, j, ij, itr, m;
   int ik[MAXJ], fk[MAXJ];
+  int index[2], u[MAXFNS], locked, myrank;
+  FORMULA_DATUM *fd;
+  LOCK *lock;
 
   order = fm->order;
   inter = fm->inter;
   interp = fm->interp;
   irank = fm->irank;
+
+  fd = NULL;
+  lock = NULL;
+  locked = 0;
+  myrank = MyRankMPI()+1;
+  if (FormulaIndex(ns, s, fm, index, u) == 0) {
+    fd = (FORMULA_DATUM *) FormulaCacheSet(formula_cache, index, NULL, &lock,
+					   InitFormulaDatum, NULL);
+    if (lock && fd->ns == 0) {
+      SetLock(lock);
+      locked = 1;
+    }
+    if (fd->ns > 0) {
+      for (i = 1; i < ns; i++) {
+	for (j = 1; j <= 3; j++) {
+	  if (fd->tr1[i][j] != fm->tr1[i][j]) break;
+	}
+	if (j <= 3) break;
+      }
+      if (i == ns) {
+	fm->ns = ns;
+	fm->ninter = fd->ninter;
+	fm->phase = fd->phase;
+	memcpy(order, fd->order, sizeof(int)*ns);
+	for (j = 0; j < fd->ninter; j++) inter[j] = u[fd->inter[j]];
+	memcpy(interp, fd->interp, sizeof(int)*(fd->ninter+1));
+	memcpy(irank, fd->irank, sizeof(int)*2*fd->ninter);
+	memcpy(fm->tr2, fd->tr2, sizeof(int)*4*ns);
+	CPYDAT(NJGDSIZE, fd->njgdata, 1);
+      }
+      fd = NULL;
+      if (locked) ReleaseLock(lock);
+#pragma omp atomic
+      formula_cache->iset -= myrank;
+      if (i == ns) return fm->ninter;
+    }
+  }
   
   for (i = 0; i < ns; i++) order[i] = i;
   fm->phase = SortShell(ns, s, order);  
@@ -1885,7 +2031,30 @@ int RecoupleTensor(int ns, INTERACT_SHELL *s, FORMULA *fm) {
 
   fm->ns = ns;
   fm->ninter = ninter;
-  if (GenerateFormula(fm) < 0) return -1;
+  if (GenerateFormula(fm) < 0) ninter = -1;
+
+  if (fd) {
+    if (ninter > 0) {
+      fd->ninter = ninter;
+      fd->phase = fm->phase;
+      memcpy(fd->order, order, sizeof(int)*ns);
+      for (i = 0; i < ninter; i++) {
+	for (j = 0; u[j] != inter[i]; j++);
+	fd->inter[i] = j;
+      }
+      memcpy(fd->interp, interp, sizeof(int)*(ninter+1));
+      memcpy(fd->irank, irank, sizeof(int)*2*ninter);
+      memcpy(fd->tr1, fm->tr1, sizeof(int)*4*ns);
+      memcpy(fd->tr2, fm->tr2, sizeof(int)*4*ns);
+      CPYDAT(NJGDSIZE, fd->njgdata, 0);
+#pragma omp flush
+      fd->ns = ns;
+    }
+    if (locked) ReleaseLock(lock);
+#pragma omp atomic
+    formula_cache->iset -= myrank;
+#pragma omp flush
+  }
 
   return ninter;
 }
@@ -2434,7 +2603,12 @@ int InitRecouple(void) {
   int blocks[4] = {10, 10, 64, 64};
   int ndim = 4;
   
+  int fblocks[2] = {8, 8};
+  
   FACTT();
+  formula_cache = (MULTI *) malloc(sizeof(MULTI));
+  FormulaCacheInit(formula_cache, sizeof(FORMULA_DATUM), 2, fblocks,
+		   "formula_cache");
   interact_shells = (MULTI *) malloc(sizeof(MULTI));
   return MultiInit(interact_shells, sizeof(INTERACT_DATUM),
 		   ndim, blocks, "interact_shells");
@@ -134,6 +134,31 @@ typedef struct _FORMULA_ {
   int phase;
 } FORMULA;
 
+/*
+** STRUCT:      FORMULA_DATUM
+** PURPOSE:     a recoupling formula set up by RecoupleTensor, 
+**              saved for the reuse with other quantum numbers.
+** FIELDS:      {int ns, ninter, phase},
+**              the number of operators, the number of interacting 
+**              shells, and the phase from sorting the operators.
+**              {int order, inter, interp, irank},
+**              the same as in FORMULA, except that inter holds
+**              the rank of the shell index among the operators.
+**              {TRIADS tr1, tr2},
+**              the triads of the two coupling schemes.
+**              {int njgdata[NJGDSIZE]},
+**              the summation compiled by NJFORM.
+** NOTE:        ns = 0 marks an entry not yet set up.
+*/
+#define MAXFNS 8
+#define NJGDSIZE 390
+typedef struct _FORMULA_DATUM_ {
+  int ns, ninter, phase;
+  int order[MAXFNS], inter[MAXFNS], interp[MAXFNS+1], irank[2*MAXFNS];
+  int tr1[MAXFNS][4], tr2[MAXFNS][4];
+  int njgdata[NJGDSIZE];
+} FORMULA_DATUM;
+
 #ifdef PERFORM_STATISTICS
 /*
 ** STRUCT:      RECOUPLE_TIMING
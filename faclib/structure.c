@@ -21,6 +21,8 @@
 #include "structure.h"
 #include "cf77.h"
 #include "mpiutil.h"
+#include <fcntl.h>
+#include <sys/mman.h>
 
 static char *rcsid="$Id$";
 #if __GNUC__ == 2
@@ -58,6 +60,39 @@ static int angz_dim, angz_dim2;
 static ANGZ_DATUM *angz_array;
 static ANGZ_DATUM *angzxz_array;
 static ANGZ_DATUM *angmz_array;
+
+/* on-disk store of the state-level angular tables. an entry is keyed
+   by a hash of the table type and of the basis states of the two
+   hamiltonians, and the orbitals are recorded as ShellToInt keys, so
+   that they do not depend on the orbital order of a run. */
+typedef struct _ASTORE_IDX_ {
+  unsigned long long key;
+  int type, ns;
+  long long oz, orec;
+} ASTORE_IDX;
+
+typedef struct _ASTORE_REC_ {
+  double coeff;
+  int k[6];
+} ASTORE_REC;
+
+typedef struct _ASTORE_ {
+  int state;
+  char *map;
+  size_t size;
+  long long ni, nr, nz;
+  ASTORE_IDX *idx;
+  ASTORE_REC *rec;
+  int *nzs;
+} ASTORE;
+
+#define ASTORE_MAGIC "FACASTO1"
+#define ASTORE_HEADER (8+3*sizeof(long long))
+#define ASTORE_ZMIX 0
+#define ASTORE_ZFB 1
+#define ASTORE_ZXZFB 2
+static char _astore_dir[1024] = "";
+static ASTORE _astore = {0, NULL, 0, 0, 0, 0, NULL, NULL, NULL};
 static ANGULAR_FROZEN ang_frozen;
 
 static int ncorrections = 0;
@@ -84,6 +119,12 @@ static double diag_bcut = 5e-2;
 static int diag_nzm = 100;
 static int diag_nbm = 32;
 static double diag_bignore = 0.25;
+static int diag_nev = 0;
+static int diag_dmin = 2000;
+static int diag_dmaxiter = 500;
+static double diag_dtol = 1e-8;
+static int diag_dcdim = 0;
+static int incr_structure = 0;
 static int full_name = 0;
 
 static int sym_pp = -1;
@@ -583,7 +624,7 @@ int ConstructHamiltonEB(int n, int *ilev) {
 
 int ConstructHamilton(int isym, int k0, int k, int *kg,
 		      int kp, int *kgp, int md) {
-  int i, j, j0, t, ti, jp, jd, m1, m2, m3, ip;
+  int i, j, j0, t, ti, jp, jd, m1, m2, m3, ip, *om;
   HAMILTON *h;
   SHAMILTON *hs;
   ARRAY *st;
@@ -692,6 +733,15 @@ int ConstructHamilton(int isym, int k0, int k, int *kg,
     for (j = 0; j < h->hsize; j++) {
       h->hamilton[j] = 0;
     }
+    /* om maps the basis onto the old block of an incremental run */
+    om = NULL;
+    if (k0 > 0 && h->oham != NULL && h->odim > 0 &&
+	h->ohash == PotentialHash()) {
+      om = malloc(sizeof(int)*h->dim);
+      for (i = 0; i < h->dim; i++) {
+	om[i] = IBisect(h->basis[i], h->odim, h->obs);
+      }
+    }
     ResetWidMPI();
 #pragma omp parallel default(shared) private(i,j,t,r)
     {
@@ -735,6 +785,8 @@ int ConstructHamilton(int isym, int k0, int k, int *kg,
 	    }
 	  } else if (perturb_setzero == 2 && i != j && i >= j0 && j >= j0) {
 	    r = 0.0;
+	  } else if (om && om[i] >= 0 && om[j] >= 0) {
+	    r = h->oham[om[i] + (om[j]*(om[j]+1))/2];
 	  } else {
 	    r = HamiltonElement(isym, h->basis[i], h->basis[j]);
 	  }
@@ -786,6 +838,7 @@ int ConstructHamilton(int isym, int k0, int k, int *kg,
 	*/
       }
     }
+    if (om) free(om);
 #if USE_MPI == 1
     if (NProcMPI() > 1) {
       MPI_Allreduce(MPI_IN_PLACE, h->hamilton, h->hsize, MPI_DOUBLE,
@@ -901,6 +954,7 @@ int ReadHamilton(char *fn, int *ng0, int *ng, int **kg,
 
 int WriteHamilton(char *fn, int ng0, int ng, int *kg, int ngp, int *kgp) {
   int s, i, j, t, n;
+  unsigned long long ph;
   FILE *f;
   HAMILTON *h;
 
@@ -962,10 +1016,142 @@ int WriteHamilton(char *fn, int ng0, int ng, int *kg, int ngp, int *kgp) {
       }
     }
   }
+  /* the potential hash, checked by LoadIncrHamilton */
+  s = -1;
+  fwrite(&s, sizeof(int), 1, f);
+  ph = PotentialHash();
+  fwrite(&ph, sizeof(ph), 1, f);
   fclose(f);
   return 0;
 }
 
+/*
+** FUNCTION:    LoadIncrHamilton
+** PURPOSE:     load the hamiltonians saved by a previous Structure
+**              call as the old blocks of an incremental calculation.
+** INPUT:       {char *fn},
+**              the hamilton file written by WriteHamilton.
+**              {int ng, int *kg},
+**              configuration groups of the new calculation.
+** RETURN:      {int},
+**              number of symmetries with a reusable block,
+**              -1 if the file cannot be used.
+** SIDE EFFECT: oham, odim, obs and ohash of the hamiltons are set.
+** NOTE:        the saved groups must all be among kg, and the saved
+**              basis of a symmetry must be exactly the states of
+**              those groups, otherwise the symmetry is computed from
+**              scratch. the file is not used at all if its potential
+**              hash differs from the current one, e.g. after the
+**              potential was optimized again with the added groups,
+**              or the breit or qed options were changed.
+*/
+static int LoadIncrHamilton(char *fn, int ng, int *kg) {
+  int s, i, j, k, n, t, ng0, ng1, ngp, dim, odim, nb, nr, *kg1, *bs;
+  unsigned long long ph;
+  double r, *oham;
+  FILE *f;
+  HAMILTON *h;
+  SYMMETRY *sym;
+  STATE *st;
+
+  f = fopen(fn, "r");
+  if (f == NULL) return -1;
+  /* the trailer written by WriteHamilton holds the potential hash */
+  k = 0;
+  if (fseek(f, -(long) (sizeof(int)+sizeof(ph)), SEEK_END) == 0 &&
+      fread(&t, sizeof(int), 1, f) == 1 && t == -1 &&
+      fread(&ph, sizeof(ph), 1, f) == 1) {
+    k = (ph == PotentialHash());
+  }
+  if (!k) {
+    MPrintf(-1, "incremental hamilton: %s does not match "
+	    "the current potential or qed options\n", fn);
+    fclose(f);
+    return -1;
+  }
+  rewind(f);
+  if (fread(&ng0, sizeof(int), 1, f) != 1 ||
+      fread(&ng1, sizeof(int), 1, f) != 1 || ng1 <= 0) {
+    fclose(f);
+    return -1;
+  }
+  kg1 = malloc(sizeof(int)*ng1);
+  k = 0;
+  if (fread(kg1, sizeof(int), ng1, f) == (size_t) ng1 &&
+      fread(&ngp, sizeof(int), 1, f) == 1 &&
+      ngp == 0 && ng0 == ng1) {
+    for (i = 0; i < ng1; i++) {
+      for (j = 0; j < ng; j++) {
+	if (kg1[i] == kg[j]) break;
+      }
+      if (j == ng) break;
+    }
+    if (i == ng1) k = 1;
+  }
+  if (!k) {
+    free(kg1);
+    fclose(f);
+    return -1;
+  }
+  nr = 0;
+  for (s = 0; s < MAX_SYMMETRIES; s++) {
+    if (fread(&k, sizeof(int), 1, f) != 1) break;
+    if (fread(&dim, sizeof(int), 1, f) != 1) break;
+    if (dim <= 0) continue;
+    if (fread(&odim, sizeof(int), 1, f) != 1 ||
+	fread(&nb, sizeof(int), 1, f) != 1 || nb < dim) break;
+    bs = malloc(sizeof(int)*nb);
+    if (fread(bs, sizeof(int), nb, f) != (size_t) nb ||
+	fread(&n, sizeof(int), 1, f) != 1) {
+      free(bs);
+      break;
+    }
+    h = GetHamilton(s);
+    sym = GetSymmetry(s);
+    k = (nb == dim && sym != NULL);
+    if (k) {
+      j = 0;
+      for (t = 0; t < sym->n_states; t++) {
+	st = (STATE *) ArrayGet(&(sym->states), t);
+	if (InGroups(st->kgroup, ng1, kg1)) {
+	  if (j >= dim || bs[j] != t) break;
+	  j++;
+	}
+      }
+      k = (t == sym->n_states && j == dim);
+    }
+    oham = NULL;
+    if (k) {
+      oham = calloc((dim*(dim+1))/2, sizeof(double));
+    }
+    for (t = 0; t < n; t++) {
+      if (fread(&i, sizeof(int), 1, f) != 1 ||
+	  fread(&j, sizeof(int), 1, f) != 1 ||
+	  fread(&r, sizeof(double), 1, f) != 1) break;
+      if (oham && i >= 0 && i <= j && j < dim) oham[(j*(j+1))/2 + i] = r;
+    }
+    if (t < n) {
+      /* a truncated file, keep the blocks read completely */
+      if (oham) free(oham);
+      free(bs);
+      break;
+    }
+    if (oham) {
+      h->ohsize = (dim*(dim+1))/2;
+      h->oham = oham;
+      h->odim = dim;
+      h->obs = bs;
+      h->ohash = ph;
+      nr++;
+    } else {
+      free(bs);
+    }
+  }
+  free(kg1);
+  fclose(f);
+  return nr;
+}
+
 int ValidBasis(STATE *s, int k, int *kg, int n) {
   return ValidBasisNK(s, k, kg, n, 0, -1, -1);
 }
@@ -1035,8 +1221,105 @@ int ValidBasisNK(STATE *s, int k, int *kg, int n1, int n0, int r1, int r0) {
   }
 }
 
+/* number of electrons that must be moved to turn ci into cj */
+static int ConfigElectronDiff(CONFIG *ci, CONFIG *cj) {
+  int i, j, k, d;
+
+  i = 0;
+  j = 0;
+  d = 0;
+  while (i < ci->n_shells || j < cj->n_shells) {
+    if (i >= ci->n_shells) k = -1;
+    else if (j >= cj->n_shells) k = 1;
+    else k = CompareShell(ci->shells+i, cj->shells+j);
+    if (k > 0) {
+      d += ci->shells[i].nq;
+      i++;
+    } else if (k < 0) {
+      j++;
+    } else {
+      if (ci->shells[i].nq > cj->shells[j].nq) {
+	d += ci->shells[i].nq - cj->shells[j].nq;
+      }
+      i++;
+      j++;
+    }
+  }
+  return d;
+}
+
+/*
+** FUNCTION:    ConfigPairScreen
+** PURPOSE:     find the configuration pairs of a block that interact.
+** INPUT:       {HAMILTON *h},
+**              the hamiltonian with its basis.
+**              {int *ic},
+**              output, index of the configuration of each basis state.
+**              {int *nc},
+**              output, number of distinct configurations.
+** RETURN:      {unsigned char *},
+**              bit table of nc*nc pairs, a bit is set if the two
+**              configurations differ by at most two electrons. NULL
+**              if some basis state has no configuration.
+** SIDE EFFECT: 
+** NOTE:        the Coulomb and Breit interactions are two-body
+**              operators, so all matrix elements between states of
+**              the pairs not set are exactly zero.
+*/
+static unsigned char *ConfigPairScreen(HAMILTON *h, int *ic, int *nc) {
+  SYMMETRY *sym;
+  STATE *s;
+  CONFIG **cfg;
+  RANDIDX *rk;
+  unsigned char *b;
+  int i, j, n, m;
+  size_t k;
+
+  sym = GetSymmetry(h->pj);
+  n = h->n_basis;
+  rk = malloc(sizeof(RANDIDX)*n);
+  for (i = 0; i < n; i++) {
+    s = (STATE *) ArrayGet(&(sym->states), h->basis[i]);
+    if (s->kgroup < 0) {
+      free(rk);
+      return NULL;
+    }
+    rk[i].i = i;
+    rk[i].r = ((double) s->kgroup)*(1L<<31) + s->kcfg;
+  }
+  qsort(rk, n, sizeof(RANDIDX), CompareRandIdx);
+  cfg = malloc(sizeof(CONFIG *)*n);
+  m = -1;
+  for (i = 0; i < n; i++) {
+    if (i == 0 || rk[i].r != rk[i-1].r) {
+      m++;
+      s = (STATE *) ArrayGet(&(sym->states), h->basis[rk[i].i]);
+      cfg[m] = GetConfig(s);
+    }
+    ic[rk[i].i] = m;
+  }
+  m++;
+  k = ((size_t)m*m+7)/8;
+  b = malloc(k);
+  memset(b, 0, k);
+  for (i = 0; i < m; i++) {
+    for (j = 0; j <= i; j++) {
+      if (ConfigElectronDiff(cfg[i], cfg[j]) > 2) continue;
+      k = (size_t)i*m + j;
+      b[k>>3] |= 1<<(k&7);
+      k = (size_t)j*m + i;
+      b[k>>3] |= 1<<(k&7);
+    }
+  }
+  free(rk);
+  free(cfg);
+  *nc = m;
+  return b;
+}
+
 void ConstructHamiltonBand(HAMILTON *h, double (*fhe)(int, int, int)) {
-  int i, j, t;
+  int i, j, t, nc, *ic;
+  unsigned char *sc;
   double r;
   ResetWidMPI();
 #pragma omp parallel default(shared) private(i,j,t,r)
@@ -1056,6 +1339,12 @@ void ConstructHamiltonBand(HAMILTON *h, double (*fhe)(int, int, int)) {
     h->hsp->d[i] = h->work[t];
     h->basis[i] = h->iwork[t+h->n_basis];
   }
+  sc = NULL;
+  ic = NULL;
+  if (fhe == HamiltonElement) {
+    ic = malloc(sizeof(int)*h->n_basis);
+    sc = ConfigPairScreen(h, ic, &nc);
+  }
   ResetWidMPI();
 #pragma omp parallel default(shared) private(i, j, t, r)
   {
@@ -1068,15 +1357,22 @@ void ConstructHamiltonBand(HAMILTON *h, double (*fhe)(int, int, int)) {
       t = 0;
       int nz = 0;
       double mar = 0.0, ar, de;
+      size_t k0 = sc? (size_t)ic[i]*nc : 0;
       for (j = i+1; j < h->n_basis; j++) {
+	if (sc) {
+	  size_t k = k0 + ic[j];
+	  if (!(sc[k>>3] & (1<<(k&7)))) continue;
+	}
 	r = fhe(h->pj, h->basis[i], h->basis[j]);
 	if (1+r == 1) continue;
 	nz++;
 	de = h->hsp->d[j] - h->hsp->d[i];
 	ar = fabs(r);
-	if (ar > mar) mar = ar;
-	if (nz > diag_nzm && mar < diag_zcut*de) break;
-	if (ar < diag_zcut*de) continue;
+	if (diag_mode == 1) {
+	  if (ar > mar) mar = ar;
+	  if (nz > diag_nzm && mar < diag_zcut*de) break;
+	  if (ar < diag_zcut*de) continue;
+	}
 	h->hsp->ir[i][t] = j;
 	h->hsp->r[i][t] = r;
 	if (j-i < diag_nbm || ar > diag_bcut*de) {
@@ -1090,6 +1386,12 @@ void ConstructHamiltonBand(HAMILTON *h, double (*fhe)(int, int, int)) {
       //	printf("hf: %d %d %d %d %d %d %g\n", i, t, h->hsp->ir[i][t-1], h->hsp->nb[i], h->hsp->ir[i][h->hsp->nb[i]], h->hsp->ir[i][h->hsp->nb[i]]-i, h->hsp->d[i]);
     }
   }
+  if (sc) {
+    free(sc);
+  }
+  if (ic) {
+    free(ic);
+  }
 }
 
 int ConstructHamiltonFrozen(int isym, int k, int *kg, int n, int snc,
@@ -2085,6 +2387,23 @@ double Hamilton1E(int n_shells, SHELL_STATE *sbra, SHELL_STATE *sket,
   return r0;
 }
 
+/* batch the slater integrals of the multipoles of Hamilton2E and
+   Hamilton2E2 with a nonzero angular factor, or all of them if the
+   z0 term is present. d is 1 if only the direct part is used. */
+static void PrepSlaterTotal2E(int *js, int *ks, int nk, int *kk,
+			      double *ang, int nk0, int d) {
+  int i, *dx;
+
+  if (nk <= 0) return;
+  dx = malloc(sizeof(int)*nk);
+  for (i = 0; i < nk; i++) {
+    if (fabs(ang[i]) > EPS30) dx[i] = d? 1 : 2;
+    else dx[i] = nk0 > 0;
+  }
+  PrepSlaterTotal(js, ks, nk, kk, dx, 0);
+  free(dx);
+}
+
 double Hamilton2E2(int n_shells, SHELL_STATE *sbra, SHELL_STATE *sket,
 		   INTERACT_SHELL *s0) {
   int nk0, nk, *kk, k, *kk0, i;
@@ -2121,6 +2440,7 @@ double Hamilton2E2(int n_shells, SHELL_STATE *sbra, SHELL_STATE *sket,
     }
   }
   nk = AngularZxZ0(&ang, &kk, 0, n_shells, sbra, sket, s);
+  PrepSlaterTotal2E(js, ks, nk, kk, ang, nk0, 1);
   for (i = 0; i < nk; i++) {
     sd = 0;
     if (fabs(ang[i]) > EPS30 || nk0 > 0) {
@@ -2153,6 +2473,7 @@ double Hamilton2E2(int n_shells, SHELL_STATE *sbra, SHELL_STATE *sket,
       }
     }
     nk = AngularZxZ0(&ang, &kk, 0, n_shells, sbra, sket, s);
+    PrepSlaterTotal2E(js, ks, nk, kk, ang, nk0, 1);
     for (i = 0; i < nk; i++) {
       sd = 0;
       if (fabs(ang[i]) > EPS30 || nk0 > 0) {
@@ -2204,6 +2525,7 @@ double Hamilton2E(int n_shells, SHELL_STATE *sbra, SHELL_STATE *sket,
 
   x = 0.0;
   nk = AngularZxZ0(&ang, &kk, 0, n_shells, sbra, sket, s);
+  PrepSlaterTotal2E(js, ks, nk, kk, ang, nk0, 0);
   for (i = 0; i < nk; i++) {
     sd = 0;
     se = 0;
@@ -2352,6 +2674,249 @@ void GenEigen(HAMILTON *h, char *trans, char *jobz, int n, double *ap,
   }
 }
 
+/*
+** FUNCTION:    DavidsonNev
+** PURPOSE:     number of eigenpairs obtained with the iterative solver.
+** INPUT:       {HAMILTON *h},
+**              the hamiltonian, only h->heff and h->hsp are examined.
+**              {int n, m},
+**              the dimension and the number of basis states.
+** RETURN:      {int},
+**              0 if the full diagonalization is to be used.
+** SIDE EFFECT: 
+** NOTE:        the partial spectrum is only used for blocks without
+**              the perturbative expansion and the effective hamiltonian,
+**              of dimension at least diag_dmin, and at least twice
+**              diag_nev, so that the restarted subspace of DavidsonEigen
+**              has room for the correction vectors.
+*/
+static int DavidsonNev(HAMILTON *h, int n, int m) {
+  if (diag_nev <= 0 || ci_level == -1) return 0;
+  if (n != m || n < diag_dmin || 2*diag_nev > n) return 0;
+  if (h->heff != NULL && h->hsp == NULL) return 0;
+  return diag_nev;
+}
+
+/* y = H x, with H in packed or sparse storage */
+static void HamiltonProduct(HAMILTON *h, int n, double *x, double *y) {
+  int i, j, t;
+  double a, *ap;
+  MATRIX *sp;
+
+  if (h->hsp) {
+    sp = h->hsp;
+    for (i = 0; i < n; i++) {
+      y[i] = sp->d[i]*x[i];
+    }
+    for (i = 0; i < n; i++) {
+      a = 0.0;
+      for (t = 0; t < sp->nr[i]; t++) {
+	j = sp->ir[i][t];
+	a += sp->r[i][t]*x[j];
+	y[j] += sp->r[i][t]*x[i];
+      }
+      y[i] += a;
+    }
+  } else {
+    for (i = 0; i < n; i++) {
+      y[i] = 0.0;
+    }
+    ap = h->hamilton;
+    for (j = 0; j < n; j++) {
+      a = 0.0;
+      for (i = 0; i < j; i++) {
+	a += ap[i]*x[i];
+	y[i] += ap[i]*x[j];
+      }
+      y[j] += a + ap[j]*x[j];
+      ap += j+1;
+    }
+  }
+}
+
+/*
+** FUNCTION:    DavidsonEigen
+** PURPOSE:     lowest eigenpairs of a large symmetric hamiltonian block.
+** INPUT:       {HAMILTON *h},
+**              the hamiltonian in packed or sparse storage.
+**              {int k},
+**              number of eigenpairs.
+** RETURN:      {int},
+**              number of iterations, < 0 on error.
+** SIDE EFFECT: the eigenvalues and eigenvectors are stored in h->mixing
+**              in the same layout as the full diagonalization, and
+**              h->neig is set to k.
+** NOTE:        block Davidson method with the diagonal preconditioner.
+**              the hamiltonian is only applied as a matrix-vector
+**              product, and the subspace is restarted with the current
+**              Ritz vectors when it exceeds max(3k, k+32) vectors.
+**              an eigenpair is converged when the norm of its residual
+**              is below diag_dtol.
+*/
+static int DavidsonEigen(HAMILTON *h, int k) {
+  int n, mmax, m, m0, nn, nc, iter, i, j, q, t, l, info, *idx;
+  double *v, *hv, *g, *ap, *s, *e, *work, *dg, *x, *hx, *rn;
+  double a, c, *y, *z;
+  char jobz[] = "V";
+  char uplo[] = "U";
+
+  n = h->dim;
+  mmax = Max(3*k, k+32);
+  if (mmax > n) mmax = n;
+  v = malloc(sizeof(double)*(size_t)n*mmax);
+  hv = malloc(sizeof(double)*(size_t)n*mmax);
+  x = malloc(sizeof(double)*(size_t)n*k);
+  hx = malloc(sizeof(double)*(size_t)n*k);
+  g = malloc(sizeof(double)*(size_t)mmax*mmax);
+  ap = malloc(sizeof(double)*(size_t)mmax*(mmax+1)/2);
+  s = malloc(sizeof(double)*(size_t)mmax*mmax);
+  e = malloc(sizeof(double)*mmax);
+  work = malloc(sizeof(double)*3*mmax);
+  rn = malloc(sizeof(double)*k);
+  dg = malloc(sizeof(double)*n);
+  idx = malloc(sizeof(int)*n);
+  if (v == NULL || hv == NULL || x == NULL || hx == NULL || g == NULL) {
+    MPrintf(-1, "DavidsonEigen not enough memory: %d %d %d\n",
+	    h->pj, n, k);
+    iter = -1;
+    goto DONE;
+  }
+  for (i = 0; i < n; i++) {
+    if (h->hsp) dg[i] = h->hsp->d[i];
+    else dg[i] = h->hamilton[i*(i+1)/2+i];
+  }
+  ArgSort(n, dg, idx);
+  for (i = 0; i < k; i++) {
+    y = v + (size_t)i*n;
+    for (t = 0; t < n; t++) y[t] = 0.0;
+    y[idx[i]] = 1.0;
+  }
+  m = 0;
+  nn = k;
+  nc = 0;
+  for (iter = 0; iter < diag_dmaxiter; iter++) {
+    m0 = m;
+    q = m;
+    for (j = m; j < m+nn; j++) {
+      y = v + (size_t)j*n;
+      for (t = 0; t < 2; t++) {
+	for (i = 0; i < q; i++) {
+	  z = v + (size_t)i*n;
+	  a = 0.0;
+	  for (l = 0; l < n; l++) a += z[l]*y[l];
+	  for (l = 0; l < n; l++) y[l] -= a*z[l];
+	}
+      }
+      a = 0.0;
+      for (t = 0; t < n; t++) a += y[t]*y[t];
+      a = sqrt(a);
+      if (a < EPS6) continue;
+      a = 1.0/a;
+      z = v + (size_t)q*n;
+      for (t = 0; t < n; t++) z[t] = y[t]*a;
+      q++;
+    }
+    if (q == m) break;
+    m = q;
+    for (j = m0; j < m; j++) {
+      y = hv + (size_t)j*n;
+      HamiltonProduct(h, n, v + (size_t)j*n, y);
+      for (i = 0; i <= j; i++) {
+	z = v + (size_t)i*n;
+	a = 0.0;
+	for (t = 0; t < n; t++) a += z[t]*y[t];
+	g[i*mmax+j] = a;
+	g[j*mmax+i] = a;
+      }
+    }
+    t = 0;
+    for (j = 0; j < m; j++) {
+      for (i = 0; i <= j; i++) {
+	ap[t++] = g[i*mmax+j];
+      }
+    }
+    DSPEV(jobz, uplo, m, ap, e, s, m, work, &info);
+    if (info) {
+      MPrintf(-1, "DSPEV ERROR in DavidsonEigen: %d %d %d\n",
+	      h->pj, iter, info);
+      iter = -1;
+      goto DONE;
+    }
+    nc = 0;
+    for (i = 0; i < k; i++) {
+      y = x + (size_t)i*n;
+      z = hx + (size_t)i*n;
+      for (t = 0; t < n; t++) {
+	y[t] = 0.0;
+	z[t] = 0.0;
+      }
+      for (j = 0; j < m; j++) {
+	c = s[i*m+j];
+	for (t = 0; t < n; t++) {
+	  y[t] += c*v[(size_t)j*n+t];
+	  z[t] += c*hv[(size_t)j*n+t];
+	}
+      }
+      a = 0.0;
+      for (t = 0; t < n; t++) {
+	c = z[t] - e[i]*y[t];
+	a += c*c;
+      }
+      rn[i] = sqrt(a);
+      if (rn[i] < diag_dtol) nc++;
+    }
+    if (nc == k) break;
+    if (m + k - nc > mmax) {
+      memcpy(v, x, sizeof(double)*(size_t)n*k);
+      memcpy(hv, hx, sizeof(double)*(size_t)n*k);
+      for (i = 0; i < k; i++) {
+	for (j = 0; j < k; j++) {
+	  g[i*mmax+j] = i == j? e[i] : 0.0;
+	}
+      }
+      m = k;
+    }
+    nn = 0;
+    for (i = 0; i < k && m+nn < mmax; i++) {
+      if (rn[i] < diag_dtol) continue;
+      y = x + (size_t)i*n;
+      z = hx + (size_t)i*n;
+      q = m + nn;
+      for (t = 0; t < n; t++) {
+	c = e[i] - dg[t];
+	if (fabs(c) < EPS4) c = c < 0? -EPS4 : EPS4;
+	v[(size_t)q*n+t] = (z[t] - e[i]*y[t])/c;
+      }
+      nn++;
+    }
+  }
+  if (nc < k) {
+    MPrintf(-1, "DavidsonEigen not converged: %d %d %d %d\n",
+	    h->pj, n, k, iter);
+  }
+  h->diag_iter = iter;
+  for (i = 0; i < k; i++) {
+    h->mixing[i] = e[i];
+    memcpy(h->mixing + n + (size_t)i*n, x + (size_t)i*n, sizeof(double)*n);
+  }
+  h->neig = k;
+
+ DONE:
+  free(v);
+  free(hv);
+  free(x);
+  free(hx);
+  free(g);
+  free(ap);
+  free(s);
+  free(e);
+  free(work);
+  free(rn);
+  free(dg);
+  free(idx);
+  return iter;
+}
+
 /*
 ** be careful that the h->hamilton or h->heff is overwritten
 ** after the DiagnolizeHamilton call
@@ -2385,6 +2950,7 @@ int DiagnolizeHamilton(HAMILTON *h) {
 
   lwork = h->lwork;
   liwork = h->liwork;
+  h->neig = n;
   if (ci_level == -1) {
     mixing = h->mixing+n;
     for (i = 0; i < n; i++) {
@@ -2398,6 +2964,12 @@ int DiagnolizeHamilton(HAMILTON *h) {
     return 0;
   }
 
+  k = DavidsonNev(h, n, m);
+  if (k > 0) {
+    if (DavidsonEigen(h, k) < 0) goto ERROR;
+    return 0;
+  }
+
   if (h->hsp) {
     w = h->mixing;
     mixing = w+m;
@@ -2626,10 +3198,23 @@ int DiagnolizeHamilton(HAMILTON *h) {
 
   if (h->heff == NULL) {
     if (m <= n) {
-      DSPEV(jobz, uplo, n, ap, w, z, ldz, h->work, &info);
-      if (info) {
-	MPrintf(-1, "DSPEV ERROR: %d %d %d\n", h->pj, h->perturb_iter, info);
-	goto ERROR;
+      /* the work size of DSPEVD is an int, which overflows for
+	 n above about 46000, DSPEV is used instead */
+      if (diag_dcdim > 0 && n >= diag_dcdim && lwork <= 0x7FFFFFFF) {
+	DSPEVD(jobz, uplo, n, ap, w, z, ldz, h->work, (int) lwork,
+	       h->iwork, liwork, &info);
+	if (info) {
+	  MPrintf(-1, "DSPEVD ERROR: %d %d %d\n",
+		  h->pj, h->perturb_iter, info);
+	  goto ERROR;
+	}
+      } else {
+	DSPEV(jobz, uplo, n, ap, w, z, ldz, h->work, &info);
+	if (info) {
+	  MPrintf(-1, "DSPEV ERROR: %d %d %d\n",
+		  h->pj, h->perturb_iter, info);
+	  goto ERROR;
+	}
       }
     } else {
       GenEigen(h, trans, jobz, n, ap, w, wi, z, h->work, lwork, &info);
@@ -2925,9 +3510,32 @@ int DiagnolizeHamilton(HAMILTON *h) {
   return -1;
 }
 
+/*
+** FUNCTION:    AllocLevelMixing
+** PURPOSE:     allocate the mixing, basis and ibasis arrays of a 
+**              level in one block.
+** INPUT:       {LEVEL *lev},
+**              the level.
+**              {int m},
+**              number of basis states kept.
+** RETURN:      
+** SIDE EFFECT: lev->n_basis is set to m.
+** NOTE:        the block is owned by lev->mixing, which is the only
+**              one of the three pointers to be freed.
+*/
+static void AllocLevelMixing(LEVEL *lev, int m) {
+  char *p;
+
+  p = (char *) malloc(m*(sizeof(double)+sizeof(int)+sizeof(short)));
+  lev->mixing = (double *) p;
+  lev->basis = (int *) (p + m*sizeof(double));
+  lev->ibasis = (short *) (p + m*(sizeof(double)+sizeof(int)));
+  lev->n_basis = m;
+}
+
 int AddToLevels(HAMILTON *h, int ng, int *kg) {
-  int i, d, j, k, t, m;
-  LEVEL lev;
+  int i, d, j, k, t, m, nb;
+  LEVEL lev, *lbuf;
   SYMMETRY *sym;
   STATE *s, *s1;
   CONFIG *c;
@@ -2977,20 +3585,18 @@ int AddToLevels(HAMILTON *h, int ng, int *kg) {
       h->mixing == NULL) return -1;
   d = h->dim;
   mix = h->mixing + d;
+  if (h->neig > 0 && h->neig < d) d = h->neig;
 
   if (h->pj < 0) {
     j = n_eblevels;
     for (i = 0; i < d; i++) {
-      k = GetPrincipleBasis(mix, d, NULL);
+      k = GetPrincipleBasis(mix, h->n_basis, NULL);
       lev.energy = h->mixing[i];
       lev.pj = h->pj;
       lev.iham = -1;
       lev.ilev = j;
       lev.pb = h->basis[k];
-      lev.ibasis = (short *) malloc(sizeof(short)*h->n_basis);
-      lev.basis = (int *) malloc(sizeof(int)*h->n_basis);
-      lev.mixing = (double *) malloc(sizeof(double)*h->n_basis);
-      lev.n_basis = h->n_basis;
+      AllocLevelMixing(&lev, h->n_basis);
       for (t = 0; t < h->n_basis; t++) {
 	lev.ibasis[t] = t;
 	lev.basis[t] = h->basis[t];
@@ -3011,6 +3617,10 @@ int AddToLevels(HAMILTON *h, int ng, int *kg) {
 
   int mce = ConfigEnergyMode();
   sym = GetSymmetry(h->pj);
+  /* the levels of the block are collected locally, and appended
+     to the global array under a single lock */
+  lbuf = (LEVEL *) malloc(sizeof(LEVEL)*d);
+  nb = 0;
   for (i = 0; i < d; i++) {
     k = GetPrincipleBasis(mix, h->n_basis, NULL);
     s = (STATE *) ArrayGet(&(sym->states), h->basis[k]);
@@ -3041,10 +3651,11 @@ int AddToLevels(HAMILTON *h, int ng, int *kg) {
     lev.iham = h->iham;
     lev.ilev = i;
     lev.pb = h->basis[k];
-    lev.ibasis = (short *) malloc(sizeof(short)*h->n_basis);
-    lev.basis = (int *) malloc(sizeof(int)*h->n_basis);
-    lev.mixing = (double *) malloc(sizeof(double)*h->n_basis);
     a = fabs(mix_cut * mix[k]);
+    for (t = 0, m = 0; t < h->n_basis; t++) {
+      if (fabs(mix[t]) >= a) m++;
+    }
+    AllocLevelMixing(&lev, m);
     double se = 0.0;
     for (t = 0, m = 0; t < h->n_basis; t++) {
       if (fabs(mix[t]) < a) continue;
@@ -3061,12 +3672,6 @@ int AddToLevels(HAMILTON *h, int ng, int *kg) {
     if (se) {
       lev.energy += se;
     }
-    lev.n_basis = m;
-    if (m < t) {
-      lev.ibasis = (short *) ReallocNew(lev.ibasis, sizeof(short)*m);
-      lev.basis = (int *) ReallocNew(lev.basis, sizeof(int)*m);
-      lev.mixing = (double *) ReallocNew(lev.mixing, sizeof(double)*m);
-    }
     SortMixing(0, m, &lev, sym);
     GetPrincipleBasis(lev.mixing, m, lev.kpb);
 
@@ -3074,16 +3679,21 @@ int AddToLevels(HAMILTON *h, int ng, int *kg) {
       lev.ibase = -(s->kgroup + 1);
       lev.iham = -1;
     }
-    if (levels->lock) {
-      SetLock(levels->lock);
-    }
-    LEVEL *alev = ArrayAppend(levels, &lev, InitLevelData);
-    if (levels->lock) {
-      ReleaseLock(levels->lock);
-    }
+    memcpy(lbuf+nb, &lev, sizeof(LEVEL));
+    nb++;
     mix += h->n_basis;
   }
+  if (levels->lock) {
+    SetLock(levels->lock);
+  }
+  for (t = 0; t < nb; t++) {
+    ArrayAppend(levels, lbuf+t, InitLevelData);
+  }
   n_levels = levels->dim;
+  if (levels->lock) {
+    ReleaseLock(levels->lock);
+  }
+  free(lbuf);
   if (i < d-1) return -2;
 
   return 0;
@@ -3109,10 +3719,14 @@ void CutMixing(int nlev, int *ilev, int n, int *kg, double c) {
       m++;
     }
     if (m < lev->n_basis) {
+      /* the arrays are compacted in place within their block */
+      if (m == 0) {
+	free(lev->mixing);
+	lev->mixing = NULL;
+	lev->basis = NULL;
+	lev->ibasis = NULL;
+      }
       lev->n_basis = m;
-      lev->ibasis = (short *) ReallocNew(lev->ibasis, sizeof(short)*m);
-      lev->basis = (int *) ReallocNew(lev->basis, sizeof(int)*m);
-      lev->mixing = (double *) ReallocNew(lev->mixing, sizeof(double)*m);
       SortMixing(0, m, lev, sym);
       GetPrincipleBasis(lev->mixing, m, lev->kpb);
     }
@@ -3234,6 +3848,23 @@ LEVEL *GetLevel(int k) {
   return (LEVEL *) ArrayGet(levels, k);
 }
 
+/* order of the levels k in a loop over level pairs for the dynamic
+** MPI schedule. the cost of a pair scales with the product of the
+** basis sizes, so a row is ranked by the basis size of its level. */
+void LevelTaskOrder(int n, int *k, int *o) {
+  double *c = NULL;
+  int i;
+
+  if (DynamicMPI()) {
+    c = malloc(sizeof(double)*n);
+    for (i = 0; i < n; i++) {
+      c[i] = 1.0 + GetLevel(k[i])->n_basis;
+    }
+  }
+  TaskOrderMPI(n, c, o);
+  if (c) free(c);
+}
+
 int LevelTotalJ(int k) {
   int i;
   i = GetLevel(k)->pj;
@@ -3506,6 +4137,95 @@ int SetFrozenTargets(int nt, int *kt, int nc, int *kc,
   return nlevs;
 }
 
+#if USE_MPI == 2
+#ifdef __GNUC__
+/* present when a threaded openblas is linked through --with-blaslib */
+extern int openblas_get_num_threads(void) __attribute__((weak));
+extern void openblas_set_num_threads(int n) __attribute__((weak));
+#endif
+
+/* let a threaded BLAS use its threads in the large blocks, and only
+   one in the small blocks, which already run one per thread. a BLAS
+   threaded with OpenMP sees the outer region and stays serial there. */
+static void DiagBlasThreads(int serial) {
+  static int mal = -1, nbt = -1;
+  if (serial) {
+    if (mal < 0) {
+      mal = omp_get_max_active_levels();
+#ifdef __GNUC__
+      if (openblas_get_num_threads && openblas_set_num_threads) {
+	nbt = openblas_get_num_threads();
+      }
+#endif
+    }
+    omp_set_max_active_levels(1);
+#ifdef __GNUC__
+    if (nbt > 0) openblas_set_num_threads(1);
+#endif
+  } else if (mal >= 0) {
+    omp_set_max_active_levels(mal);
+#ifdef __GNUC__
+    if (nbt > 0) openblas_set_num_threads(nbt);
+#endif
+    mal = -1;
+    nbt = -1;
+  }
+}
+
+/* a threaded BLAS is linked, the large blocks are worth running alone */
+static int DiagBlasThreaded(void) {
+#ifdef __GNUC__
+  if (openblas_get_num_threads && openblas_set_num_threads) {
+    return openblas_get_num_threads() > 1;
+  }
+#endif
+  return 0;
+}
+
+/* the large blocks run one at a time, with all threads in the BLAS */
+#define DiagSkip(large) ((large)?0:SkipMPI())
+#else
+#define DiagBlasThreads(serial)
+#define DiagBlasThreaded() 0
+#define DiagSkip(large) SkipMPI()
+#endif
+
+/*
+** FUNCTION:    DiagOrder
+** PURPOSE:     order in which the symmetry blocks are diagonalized.
+** INPUT:       {int ns},
+**              number of symmetries.
+**              {int *k},
+**              output, the symmetry to visit at each step.
+** RETURN:      {int},
+**              number of large blocks at the front of k.
+** SIDE EFFECT: 
+** NOTE:        the largest blocks go first, so that they do not
+**              hold up the end of the parallel loop. with 
+**              structure:diag_dcdim and a threaded BLAS, the blocks
+**              of at least that dimension are large. they are
+**              diagonalized one after the other before the parallel
+**              loop, each with all threads in the BLAS, and the others
+**              one per thread. with the bundled serial BLAS, all blocks
+**              go to the parallel loop.
+*/
+static int DiagOrder(int ns, int *k) {
+  int i, nl;
+  double *d;
+
+  d = malloc(sizeof(double)*ns);
+  for (i = 0; i < ns; i++) {
+    d[i] = -(double)(GetHamilton(i)->dim);
+  }
+  ArgSort(ns, d, k);
+  free(d);
+  nl = 0;
+  if (diag_dcdim > 0 && DiagBlasThreaded()) {
+    while (nl < ns && GetHamilton(k[nl])->dim >= diag_dcdim) nl++;
+  }
+  return nl;
+}
+
 int SolveStructureFrozen(char *fn, int ng, int *kg, int nc, int *kc,
 			 int n0, int n1, int k1) {
   int nk, nn, k, k2, t, j, ka, i, n;
@@ -3603,14 +4323,19 @@ int SolveStructureFrozen(char *fn, int ng, int *kg, int nc, int *kc,
     MPrintf(-1, "construct hamilton: %d %d %g\n", i, h->dim, wt1-wt0);
     fflush(stdout);
   }
+  int io, nl, ph, ord[MAX_SYMMETRIES];
+  nl = DiagOrder(MAX_SYMMETRIES, ord);
+  for (ph = nl > 0?0:1; ph < 2; ph++) {
+  DiagBlasThreads(ph);
   ResetWidMPI();
-#pragma omp parallel default(shared) private(i, h)
+#pragma omp parallel default(shared) private(i, io, h) if(ph)
   {
-  for (i = 0; i < MAX_SYMMETRIES; i++) {
+  for (io = ph?nl:0; io < (ph?MAX_SYMMETRIES:nl); io++) {
+    i = ord[io];
     double wt0 = WallTime();
     h = GetHamilton(i);
     if (h->dim <= 0) continue;
-    int skip = SkipMPI();
+    int skip = DiagSkip(!ph);
     if (skip) continue;
     DiagnolizeHamilton(h);
     AddToLevels(h, 0, kg);
@@ -3619,6 +4344,8 @@ int SolveStructureFrozen(char *fn, int ng, int *kg, int nc, int *kc,
     fflush(stdout);
   }
   }
+  }
+  DiagBlasThreads(0);
   
   SortLevels(nlevels, -1, 0);
   SaveLevels(fn, nlevels, -1);
@@ -3629,6 +4356,8 @@ int SolveStructure(char *fn, char *hfn,
 		   int ng, int *kg, int ngp, int *kgp, int ip) {
   int ng0, nlevels, ns, k, i, md, rh;
   HAMILTON *h;
+
+  MSetTag(MTAG_STRUCTURE);
   if (ip > 10) {
     int n0, n1, k1;
     k1 = ip%100;
@@ -3647,6 +4376,7 @@ int SolveStructure(char *fn, char *hfn,
     ReadHamilton(hfn, &ng0, &ng, &kg, &ngp, &kgp, fn != NULL);
     ip = 0;
     rh = 1;
+    md = 0;
   } else {
     if (ngp < 0) return 0;
     ng0 = ng;
@@ -3671,11 +4401,26 @@ int SolveStructure(char *fn, char *hfn,
   } else {
     double wtb = WallTime();
     if (rh == 0) {
+      if (incr_structure && hfn != NULL && ip == 0 && ngp == 0) {
+	LoadIncrHamilton(hfn, ng, kg);
+      }
       for (i = 0; i < ns; i++) {
 	k = ConstructHamilton(i, ng0, ng, kg, ngp, kgp, md);
 	h = GetHamilton(i);
 	h->orig_dim = h->dim;
 	h->exp_dim = 0;
+	if (h->oham != NULL) {
+	  if (k >= 0) {
+	    MPrintf(-1, "incremental hamilton: %d %d %d\n",
+		    i, h->odim, h->dim);
+	  }
+	  free(h->oham);
+	  free(h->obs);
+	  h->oham = NULL;
+	  h->obs = NULL;
+	  h->odim = 0;
+	  h->ohsize = 0;
+	}
 	if (k < 0) {
 	  h = GetHamilton(i);
 	  AllocHamMem(h, -1, -1);
@@ -3683,28 +4428,35 @@ int SolveStructure(char *fn, char *hfn,
 	}
       }
     }
-    ResetWidMPI();
-#pragma omp parallel default(shared) private(i, h)
-    {
-      for (i = 0; i < ns; i++) {
-	h = GetHamilton(i);
-	if (h->dim <= 0) continue;
-	int skip = SkipMPI();
-	if (skip) continue;
-	if (DiagnolizeHamilton(h) < 0) {
-	  continue;
-	}
-	if (fn != NULL) {
-	  if (ip == 0 || perturb_threshold < 0) {
-	    if (ng0 < ng || ip || ngp > 0) {
-	      AddToLevels(h, ng0, kg);
-	    } else {
-	      AddToLevels(h, 0, kg);
+    int io, nl, ph, ord[MAX_SYMMETRIES];
+    nl = DiagOrder(ns, ord);
+    for (ph = nl > 0?0:1; ph < 2; ph++) {
+      DiagBlasThreads(ph);
+      ResetWidMPI();
+#pragma omp parallel default(shared) private(i, io, h) if(ph)
+      {
+	for (io = ph?nl:0; io < (ph?ns:nl); io++) {
+	  i = ord[io];
+	  h = GetHamilton(i);
+	  if (h->dim <= 0) continue;
+	  int skip = DiagSkip(!ph);
+	  if (skip) continue;
+	  if (DiagnolizeHamilton(h) < 0) {
+	    continue;
+	  }
+	  if (fn != NULL) {
+	    if (ip == 0 || perturb_threshold < 0) {
+	      if (ng0 < ng || ip || ngp > 0) {
+		AddToLevels(h, ng0, kg);
+	      } else {
+		AddToLevels(h, 0, kg);
+	      }
 	    }
 	  }
 	}
       }
     }
+    DiagBlasThreads(0);
     if (ip > 0 && perturb_threshold >= 0) {
       int *isp0, *isp1, *ib, dim, np0, np1, j, t, iter;
       int dim0[MAX_SYMMETRIES];
@@ -3989,26 +4741,151 @@ int SaveEBLevels(char *fn, int m, int n) {
   return 0;
 }
 
-int SaveLevels(char *fn, int m, int n) {
-  STATE *s, *s1, sp;
-  SYMMETRY *sym, *sym1;
+/*
+** FUNCTION:    LevelIonBase
+** PURPOSE:     find the level of the next ion on which a level is
+**              built, and apply its energy correction.
+** INPUT:       {LEVEL *lev},
+**              the level.
+**              {int i},
+**              index of the level.
+**              {STATE *s},
+**              the principal basis state of the level.
+**              {SYMMETRY *sym},
+**              symmetry of the level.
+**              {int ecorr},
+**              whether the level has its own energy correction.
+** RETURN:      
+** SIDE EFFECT: lev->ibase and lev->energy are set.
+** NOTE:        only the levels of the ion already in levels_per_ion
+**              are searched. s->kgroup must be positive.
+*/
+static void LevelIonBase(LEVEL *lev, int i, STATE *s, SYMMETRY *sym,
+			 int ecorr) {
+  STATE *s1;
+  SYMMETRY *sym1;
   CONFIG *cfg, *cfg1;
   SHELL_STATE *csf, *csf1;
-  LEVEL *lev, *lev1;
+  LEVEL *lev1;
+  ECORRECTION *ec;
+  LEVEL_ION *gion;
+  ORBITAL *orb;
+  double md, md1, a;
+  int p, nk, ib, dn, ik, ms, mst, t, q;
+
+  cfg = GetConfig(s);
+  nk = cfg->n_electrons-1;
+  if (nk < 0 ||
+      levels_per_ion[nk].dim == 0 ||
+      cfg->shells[0].nq > 1) {
+    lev->ibase = -1;
+  } else {
+    csf = cfg->csfs + s->kstate;
+    md = 1E30;
+    lev->ibase = -1;
+    dn = cfg->shells[0].n - cfg->shells[1].n;
+    a = 0.0;
+    if (dn < MAXDN) {
+      a = 0.0;
+      for (t = 0; t < lev->n_basis; t++) {
+	s1 = ArrayGet(&(sym->states), lev->basis[t]);
+	cfg1 = GetConfig(s1);
+	if (cfg1->shells[0].n == cfg->shells[0].n &&
+	    cfg1->shells[0].nq == 1) {
+	  a += (lev->mixing[t])*(lev->mixing[t]);
+	}
+      }
+      a = 1.0/a;
+    }
+    for (ib = 0; ib < NPRINCIPLE; ib++) {
+      for (t = 0; t < levels_per_ion[nk].dim; t++) {
+	gion = (LEVEL_ION *) ArrayGet(levels_per_ion+nk, t);
+	for (q = gion->imin; q <= gion->imax; q++) {
+	  lev1 = GetLevel(q);
+	  sym1 = GetSymmetry(lev1->pj);
+	  s1 = ArrayGet(&(sym1->states), lev1->basis[lev1->kpb[ib]]);
+	  cfg1 = GetConfig(s1);
+	  csf1 = cfg1->csfs + s1->kstate;
+	  mst = cfg1->n_shells*sizeof(SHELL_STATE);
+	  ms = cfg1->n_shells*sizeof(SHELL);
+	  if (cfg->n_shells == cfg1->n_shells+1 &&
+	      memcmp(cfg->shells+1, cfg1->shells, ms) == 0 &&
+	      memcmp(csf+1, csf1, mst) == 0) {
+	    if (dn < MAXDN) {
+	      md1 = fabs(fabs(a*lev->mixing[lev->kpb[0]]) -
+			 fabs(lev1->mixing[lev1->kpb[ib]]));
+	      if (md1 < md) {
+		md = md1;
+		lev->ibase = q;
+	      }
+	    } else {
+	      ik = OrbitalIndex(cfg->shells[0].n, cfg->shells[0].kappa, 0.0);
+	      orb = GetOrbital(ik);
+	      a = lev->energy - orb->energy;
+	      for (p = 0; p < ecorrections->dim; p++) {
+		ec = (ECORRECTION *) ArrayGet(ecorrections, p);
+		if (-(q+1) == ec->ilev) {
+		  a += ec->e;
+		  break;
+		}
+	      }
+	      md1 = fabs(lev1->energy - a);
+	      if (md1 < md) {
+		md = md1;
+		lev->ibase = q;
+	      }
+	    }
+	  }
+	}
+      }
+      if (lev->ibase >= 0) {
+	break;
+      }
+    }
+  }
+
+  if (!ecorr && lev->ibase >= 0) {
+    for (p = 0; p < ecorrections->dim; p++) {
+      ec = (ECORRECTION *) ArrayGet(ecorrections, p);
+      if (-(i+1) == ec->ilev) break;
+      if (-(lev->ibase + 1) == ec->ilev && cfg->shells[0].n >= ec->nmin) {
+	lev->energy += ec->e;
+	break;
+      }
+    }
+  }
+}
+
+/* copy a level name into a record field of n chars, truncating it */
+static void CopyLevelName(char *d, char *s, int n) {
+  int m;
+
+  m = strlen(s);
+  if (m >= n) m = n-1;
+  memcpy(d, s, m);
+  d[m] = '\0';
+}
+
+int SaveLevels(char *fn, int m, int n) {
+  STATE *s, sp;
+  SYMMETRY *sym;
+  LEVEL *lev;
   EN_RECORD r;
   EN_HEADER en_hdr;
   F_HEADER fhdr;
   ECORRECTION *ec;
   LEVEL_ION *gion, gion1;
-  ORBITAL *orb;
-  double e0, md, md1, a;
+  double e0;
   char name[LEVEL_NAME_LEN];
   char sname[LEVEL_NAME_LEN];
   char nc[LEVEL_NAME_LEN];
   TFILE *f;
   int i, k, p, j0;
-  int nele, nele0, vnl, ib, dn, ik;
-  int si, ms, mst, t, q, nk, n0;
+  int nele, nele0, vnl;
+  int si, t, q, nk, n0;
+  int *nes, hn[N_ELEMENTS+1];
+  char *ibd;
+  EN_RECORD *rs;
 
 #ifdef PERFORM_STATISTICS
   STRUCT_TIMING structt;
@@ -4043,12 +4920,9 @@ int SaveLevels(char *fn, int m, int n) {
       r.energy = lev->energy;
 
       nele = ConstructLevelName(name, sname, nc, &vnl, &sp);
-      strncpy(r.name, name, LNAME);
-      strncpy(r.sname, sname, LSNAME);
-      strncpy(r.ncomplex, nc, LNCOMPLEX);
-      r.name[LNAME-1] = '\0';
-      r.sname[LSNAME-1] = '\0';
-      r.ncomplex[LNCOMPLEX-1] = '\0';
+      CopyLevelName(r.name, name, LNAME);
+      CopyLevelName(r.sname, sname, LSNAME);
+      CopyLevelName(r.ncomplex, nc, LNCOMPLEX);
       if (r.p == 0) {
 	r.p = vnl;
       } else {
@@ -4105,6 +4979,57 @@ int SaveLevels(char *fn, int m, int n) {
     return 0;
   }
 
+  /* the level names are built in parallel. so are the ion bases,
+  ** unless there are pending energy corrections, or the next ion
+  ** is among the levels being saved, which makes them depend on
+  ** the order of the loop below. */
+  rs = NULL;
+  nes = NULL;
+  ibd = NULL;
+  if (n > 0) {
+    rs = malloc(sizeof(EN_RECORD)*n);
+    nes = malloc(sizeof(int)*n);
+    ibd = malloc(sizeof(char)*n);
+  }
+  for (k = 0; k <= N_ELEMENTS; k++) {
+    hn[k] = 0;
+  }
+#pragma omp parallel default(shared) private(k, i, lev, sym, s, vnl)
+  {
+    char pname[LEVEL_NAME_LEN];
+    char psname[LEVEL_NAME_LEN];
+    char pnc[LEVEL_NAME_LEN];
+#pragma omp for schedule(dynamic, 64)
+    for (k = 0; k < n; k++) {
+      i = m + k;
+      lev = GetLevel(i);
+      sym = GetSymmetry(lev->pj);
+      s = (STATE *) ArrayGet(&(sym->states), lev->pb);
+      ibd[k] = 0;
+      nes[k] = ConstructLevelName(pname, psname, pnc, &vnl, s);
+      CopyLevelName(rs[k].name, pname, LNAME);
+      CopyLevelName(rs[k].sname, psname, LSNAME);
+      CopyLevelName(rs[k].ncomplex, pnc, LNCOMPLEX);
+      rs[k].p = vnl;
+    }
+  }
+  for (k = 0; k < n; k++) {
+    if (nes[k] >= 0 && nes[k] <= N_ELEMENTS) hn[nes[k]] = 1;
+  }
+  if (ncorrections == 0) {
+#pragma omp parallel for schedule(dynamic, 64) private(i, lev, sym, s)
+    for (k = 0; k < n; k++) {
+      i = m + k;
+      lev = GetLevel(i);
+      sym = GetSymmetry(lev->pj);
+      s = (STATE *) ArrayGet(&(sym->states), lev->pb);
+      if (s->kgroup <= 0) continue;
+      if (nes[k] > 0 && nes[k] <= N_ELEMENTS && hn[nes[k]-1]) continue;
+      LevelIonBase(lev, i, s, sym, 0);
+      ibd[k] = 1;
+    }
+  }
+
   for (k = 0; k < n; k++) {
     i = m + k;
     lev = GetLevel(i);
@@ -4133,87 +5058,7 @@ int SaveLevels(char *fn, int m, int n) {
     }
 
     if (s->kgroup > 0) {
-      cfg = GetConfig(s);
-      nk = cfg->n_electrons-1;
-      if (nk < 0 ||
-	  levels_per_ion[nk].dim == 0 ||
-	  cfg->shells[0].nq > 1) {
-	lev->ibase = -1;
-      } else {
-	csf = cfg->csfs + s->kstate;
-	md = 1E30;
-	lev->ibase = -1;
-	dn = cfg->shells[0].n - cfg->shells[1].n;
-	a = 0.0;
-	if (dn < MAXDN) {
-	  a = 0.0;
-	  for (t = 0; t < lev->n_basis; t++) {
-	    s1 = ArrayGet(&(sym->states), lev->basis[t]);
-	    cfg1 = GetConfig(s1);
-	    if (cfg1->shells[0].n == cfg->shells[0].n &&
-		cfg1->shells[0].nq == 1) {
-	      a += (lev->mixing[t])*(lev->mixing[t]);
-	    }
-	  }
-	  a = 1.0/a;
-	}
-	for (ib = 0; ib < NPRINCIPLE; ib++) {
-	  for (t = 0; t < levels_per_ion[nk].dim; t++) {
-	    gion = (LEVEL_ION *) ArrayGet(levels_per_ion+nk, t);
-	    for (q = gion->imin; q <= gion->imax; q++) {
-	      lev1 = GetLevel(q);
-	      sym1 = GetSymmetry(lev1->pj);
-	      s1 = ArrayGet(&(sym1->states), lev1->basis[lev1->kpb[ib]]);
-	      cfg1 = GetConfig(s1);
-	      csf1 = cfg1->csfs + s1->kstate;
-	      mst = cfg1->n_shells*sizeof(SHELL_STATE);
-	      ms = cfg1->n_shells*sizeof(SHELL);
-	      if (cfg->n_shells == cfg1->n_shells+1 &&
-		  memcmp(cfg->shells+1, cfg1->shells, ms) == 0 &&
-		  memcmp(csf+1, csf1, mst) == 0) {
-		if (dn < MAXDN) {
-		  md1 = fabs(fabs(a*lev->mixing[lev->kpb[0]]) -
-			     fabs(lev1->mixing[lev1->kpb[ib]]));
-		  if (md1 < md) {
-		    md = md1;
-		    lev->ibase = q;
-		  }
-		} else {
-		  ik = OrbitalIndex(cfg->shells[0].n, cfg->shells[0].kappa, 0.0);
-		  orb = GetOrbital(ik);
-		  a = lev->energy - orb->energy;
-		  for (p = 0; p < ecorrections->dim; p++) {
-		    ec = (ECORRECTION *) ArrayGet(ecorrections, p);
-		    if (-(q+1) == ec->ilev) {
-		      a += ec->e;
-		      break;
-		    }
-		  }
-		  md1 = fabs(lev1->energy - a);
-		  if (md1 < md) {
-		    md = md1;
-		    lev->ibase = q;
-		  }
-		}
-	      }
-	    }
-	  }
-	  if (lev->ibase >= 0) {
-	    break;
-	  }
-	}
-      }
-
-      if (!ecorr && lev->ibase >= 0) {
-	for (p = 0; p < ecorrections->dim; p++) {
-	  ec = (ECORRECTION *) ArrayGet(ecorrections, p);
-	  if (-(i+1) == ec->ilev) break;
-	  if (-(lev->ibase + 1) == ec->ilev && cfg->shells[0].n >= ec->nmin) {
-	    lev->energy += ec->e;
-	    break;
-	  }
-	}
-      }
+      if (!ibd || !ibd[k]) LevelIonBase(lev, i, s, sym, ecorr);
     } else {
       lev->ibase = -(s->kgroup + 1);
     }
@@ -4225,13 +5070,11 @@ int SaveLevels(char *fn, int m, int n) {
     r.j = j0;
     r.energy = lev->energy;
 
-    nele = ConstructLevelName(name, sname, nc, &vnl, s);
-    strncpy(r.name, name, LNAME);
-    strncpy(r.sname, sname, LSNAME);
-    strncpy(r.ncomplex, nc, LNCOMPLEX);
-    r.name[LNAME-1] = '\0';
-    r.sname[LSNAME-1] = '\0';
-    r.ncomplex[LNCOMPLEX-1] = '\0';
+    nele = nes[k];
+    vnl = rs[k].p;
+    memcpy(r.name, rs[k].name, LNAME);
+    memcpy(r.sname, rs[k].sname, LSNAME);
+    memcpy(r.ncomplex, rs[k].ncomplex, LNCOMPLEX);
     if (r.p == 0) {
       r.p = vnl;
     } else {
@@ -4266,6 +5109,11 @@ int SaveLevels(char *fn, int m, int n) {
 
   DeinitFile(f, &fhdr);
   CloseFile(f, &fhdr);
+  if (rs) {
+    free(rs);
+    free(nes);
+    free(ibd);
+  }
 
   for (i = m; i < levels->dim; i++) {
     lev = GetLevel(i);
@@ -4934,6 +5782,403 @@ void StructureEB(char *fn, int n, int *ilev) {
   SaveEBLevels(fn, k, -1);
 }
 
+static unsigned long long AStoreFNV(unsigned long long h,
+				     void *p, size_t n) {
+  unsigned char *c = (unsigned char *) p;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    h ^= c[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/* hash of the table type and the basis states of the two hamiltonians */
+static unsigned long long AStoreKey(int type, int ih1, int ih2) {
+  unsigned long long h;
+  SHAMILTON *hs;
+  STATE *st;
+  CONFIG *c;
+  int i, m, x[3];
+
+  h = 14695981039346656037ULL;
+  h = AStoreFNV(h, ASTORE_MAGIC, 8);
+  x[0] = type;
+  x[1] = GetMaxRank();
+  h = AStoreFNV(h, x, sizeof(int)*2);
+  for (m = 0; m < 2; m++) {
+    hs = hams + (m? ih2 : ih1);
+    x[0] = hs->pj;
+    x[1] = hs->nbasis;
+    h = AStoreFNV(h, x, sizeof(int)*2);
+    for (i = 0; i < hs->nbasis; i++) {
+      st = hs->basis[i];
+      c = GetConfigFromGroup(st->kgroup, st->kcfg);
+      x[0] = c->n_shells;
+      h = AStoreFNV(h, x, sizeof(int));
+      h = AStoreFNV(h, c->shells, sizeof(SHELL)*c->n_shells);
+      h = AStoreFNV(h, c->csfs + st->kstate,
+		    sizeof(SHELL_STATE)*c->n_shells);
+    }
+  }
+  return h;
+}
+
+static int CompareAStoreIdx(const void *p0, const void *p1) {
+  const ASTORE_IDX *i0 = (const ASTORE_IDX *) p0;
+  const ASTORE_IDX *i1 = (const ASTORE_IDX *) p1;
+
+  if (i0->key < i1->key) return -1;
+  if (i0->key > i1->key) return 1;
+  return i0->type - i1->type;
+}
+
+/* map the angular store, if there is one */
+static void OpenAngZStore(void) {
+  char fn[1100];
+  struct stat st;
+  char *m;
+  long long *c;
+  int fd;
+
+  if (_astore.state) return;
+#pragma omp critical(astore)
+  {
+    if (_astore.state == 0) {
+      sprintf(fn, "%s/angz.fas", _astore_dir);
+      _astore.state = -1;
+      fd = open(fn, O_RDONLY);
+      if (fd >= 0) {
+	m = NULL;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t) ASTORE_HEADER) {
+	  m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	  if (m == MAP_FAILED) m = NULL;
+	}
+	close(fd);
+	if (m) {
+	  c = (long long *) (m + 8);
+	  if (memcmp(m, ASTORE_MAGIC, 8) != 0 ||
+	      st.st_size != (off_t) (ASTORE_HEADER + c[0]*sizeof(ASTORE_IDX)
+				     + c[1]*sizeof(ASTORE_REC)
+				     + c[2]*sizeof(int))) {
+	    MPrintf(-1, "invalid angular store: %s\n", fn);
+	    munmap(m, st.st_size);
+	  } else {
+	    _astore.map = m;
+	    _astore.size = st.st_size;
+	    _astore.ni = c[0];
+	    _astore.nr = c[1];
+	    _astore.nz = c[2];
+	    _astore.idx = (ASTORE_IDX *) (m + ASTORE_HEADER);
+	    _astore.rec = (ASTORE_REC *) (_astore.idx + _astore.ni);
+	    _astore.nzs = (int *) (_astore.rec + _astore.nr);
+	    _astore.state = 1;
+	  }
+	}
+      }
+#pragma omp flush
+    }
+  }
+}
+
+static void CloseAngZStore(void) {
+  if (_astore.state > 0) {
+    munmap(_astore.map, _astore.size);
+    _astore.map = NULL;
+    _astore.size = 0;
+  }
+  _astore.state = 0;
+}
+
+static int AStoreOrbital(int k) {
+  int n, kappa;
+
+  IntToShell(k, &n, &kappa);
+  return OrbitalIndex(n, kappa, 0.0);
+}
+
+/*
+** FUNCTION:    LoadAngZStore
+** PURPOSE:     fill an angular table from the on-disk store.
+** INPUT:       {int type},
+**              ASTORE_ZMIX, ASTORE_ZFB, or ASTORE_ZXZFB.
+**              {ANGZ_DATUM *ad},
+**              the table, locked by the caller.
+**              {int ih1, ih2},
+**              the two hamiltonians.
+** RETURN:      {int},
+**              number of state pairs, 0 if not in the store.
+** SIDE EFFECT: 
+** NOTE:        only the pages of the entry found are touched.
+*/
+static int LoadAngZStore(int type, ANGZ_DATUM *ad, int ih1, int ih2) {
+  ASTORE_IDX q0, *q;
+  ASTORE_REC *r;
+  ANGZ_ARY **a;
+  ANGULAR_ZMIX *zm;
+  ANGULAR_ZFB *zf;
+  ANGULAR_ZxZMIX *zx;
+  int i, p, n, ns, *nzs;
+
+  if (!_astore_dir[0]) return 0;
+  OpenAngZStore();
+  if (_astore.state <= 0) return 0;
+  q0.key = AStoreKey(type, ih1, ih2);
+  q0.type = type;
+  q = bsearch(&q0, _astore.idx, _astore.ni, sizeof(ASTORE_IDX),
+	      CompareAStoreIdx);
+  ns = hams[ih1].nbasis * hams[ih2].nbasis;
+  if (q == NULL || q->ns != ns) return 0;
+  nzs = _astore.nzs + q->oz;
+  r = _astore.rec + q->orec;
+  a = malloc(sizeof(ANGZ_ARY *)*ns);
+  for (i = 0; i < ns; i++) {
+    n = nzs[i];
+    if (n == 0) {
+      a[i] = NULL;
+      continue;
+    }
+    a[i] = malloc(sizeof(ANGZ_ARY));
+    a[i]->nz = n;
+    switch (type) {
+    case ASTORE_ZMIX:
+      zm = malloc(sizeof(ANGULAR_ZMIX)*n);
+      for (p = 0; p < n; p++) {
+	zm[p].coeff = r[p].coeff;
+	zm[p].k = r[p].k[0];
+	zm[p].k0 = AStoreOrbital(r[p].k[1]);
+	zm[p].k1 = AStoreOrbital(r[p].k[2]);
+      }
+      a[i]->az = zm;
+      break;
+    case ASTORE_ZFB:
+      zf = malloc(sizeof(ANGULAR_ZFB)*n);
+      for (p = 0; p < n; p++) {
+	zf[p].coeff = r[p].coeff;
+	zf[p].kb = AStoreOrbital(r[p].k[0]);
+      }
+      a[i]->az = zf;
+      break;
+    default:
+      zx = malloc(sizeof(ANGULAR_ZxZMIX)*n);
+      for (p = 0; p < n; p++) {
+	zx[p].coeff = r[p].coeff;
+	zx[p].k = r[p].k[0];
+	zx[p].k0 = r[p].k[1];
+	zx[p].k1 = AStoreOrbital(r[p].k[2]);
+	zx[p].k2 = AStoreOrbital(r[p].k[3]);
+	zx[p].k3 = AStoreOrbital(r[p].k[4]);
+      }
+      a[i]->az = zx;
+      break;
+    }
+    r += n;
+  }
+  ad->angz = a;
+  ad->type = type;
+  if (type == ASTORE_ZMIX) {
+    ad->nd = hams[ih1].nlevs * hams[ih2].nlevs;
+  }
+  ad->ns = ns;
+  return ns;
+}
+
+typedef struct _ASTORE_COLLECT_ {
+  long long ni, nimax, nr, nrmax, nz, nzmax;
+  ASTORE_IDX *idx;
+  ASTORE_REC *rec;
+  int *nzs;
+} ASTORE_COLLECT;
+
+static void AStoreGrow(ASTORE_COLLECT *c, long long ns, long long nr) {
+  if (c->ni == c->nimax) {
+    c->nimax = c->nimax? 2*c->nimax : 256;
+    c->idx = realloc(c->idx, sizeof(ASTORE_IDX)*c->nimax);
+  }
+  if (c->nz + ns > c->nzmax) {
+    c->nzmax = Max(2*c->nzmax, c->nz+ns);
+    c->nzs = realloc(c->nzs, sizeof(int)*c->nzmax);
+  }
+  if (c->nr + nr > c->nrmax) {
+    c->nrmax = Max(2*c->nrmax, c->nr+nr);
+    c->rec = realloc(c->rec, sizeof(ASTORE_REC)*c->nrmax);
+  }
+}
+
+/* shell key of an orbital index, -1 if it is not bound */
+static int AStoreShell(int k) {
+  ORBITAL *orb;
+
+  orb = GetOrbital(k);
+  if (orb == NULL || orb->n <= 0) return -1;
+  return ShellToInt(orb->n, orb->kappa);
+}
+
+/* append the table ad, returns 0 if it cannot be stored */
+static int AStoreCollect(ASTORE_COLLECT *c, ANGZ_DATUM *ad,
+			 int ih1, int ih2) {
+  ANGZ_ARY **a;
+  ANGULAR_ZMIX *zm;
+  ANGULAR_ZFB *zf;
+  ANGULAR_ZxZMIX *zx;
+  ASTORE_REC *r;
+  ASTORE_IDX *q;
+  long long nr;
+  int i, p, n, t;
+
+  a = ad->angz;
+  nr = 0;
+  for (i = 0; i < ad->ns; i++) {
+    if (a[i]) nr += a[i]->nz;
+  }
+  AStoreGrow(c, ad->ns, nr);
+  q = c->idx + c->ni;
+  q->key = AStoreKey(ad->type, ih1, ih2);
+  q->type = ad->type;
+  q->ns = ad->ns;
+  q->oz = c->nz;
+  q->orec = c->nr;
+  r = c->rec + c->nr;
+  for (i = 0; i < ad->ns; i++) {
+    n = a[i]? a[i]->nz : 0;
+    c->nzs[c->nz+i] = n;
+    for (p = 0; p < n; p++, r++) {
+      memset(r->k, 0, sizeof(int)*6);
+      t = 0;
+      switch (ad->type) {
+      case ASTORE_ZMIX:
+	zm = ((ANGULAR_ZMIX *) a[i]->az) + p;
+	r->coeff = zm->coeff;
+	r->k[0] = zm->k;
+	r->k[1] = AStoreShell(zm->k0);
+	r->k[2] = AStoreShell(zm->k1);
+	t = r->k[1] < 0 || r->k[2] < 0;
+	break;
+      case ASTORE_ZFB:
+	zf = ((ANGULAR_ZFB *) a[i]->az) + p;
+	r->coeff = zf->coeff;
+	r->k[0] = AStoreShell(zf->kb);
+	t = r->k[0] < 0;
+	break;
+      default:
+	zx = ((ANGULAR_ZxZMIX *) a[i]->az) + p;
+	r->coeff = zx->coeff;
+	r->k[0] = zx->k;
+	r->k[1] = zx->k0;
+	r->k[2] = AStoreShell(zx->k1);
+	r->k[3] = AStoreShell(zx->k2);
+	r->k[4] = AStoreShell(zx->k3);
+	t = r->k[2] < 0 || r->k[3] < 0 || r->k[4] < 0;
+	break;
+      }
+      if (t) return 0;
+    }
+  }
+  c->ni++;
+  c->nz += ad->ns;
+  c->nr += nr;
+  return 1;
+}
+
+/*
+** FUNCTION:    SaveAngZStore
+** PURPOSE:     write the state-level angular tables to the on-disk
+**              store.
+** INPUT:       
+** RETURN:      {int},
+**              number of tables in the store, -1 on error.
+** SIDE EFFECT: the tables already in the store are merged in, and
+**              the store is remapped on the next lookup.
+** NOTE:        the store directory is set with
+**              SetOption("structure:angz_store", dir). the tables of
+**              AngularZMixStates, AngularZFreeBoundStates and
+**              AngularZxZFreeBoundStates are looked up there before
+**              being computed. they depend only on the configurations
+**              and couplings, so a store stays valid when only the
+**              potential changes.
+*/
+int SaveAngZStore(void) {
+  ASTORE_COLLECT c;
+  ASTORE_IDX *q;
+  char fn[1100], tfn[1200];
+  long long h[3], m, i;
+  int ih1, ih2, iz, k, n;
+  ANGZ_DATUM *ad;
+  FILE *f;
+
+  if (!_astore_dir[0]) return -1;
+  if (MyRankMPI() != 0) return 0;
+  OpenAngZStore();
+  memset(&c, 0, sizeof(ASTORE_COLLECT));
+  for (ih1 = 0; ih1 < nhams; ih1++) {
+    for (ih2 = 0; ih2 < nhams; ih2++) {
+      iz = ih1*angz_dim + ih2;
+      for (k = 0; k < 2; k++) {
+	ad = k? &(angzxz_array[iz]) : &(angz_array[iz]);
+	if (ad->ns <= 0 || ad->type < 0) continue;
+	AStoreCollect(&c, ad, ih1, ih2);
+      }
+    }
+  }
+  m = c.ni;
+  if (m > 0) {
+    qsort(c.idx, m, sizeof(ASTORE_IDX), CompareAStoreIdx);
+  }
+  if (_astore.state > 0) {
+    for (i = 0; i < _astore.ni; i++) {
+      q = _astore.idx + i;
+      if (m > 0 && bsearch(q, c.idx, m, sizeof(ASTORE_IDX),
+			   CompareAStoreIdx)) continue;
+      for (n = 0, k = 0; k < q->ns; k++) {
+	n += _astore.nzs[q->oz+k];
+      }
+      AStoreGrow(&c, q->ns, n);
+      c.idx[c.ni] = *q;
+      c.idx[c.ni].oz = c.nz;
+      c.idx[c.ni].orec = c.nr;
+      memcpy(c.nzs+c.nz, _astore.nzs+q->oz, sizeof(int)*q->ns);
+      memcpy(c.rec+c.nr, _astore.rec+q->orec, sizeof(ASTORE_REC)*n);
+      c.ni++;
+      c.nz += q->ns;
+      c.nr += n;
+    }
+  }
+  if (c.ni > 0) {
+    qsort(c.idx, c.ni, sizeof(ASTORE_IDX), CompareAStoreIdx);
+  }
+
+  sprintf(fn, "%s/angz.fas", _astore_dir);
+  sprintf(tfn, "%s.%d", fn, (int) getpid());
+  f = fopen(tfn, "w");
+  n = -1;
+  if (f == NULL) {
+    MPrintf(-1, "cannot open angular store: %s\n", tfn);
+  } else {
+    h[0] = c.ni;
+    h[1] = c.nr;
+    h[2] = c.nz;
+    k = fwrite(ASTORE_MAGIC, 1, 8, f) == 8;
+    k = k && fwrite(h, sizeof(long long), 3, f) == 3;
+    k = k && fwrite(c.idx, sizeof(ASTORE_IDX), c.ni, f) == (size_t) c.ni;
+    k = k && fwrite(c.rec, sizeof(ASTORE_REC), c.nr, f) == (size_t) c.nr;
+    k = k && fwrite(c.nzs, sizeof(int), c.nz, f) == (size_t) c.nz;
+    if (fclose(f) != 0) k = 0;
+    if (k && rename(tfn, fn) == 0) {
+      n = c.ni;
+      MPrintf(-1, "angular store: %s %lld %lld\n", fn, c.ni, c.nr);
+    } else {
+      MPrintf(-1, "cannot write angular store: %s\n", fn);
+      unlink(tfn);
+    }
+  }
+  if (c.idx) free(c.idx);
+  if (c.rec) free(c.rec);
+  if (c.nzs) free(c.nzs);
+  CloseAngZStore();
+  return n;
+}
+
 int AngularZMixStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   int kg1, kg2, kc1, kc2;
   int ns, n, p, q, nz, iz, iz1, iz2;
@@ -4989,6 +6234,10 @@ int AngularZMixStates(ANGZ_DATUM **ad, int ih1, int ih2) {
     ReleaseLock(&(*ad)->lock);
     return ns;
   }
+  if (LoadAngZStore(ASTORE_ZMIX, *ad, ih1, ih2) > 0) {
+    ReleaseLock(&(*ad)->lock);
+    return (*ad)->ns;
+  }
   ns1 = hams[ih1].nbasis;
   ns2 = hams[ih2].nbasis;
   ns = ns1*ns2;
@@ -5139,6 +6388,7 @@ int AngularZMixStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   timing.n_angz_states++;
 #endif
 
+  (*ad)->type = ASTORE_ZMIX;
   (*ad)->ns = ns;
   (*ad)->nd = hams[ih1].nlevs * hams[ih2].nlevs;
   ReleaseLock(&(*ad)->lock);
@@ -5215,6 +6465,10 @@ int AngularZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
     ReleaseLock(&(*ad)->lock);
     return ns;
   }
+  if (LoadAngZStore(ASTORE_ZFB, *ad, ih1, ih2) > 0) {
+    ReleaseLock(&(*ad)->lock);
+    return (*ad)->ns;
+  }
   ns1 = hams[ih1].nbasis;
   ns2 = hams[ih2].nbasis;
   ns = ns1 * ns2;
@@ -5309,6 +6563,7 @@ int AngularZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   stop = clock();
   timing.angzfb_states += stop-start;
 #endif
+  (*ad)->type = ASTORE_ZFB;
   (*ad)->ns = ns;
   ReleaseLock(&(*ad)->lock);
   return (*ad)->ns;
@@ -5371,6 +6626,10 @@ int AngularZxZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
     ReleaseLock(&(*ad)->lock);
     return ns;
   }
+  if (LoadAngZStore(ASTORE_ZXZFB, *ad, ih1, ih2) > 0) {
+    ReleaseLock(&(*ad)->lock);
+    return (*ad)->ns;
+  }
 
   ns1 = hams[ih1].nbasis;
   ns2 = hams[ih2].nbasis;
@@ -5477,6 +6736,7 @@ int AngularZxZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2) {
   stop = clock();
   timing.angzfb_states += stop-start;
 #endif
+  (*ad)->type = ASTORE_ZXZFB;
   (*ad)->ns = ns;
   ReleaseLock(&(*ad)->lock);
   return (*ad)->ns;
@@ -6645,6 +7905,8 @@ int InitAngZArray(void) {
     angzxz_array[i].nd = 0;
     angz_array[i].mk = NULL;
     angzxz_array[i].mk = NULL;
+    angz_array[i].type = -1;
+    angzxz_array[i].type = -1;
     InitLock(&angz_array[i].lock);
     InitLock(&angzxz_array[i].lock);
   }
@@ -6684,8 +7946,6 @@ void FreeLevelData(void *p) {
   LEVEL *lev;
   lev = (LEVEL *) p;
   if (lev->n_basis > 0) {
-    free(lev->basis);
-    free(lev->ibasis);
     free(lev->mixing);
     lev->n_basis = 0;
   }
@@ -6814,6 +8074,7 @@ int AllocHamMem(HAMILTON *h, int hdim, int nbasis) {
     h->iwork = NULL;
     h->heff = NULL;
     h->hsp = NULL;
+    h->neig = 0;
     return 0;
   }
   if (hdim < 0) {
@@ -6842,8 +8103,15 @@ int AllocHamMem(HAMILTON *h, int hdim, int nbasis) {
   h->dim = hdim;
   h->iham = nhams;
   h->n_basis = nbasis;
+  h->neig = hdim;
 
   h->msize = h->dim * h->n_basis + h->dim;
+  if (diag_mode > 0 && h->n_basis > diag_nbm) {
+    /* the sparse blocks have no effective hamiltonian, and only the
+       eigenvectors of the partial spectrum are stored */
+    i = DavidsonNev(h, hdim, nbasis);
+    if (i > 0) h->msize = (size_t)i * h->n_basis + h->dim;
+  }
   if (h->mixing == NULL) {
     h->msize0 = h->msize;
     h->mixing = (double *) malloc(sizeof(double)*(size_t)h->msize);
@@ -6971,6 +8239,7 @@ int InitStructure(void) {
     _allhams[i].ondim = 0;
     _allhams[i].onbs = 0;
     _allhams[i].obs = NULL;
+    _allhams[i].ohash = 0;
     _allhams[i].oham = NULL;
     _allhams[i].mmix = NULL;
     _allhams[i].perturb_iter = 0;
@@ -7077,6 +8346,35 @@ void SetOptionStructure(char *s, char *sp, int ip, double dp) {
     diag_bignore = dp;
     return;
   }
+  if (0 == strcmp(s, "structure:diag_nev")) {
+    diag_nev = ip;
+    return;
+  }
+  if (0 == strcmp(s, "structure:diag_dmin")) {
+    diag_dmin = ip;
+    return;
+  }
+  if (0 == strcmp(s, "structure:diag_dmaxiter")) {
+    diag_dmaxiter = ip;
+    return;
+  }
+  if (0 == strcmp(s, "structure:diag_dtol")) {
+    diag_dtol = dp;
+    return;
+  }
+  if (0 == strcmp(s, "structure:angz_store")) {
+    strncpy(_astore_dir, sp, sizeof(_astore_dir)-1);
+    CloseAngZStore();
+    return;
+  }
+  if (0 == strcmp(s, "structure:incremental")) {
+    incr_structure = ip;
+    return;
+  }
+  if (0 == strcmp(s, "structure:diag_dcdim")) {
+    diag_dcdim = ip;
+    return;
+  }
   if (0 == strcmp(s, "structure:mix_cut")) {
     mix_cut = dp;
     return;
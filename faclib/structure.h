@@ -34,6 +34,7 @@ typedef struct _HAMILTON_ {
   int dim;
   int ndim;
   int n_basis;
+  int neig;
   size_t hsize;
   size_t dsize;
   size_t dsize2;
@@ -57,6 +58,7 @@ typedef struct _HAMILTON_ {
   size_t ohsize;
   double *oham;
   int *obs;
+  unsigned long long ohash;
   double *mmix;
   int orig_dim;
   int exp_dim;
@@ -99,7 +101,7 @@ typedef struct _ANGZ_ARY_ {
   
 typedef struct _ANGZ_DATUM_ {
   LOCK lock;
-  int ns, nd;
+  int ns, nd, type;
   ANGZ_ARY **angz;
   double **mk;
 } ANGZ_DATUM;
@@ -201,6 +203,7 @@ int DiagnolizeHamilton(HAMILTON *h);
 int AddToLevels(HAMILTON *h, int ng, int *kg);
 int AddECorrection(int kref, int k, double e, int nmin);
 LEVEL *GetLevel(int k);
+void LevelTaskOrder(int n, int *k, int *o);
 LEVEL *GetEBLevel(int k);
 int LevelTotalJ(int k);
 int GetNumEBLevels(void);
@@ -225,6 +228,7 @@ int PackAngularZMix(int *n, ANGULAR_ZMIX **ang, int nz);
 int PackAngularZFB(int *n, ANGULAR_ZFB **ang, int nz);
 int AngularZFreeBound(ANGULAR_ZFB **ang, int lower, int upper);
 int AngularZMixStates(ANGZ_DATUM **ad, int ih1, int ih2);
+int SaveAngZStore(void);
 int AngZSwapBraKet(int nz, ANGULAR_ZMIX *ang, int p);
 int AngularZFreeBoundStates(ANGZ_DATUM **ad, int ih1, int ih2);
 int AngularZxZMixStates(ANGZ_DATUM **ad, int ih1, int ih2);
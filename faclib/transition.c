@@ -856,6 +856,8 @@ int OverlapLowUp(int nlow, int *low, int nup, int *up) {
 int SaveTransition(int nlow, int *low, int nup, int *up,
 		   char *fn, int m) {
   int n, *alev, i, nc;
+
+  MSetTag(MTAG_STRUCTURE);
   
   n = 0;
   if (nlow == 0 || nup == 0) {
@@ -3273,6 +3273,30 @@ static PyObject *PLoadRadialMultipole(PyObject *self, PyObject *args) {
   return Py_None;
 }
 
+static PyObject *PSaveRadialStore(PyObject *self, PyObject *args) {
+  if (sfac_file) {
+    SFACStatement("SaveRadialStore", args, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+
+  if (SaveRadialStore() < 0) return NULL;
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
+static PyObject *PSaveAngZStore(PyObject *self, PyObject *args) {
+  if (sfac_file) {
+    SFACStatement("SaveAngZStore", args, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+
+  if (SaveAngZStore() < 0) return NULL;
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
 static PyObject *PSaveRadialMultipole(PyObject *self, PyObject *args) {
   char *fn;
   int n, g, nk, *ks;
@@ -4170,6 +4194,22 @@ static PyObject *PTestIntegrate(PyObject *self, PyObject *args) {
   
 }
 
+static PyObject *PTestQuadrature(PyObject *self, PyObject *args) { 
+  int n;
+
+  if (sfac_file) {
+    SFACStatement("TestQuadrature", args, NULL);
+    Py_INCREF(Py_None);
+    return Py_None;
+  }
+
+  n = 1;
+  if (!PyArg_ParseTuple(args, "|i", &n)) return NULL;
+  TestQuadrature(n);
+  Py_INCREF(Py_None);
+  return Py_None;
+}
+
 static PyObject *PCoulombBethe(PyObject *self, PyObject *args) { 
   char *s;
   double z, te, e1;
@@ -6293,6 +6333,8 @@ static struct PyMethodDef fac_methods[] = {
   {"RRMultipole", PRRMultipole, METH_VARARGS},
   {"SaveRadialMultipole", PSaveRadialMultipole, METH_VARARGS},
   {"LoadRadialMultipole", PLoadRadialMultipole, METH_VARARGS},
+  {"SaveRadialStore", PSaveRadialStore, METH_VARARGS},
+  {"SaveAngZStore", PSaveAngZStore, METH_VARARGS},
   {"SetAICut", PSetAICut, METH_VARARGS},
   {"SetAngZOptions", PSetAngZOptions, METH_VARARGS},
   {"SetAngZCut", PSetAngZCut, METH_VARARGS},
@@ -6361,6 +6403,7 @@ static struct PyMethodDef fac_methods[] = {
   {"CoulombBethe", PCoulombBethe, METH_VARARGS}, 
   {"TestHamilton", PTestHamilton, METH_VARARGS}, 
   {"TestIntegrate", PTestIntegrate, METH_VARARGS}, 
+  {"TestQuadrature", PTestQuadrature, METH_VARARGS}, 
   {"TestMyArray", PTestMyArray, METH_VARARGS},        
   {"ReportMultiStats", PReportMultiStats, METH_VARARGS},     
   {"ElectronDensity", PElectronDensity, METH_VARARGS},  
@@ -1600,6 +1600,20 @@ static int PLoadRadialMultipole(int argc, char *argv[], int argt[],
   return 0;
 }
 
+static int PSaveRadialStore(int argc, char *argv[], int argt[], 
+			    ARRAY *variables) {
+  if (argc != 0) return -1;
+  if (SaveRadialStore() < 0) return -1;
+  return 0;
+}
+
+static int PSaveAngZStore(int argc, char *argv[], int argt[], 
+			  ARRAY *variables) {
+  if (argc != 0) return -1;
+  if (SaveAngZStore() < 0) return -1;
+  return 0;
+}
+
 static int PSaveRadialMultipole(int argc, char *argv[], int argt[], 
 				ARRAY *variables) {
   int n, g, nk, *ks;
@@ -3644,6 +3658,20 @@ static int PTestIntegrate(int argc, char *argv[], int argt[],
   return 0;
 }
 
+static int PTestQuadrature(int argc, char *argv[], int argt[], 
+			   ARRAY *variables) {
+  int n;
+
+  n = 1;
+  if (argc > 1) return -1;
+  if (argc > 0) {
+    if (argt[0] != NUMBER) return -1;
+    n = atoi(argv[0]);
+  }
+  TestQuadrature(n);
+  return 0;
+}
+
 static int PReportMultiStats(int argc, char *argv[], int argt[], 
 			     ARRAY *variables) {
   ReportMultiStats();
@@ -5233,6 +5261,8 @@ static METHOD methods[] = {
   {"RRMultipole", PRRMultipole, METH_VARARGS},
   {"SaveRadialMultipole", PSaveRadialMultipole, METH_VARARGS},
   {"LoadRadialMultipole", PLoadRadialMultipole, METH_VARARGS},
+  {"SaveRadialStore", PSaveRadialStore, METH_VARARGS},
+  {"SaveAngZStore", PSaveAngZStore, METH_VARARGS},
   {"SetAICut", PSetAICut, METH_VARARGS},
   {"SetAngZOptions", PSetAngZOptions, METH_VARARGS},
   {"SetAngZCut", PSetAngZCut, METH_VARARGS},
@@ -5296,6 +5326,7 @@ static METHOD methods[] = {
   {"CoulombBethe", PCoulombBethe, METH_VARARGS}, 
   {"TestAngular", PTestAngular, METH_VARARGS}, 
   {"TestIntegrate", PTestIntegrate, METH_VARARGS}, 
+  {"TestQuadrature", PTestQuadrature, METH_VARARGS}, 
   {"TestMyArray", PTestMyArray, METH_VARARGS},   
   {"ReportMultiStats", PReportMultiStats, METH_VARARGS},   
   {"ElectronDensity", PElectronDensity, METH_VARARGS},  